@@ -0,0 +1,319 @@
+#include <benchmark/benchmark.h>
+#include <PeImage.h>
+#include <PeMappedFile.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using pe_iterator::Architecture;
+using pe_iterator::Image;
+using pe_iterator::ImageType;
+using pe_iterator::RVA;
+
+static constexpr char   kCorpusVariable[]    = "PE_ITERATOR_CORPUS";
+static constexpr size_t kRvasPerSection      = 64;
+static constexpr DWORD  kMaximalModuleSize   = 256 * 1024 * 1024;
+static constexpr size_t kMaximalExportsCount = 4096;
+
+/**
+ * @brief Corpus file mapped as the raw file and copied into the module layout, with the inputs of the lookups.
+ */
+struct CorpusFile {
+    pe_iterator::MappedFile                  File;
+    std::vector<BYTE>                        Module;
+    std::optional<Image<Architecture::kX32>> FileImage32;
+    std::optional<Image<Architecture::kX64>> FileImage64;
+    std::optional<Image<Architecture::kX32>> ModuleImage32;
+    std::optional<Image<Architecture::kX64>> ModuleImage64;
+    std::vector<RVA>                         Rvas;
+    std::vector<std::string>                 Names;
+    std::vector<WORD>                        Ordinals;
+};
+
+static std::vector<CorpusFile> g_corpus;
+
+/**
+ * @brief Calls the visitor with the raw file image or the module image of the corpus file architecture.
+ */
+template<typename Visitor> void VisitCorpusImage(const CorpusFile& file, ImageType imageType, Visitor&& visitor)
+{
+    if (imageType == ImageType::kFile) {
+        if (file.FileImage64)
+            visitor(*file.FileImage64);
+        else
+            visitor(*file.FileImage32);
+    } else {
+        if (file.ModuleImage64)
+            visitor(*file.ModuleImage64);
+        else
+            visitor(*file.ModuleImage32);
+    }
+}
+
+/**
+ * @brief Copies headers and sections of the raw file to their RVAs, as the loader does without relocating or binding.
+ * @return Module layout, empty if the image declares an unreasonable size.
+ */
+template<Architecture Arch> std::vector<BYTE> MapModule(const Image<Arch>& image, const BYTE* data, size_t size)
+{
+    const auto header      = image.GetHeader();
+    const auto moduleSize  = header.GetOptionalHeader()->SizeOfImage;
+    const auto headersSize = std::min<size_t>({ header.GetOptionalHeader()->SizeOfHeaders, moduleSize, size });
+    if (!moduleSize || moduleSize > kMaximalModuleSize)
+        return {};
+
+    std::vector<BYTE> module(moduleSize);
+    memcpy(module.data(), data, headersSize);
+    for (const auto& section : image.GetSection()) {
+        if (section.VirtualAddress >= moduleSize || section.PointerToRawData >= size)
+            continue;
+
+        const auto sectionSize = std::min<size_t>({ section.SizeOfRawData, moduleSize - section.VirtualAddress, size - section.PointerToRawData });
+        memcpy(module.data() + section.VirtualAddress, data + section.PointerToRawData, sectionSize);
+    }
+
+    return module;
+}
+
+/**
+ * @brief Collects RVAs spread over the sections, exported names and ordinals of the image.
+ */
+template<Architecture Arch> void CollectInputs(const Image<Arch>& image, CorpusFile& file)
+{
+    for (const auto& section : image.GetSection()) {
+        const auto sectionSize = std::min(section.SizeOfRawData, section.Misc.VirtualSize ? section.Misc.VirtualSize : section.SizeOfRawData);
+        for (size_t cx = 0; sectionSize && cx < kRvasPerSection; ++cx)
+            file.Rvas.push_back(static_cast<RVA>(section.VirtualAddress + sectionSize * cx / kRvasPerSection));
+    }
+
+    const auto exports = image.GetExport();
+    if (!exports.IsValid())
+        return;
+
+    // Lookups are spread over the tables, so the binary search does not hit the same path every time.
+    const auto namesCount = exports.GetCountOfFunctionsNames();
+    const auto namesStep  = std::max<size_t>(namesCount / kMaximalExportsCount, 1);
+    for (DWORD nameIndex = 0; nameIndex < namesCount; nameIndex += static_cast<DWORD>(namesStep)) {
+        if (const auto name = exports.GetFunctionName(nameIndex))
+            file.Names.emplace_back(name);
+    }
+
+    const auto functionsCount = exports.GetCountFunctions();
+    const auto functionsStep  = std::max<size_t>(functionsCount / kMaximalExportsCount, 1);
+    for (DWORD functionIndex = 0; functionIndex < functionsCount; functionIndex += static_cast<DWORD>(functionsStep))
+        file.Ordinals.push_back(static_cast<WORD>(exports.GetDirectoryDescriptor()->Base + functionIndex));
+}
+
+/**
+ * @brief Keeps the raw file image and its module layout copy, and collects the lookup inputs.
+ * @return false if the image is not valid.
+ */
+template<Architecture Arch> bool AddImage(const Image<Arch>& image, CorpusFile& file)
+{
+    if (!image.GetHeader().IsValid())
+        return false;
+
+    file.Module = MapModule(image, file.File.GetData(), file.File.GetSize());
+    if (file.Module.empty())
+        return false;
+
+    const Image<Arch> moduleImage(file.Module.data(), file.Module.size(), ImageType::kModule);
+    if constexpr (Arch == Architecture::kX64) {
+        file.FileImage64.emplace(image);
+        file.ModuleImage64.emplace(moduleImage);
+    } else {
+        file.FileImage32.emplace(image);
+        file.ModuleImage32.emplace(moduleImage);
+    }
+
+    CollectInputs(image, file);
+    return true;
+}
+
+/**
+ * @brief Maps the file and adds it to the corpus if it is a valid image.
+ * @param path Path to the file.
+ */
+static void AddCorpusFile(const std::string& path)
+{
+    CorpusFile file;
+    file.File = pe_iterator::MappedFile(path.c_str());
+
+    auto added = false;
+    file.File.GetAnyImage().Visit([&](const auto& image) { added = AddImage(image, file); });
+    if (added)
+        g_corpus.push_back(std::move(file));
+    else
+        fprintf(stderr, "Skipped %s: not a valid PE image\n", path.c_str());
+}
+
+/**
+ * @brief Adds the file, or every regular file under the directory, to the corpus.
+ * @param path Path to the file or to the directory.
+ */
+static void AddCorpusPath(const std::filesystem::path& path)
+{
+    std::error_code error;
+    if (!std::filesystem::is_directory(path, error)) {
+        AddCorpusFile(path.string());
+        return;
+    }
+
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(path, std::filesystem::directory_options::skip_permission_denied, error)) {
+        if (entry.is_regular_file(error))
+            AddCorpusFile(entry.path().string());
+    }
+}
+
+/**
+ * @brief Runs the operation over every corpus file and reports ns/op and files/s.
+ * @tparam Operation Callable as operation(const CorpusFile&) returning the count of operations performed.
+ */
+template<typename Operation> void RunOverCorpus(benchmark::State& state, Operation&& operation)
+{
+    if (g_corpus.empty()) {
+        state.SkipWithError("The corpus is empty, pass PE files or directories after the benchmark flags or set PE_ITERATOR_CORPUS");
+        return;
+    }
+
+    size_t operations = 0;
+    for (auto _ : state) {
+        operations = 0;
+        for (const auto& file : g_corpus)
+            operations += operation(file);
+    }
+
+    if (!operations) {
+        state.SkipWithError("The corpus has nothing to measure");
+        return;
+    }
+
+    // Inverted rate of the per-iteration count is the time per operation, printed with the SI prefix (ns).
+    state.counters["ns/op"]   = benchmark::Counter(static_cast<double>(operations), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+    state.counters["files/s"] = benchmark::Counter(static_cast<double>(g_corpus.size()), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+static void BM_RvaToVA(benchmark::State& state, ImageType imageType)
+{
+    RunOverCorpus(state, [imageType](const CorpusFile& file) {
+        VisitCorpusImage(file, imageType, [&](const auto& image) {
+            const auto header = image.GetHeader();
+            for (const auto rva : file.Rvas)
+                benchmark::DoNotOptimize(header.template RvaToVA<BYTE>(rva));
+        });
+        return file.Rvas.size();
+    });
+}
+BENCHMARK_CAPTURE(BM_RvaToVA, File, ImageType::kFile);
+BENCHMARK_CAPTURE(BM_RvaToVA, Module, ImageType::kModule);
+
+static void BM_FindFunctionByName(benchmark::State& state)
+{
+    RunOverCorpus(state, [](const CorpusFile& file) {
+        VisitCorpusImage(file, ImageType::kFile, [&](const auto& image) {
+            const auto exports = image.GetExport();
+            for (const auto& name : file.Names)
+                benchmark::DoNotOptimize(exports.FindFunction(name.c_str()));
+        });
+        return file.Names.size();
+    });
+}
+BENCHMARK(BM_FindFunctionByName);
+
+static void BM_FindFunctionByOrdinal(benchmark::State& state)
+{
+    RunOverCorpus(state, [](const CorpusFile& file) {
+        VisitCorpusImage(file, ImageType::kFile, [&](const auto& image) {
+            const auto exports = image.GetExport();
+            for (const auto ordinal : file.Ordinals)
+                benchmark::DoNotOptimize(exports.FindFunction(ordinal));
+        });
+        return file.Ordinals.size();
+    });
+}
+BENCHMARK(BM_FindFunctionByOrdinal);
+
+static void BM_ImportWalk(benchmark::State& state)
+{
+    RunOverCorpus(state, [](const CorpusFile& file) {
+        size_t functions = 0;
+        VisitCorpusImage(file, ImageType::kFile, [&](const auto& image) {
+            for (const auto& module : image.GetImport()) {
+                benchmark::DoNotOptimize(module.GetModuleName());
+                for (const auto& function : module) {
+                    benchmark::DoNotOptimize(function.GetFunctionName());
+                    ++functions;
+                }
+            }
+        });
+        return functions;
+    });
+}
+BENCHMARK(BM_ImportWalk);
+
+static void BM_RelocationWalk(benchmark::State& state)
+{
+    RunOverCorpus(state, [](const CorpusFile& file) {
+        size_t relocations = 0;
+        VisitCorpusImage(file, ImageType::kFile, [&](const auto& image) {
+            for (const auto& block : image.GetRelocation()) {
+                for (const auto& relocation : block) {
+                    benchmark::DoNotOptimize(relocation.GetAddress());
+                    ++relocations;
+                }
+            }
+        });
+        return relocations;
+    });
+}
+BENCHMARK(BM_RelocationWalk);
+
+static void BM_TlsEnumeration(benchmark::State& state)
+{
+    // Callback addresses are VAs of the preferred base, so only the raw file resolves them without the relocation. One
+    // operation is the enumeration of one file.
+    RunOverCorpus(state, [](const CorpusFile& file) {
+        VisitCorpusImage(file, ImageType::kFile, [&](const auto& image) {
+            for (const auto& callback : image.GetTls())
+                benchmark::DoNotOptimize(callback.GetCallback());
+        });
+        return size_t{ 1 };
+    });
+}
+BENCHMARK(BM_TlsEnumeration);
+
+int main(int argc, char** argv)
+{
+    benchmark::Initialize(&argc, argv);
+
+    // Arguments left after the benchmark flags are the corpus paths.
+    for (int cx = 1; cx < argc; ++cx)
+        AddCorpusPath(argv[cx]);
+
+    if (const auto corpus = getenv(kCorpusVariable)) {
+        std::string paths = corpus;
+#if defined(_WIN32)
+        constexpr char kSeparator = ';';
+#else
+        constexpr char kSeparator = ':';
+#endif
+        for (size_t begin = 0, end; begin < paths.size(); begin = end + 1) {
+            end = paths.find(kSeparator, begin);
+            if (end == std::string::npos)
+                end = paths.size();
+            if (end > begin)
+                AddCorpusPath(paths.substr(begin, end - begin));
+        }
+    }
+
+    fprintf(stderr, "Corpus: %zu files\n", g_corpus.size());
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
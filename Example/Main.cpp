@@ -1,5 +1,8 @@
 #include <cstdio>
+#include <PeAnyImage.h>
+#include <PeExportNameIndex.h>
 #include <PeImage.h>
+#include <PeMappedFile.h>
 #include <string>
 #include <vector>
 #include <Windows.h>
@@ -14,7 +17,7 @@ static constexpr wchar_t kOptionTls[]         = L"/TLS";
 
 void ShowUsage()
 {
-    printf("Usage: PeLibExample.exe [option] [module]\nNOTE: The specified module must be loaded to the current process.\n\n");
+    printf("Usage: PeLibExample.exe [option] [module]\nNOTE: Modules not loaded to the current process are opened as files.\n\n");
     printf("  Options:\n\n");
     printf("    %ws\n", kOptionAll);
     printf("    %ws\n", kOptionSections);
@@ -25,9 +28,8 @@ void ShowUsage()
     printf("    %ws\n\n", kOptionTls);
 }
 
-void ShowSections(const pe_iterator::Image<pe_iterator::Architecture::kNative>& image)
+void ShowSections(const pe_iterator::Section& sections)
 {
-    const auto sections           = image.GetSection();
     const auto getCharacteristics = [](const pe_iterator::SectionHeader& section) -> std::string {
         std::string access;
         if (section.Characteristics & IMAGE_SCN_MEM_READ)
@@ -70,19 +72,15 @@ template<typename ImportsType> void ShowModuleNames(const ImportsType& imports,
     }
 }
 
-void ShowImports(const pe_iterator::Image<pe_iterator::Architecture::kNative>& image)
+template<pe_iterator::Architecture Arch> void ShowExports(const pe_iterator::Export<Arch>& exports)
 {
-    ShowModuleNames(image.GetImport(), "IMPORTS");
-    ShowModuleNames(image.GetDelayedImport(), "DELAYED IMPORTS");
-}
-
-void ShowExports(const pe_iterator::Image<pe_iterator::Architecture::kNative>& image)
-{
-    const auto exports = image.GetExport();
     printf("******* EXPORTS *******\n");
     if (exports.IsValid()) {
-        for (const auto& exp : exports) {
-            printf("  Name: %s\n", exp.GetName());
+        std::vector<DWORD>                       nameIndices(pe_iterator::ExportNameIndex<Arch>::GetRequiredCapacity(exports.GetCountFunctions()));
+        const pe_iterator::ExportNameIndex<Arch> names(exports, nameIndices.data(), nameIndices.size());
+        for (const auto& exp : names) {
+            if (const auto name = exp.GetName())
+                printf("  Name: %s\n", name);
             if (exp.IsForwarded())
                 printf("  Forwarded name: %s\n", exp.GetForwardedName());
             else
@@ -95,9 +93,8 @@ void ShowExports(const pe_iterator::Image<pe_iterator::Architecture::kNative>& i
     }
 }
 
-void ShowRelocations(const pe_iterator::Image<pe_iterator::Architecture::kNative>& image)
+template<pe_iterator::Architecture Arch> void ShowRelocations(const pe_iterator::Relocation<Arch>& relocations)
 {
-    const auto relocations       = image.GetRelocation();
     const auto getRelocationType = [](const pe_iterator::IMAGE_RELOC* reloc) -> std::string {
         switch (reloc->type) {
         case IMAGE_REL_BASED_ABSOLUTE: return "IMAGE_REL_BASED_ABSOLUTE";
@@ -123,9 +120,8 @@ void ShowRelocations(const pe_iterator::Image<pe_iterator::Architecture::kNative
     }
 }
 
-void ShowExceptions(const pe_iterator::Image<pe_iterator::Architecture::kNative>& image)
+template<pe_iterator::Architecture Arch> void ShowExceptions(const pe_iterator::Exception<Arch>& exceptions)
 {
-    const auto exceptions = image.GetException();
     printf("******* EXCEPTIONS *******\n");
     if (exceptions.IsValid()) {
         for (const auto& exception : exceptions)
@@ -135,9 +131,8 @@ void ShowExceptions(const pe_iterator::Image<pe_iterator::Architecture::kNative>
         printf("  NO EXCEPTIONS.\n\n");
 }
 
-void ShowTls(const pe_iterator::Image<pe_iterator::Architecture::kNative>& image)
+template<pe_iterator::Architecture Arch> void ShowTls(const pe_iterator::Tls<Arch>& tls)
 {
-    const auto tls = image.GetTls();
     printf("******* TLS *******\n");
     if (tls.IsValid()) {
         for (const auto& callback : tls)
@@ -148,9 +143,42 @@ void ShowTls(const pe_iterator::Image<pe_iterator::Architecture::kNative>& image
     }
 }
 
-bool IsOptionSelected(const wchar_t* option, const wchar_t* argvOption)
+// Shows the directories visited in the file order.
+struct DirectoryPrinter {
+    void operator()(const pe_iterator::Section& sections) const { ShowSections(sections); }
+    template<pe_iterator::Architecture Arch> void operator()(const pe_iterator::Import<Arch>& imports) const { ShowModuleNames(imports, "IMPORTS"); }
+    template<pe_iterator::Architecture Arch> void operator()(const pe_iterator::DelayedImport<Arch>& imports) const { ShowModuleNames(imports, "DELAYED IMPORTS"); }
+    template<pe_iterator::Architecture Arch> void operator()(const pe_iterator::Export<Arch>& exports) const { ShowExports(exports); }
+    template<pe_iterator::Architecture Arch> void operator()(const pe_iterator::Relocation<Arch>& relocations) const { ShowRelocations(relocations); }
+    template<pe_iterator::Architecture Arch> void operator()(const pe_iterator::Exception<Arch>& exceptions) const { ShowExceptions(exceptions); }
+    template<pe_iterator::Architecture Arch> void operator()(const pe_iterator::Tls<Arch>& tls) const { ShowTls(tls); }
+};
+
+// Shows the selected directories of the image of either architecture.
+template<pe_iterator::Architecture Arch> void ShowImage(const pe_iterator::Image<Arch>& image, const wchar_t* option)
 {
-    return lstrcmpW(option, argvOption) == 0 || lstrcmpW(argvOption, kOptionAll) == 0;
+    if (lstrcmpW(option, kOptionAll) == 0) {
+        // Every directory is touched once, in the file order, with the OS reading ahead.
+        pe_iterator::VisitOptions options;
+        options.Prefetch = image.GetHeader().GetImageType() == pe_iterator::ImageType::kFile;
+        image.Visit(DirectoryPrinter(), options);
+        return;
+    }
+
+    if (lstrcmpW(option, kOptionSections) == 0)
+        ShowSections(image.GetSection());
+    if (lstrcmpW(option, kOptionImports) == 0) {
+        ShowModuleNames(image.GetImport(), "IMPORTS");
+        ShowModuleNames(image.GetDelayedImport(), "DELAYED IMPORTS");
+    }
+    if (lstrcmpW(option, kOptionExports) == 0)
+        ShowExports(image.GetExport());
+    if (lstrcmpW(option, kOptionRelocations) == 0)
+        ShowRelocations(image.GetRelocation());
+    if (lstrcmpW(option, kOptionExceptions) == 0)
+        ShowExceptions(image.GetException());
+    if (lstrcmpW(option, kOptionTls) == 0)
+        ShowTls(image.GetTls());
 }
 
 int wmain(int argc, wchar_t** argv)
@@ -159,29 +187,21 @@ int wmain(int argc, wchar_t** argv)
         ShowUsage();
         return -1;
     }
-    const auto moduleBase = GetModuleHandleW(argv[2]);
+    const auto              moduleBase = GetModuleHandleW(argv[2]);
+    pe_iterator::MappedFile file;
     if (!moduleBase) {
-        printf("Module \"%ws\" not found.", argv[2]);
-        return -1;
+        file = pe_iterator::MappedFile(argv[2]);
+        if (!file.IsValid()) {
+            printf("Module \"%ws\" not found.", argv[2]);
+            return -1;
+        }
     }
-    const pe_iterator::Image<pe_iterator::Architecture::kNative> image(reinterpret_cast<const BYTE*>(moduleBase));
-    if (!image.GetHeader().IsValid()) {
+    // Files are bounded by their size and may be of the other architecture than the process.
+    const auto image = moduleBase ? pe_iterator::AnyImage(reinterpret_cast<const BYTE*>(moduleBase), pe_iterator::ImageType::kModule) : file.GetAnyImage();
+    if (!image.Visit([&](const auto& typed) { ShowImage(typed, argv[1]); })) {
         printf("The '%ws' module has an incorrect header.", argv[2]);
         return -1;
     }
 
-    const wchar_t* option = argv[1];
-    if (IsOptionSelected(kOptionSections, option))
-        ShowSections(image);
-    if (IsOptionSelected(kOptionImports, option))
-        ShowImports(image);
-    if (IsOptionSelected(kOptionExports, option))
-        ShowExports(image);
-    if (IsOptionSelected(kOptionRelocations, option))
-        ShowRelocations(image);
-    if (IsOptionSelected(kOptionExceptions, option))
-        ShowExceptions(image);
-    if (IsOptionSelected(kOptionTls, option))
-        ShowTls(image);
     return 0;
-}
\ No newline at end of file
+}
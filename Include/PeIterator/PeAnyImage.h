@@ -0,0 +1,132 @@
+#pragma once
+
+#include "PeImage.h"
+#include "PeTypes.h"
+
+namespace pe_iterator {
+
+/**
+ * @brief Image of the architecture known only at runtime.
+ *
+ * The optional header magic is inspected once on construction. Visit then calls a generic visitor with the matching
+ * Image<Arch>, so the caller writes its code once and both instantiations are dispatched in a single place, outside
+ * of the parsing loops.
+ */
+class AnyImage {
+public:
+    /**
+     * @brief Initialization constructor.
+     * @param imageBase Pointer to the image base.
+     * @param imageType Image type.
+     * @param sectionIndex Optional prebuilt section index used to translate RVAs of the raw file. Must outlive the image.
+     */
+    explicit AnyImage(const BYTE* imageBase, ImageType imageType = ImageType::kModule, const SectionIndex* sectionIndex = nullptr) noexcept
+        : AnyImage(imageBase, 0, imageType, sectionIndex)
+    {
+    }
+
+    /**
+     * @brief Initialization constructor of the bounded image, see Header for the checks performed.
+     * @param imageBase Pointer to the image base.
+     * @param imageSize Size of the image in bytes.
+     * @param imageType Image type.
+     * @param sectionIndex Optional prebuilt section index used to translate RVAs of the raw file. Must outlive the image.
+     */
+    AnyImage(const BYTE* imageBase, size_t imageSize, ImageType imageType = ImageType::kModule, const SectionIndex* sectionIndex = nullptr) noexcept
+        : imageBase_(imageBase)
+        , imageSize_(imageBase ? imageSize : 0)
+        , imageType_(imageType)
+        , sectionIndex_(sectionIndex)
+    {
+        if (!imageBase_)
+            return;
+
+        // Signatures and the magic have the same offsets in both architectures, the smaller x86 headers are checked first.
+        const Header<Architecture::kX32> header(imageBase_, imageSize_, imageType_);
+        if (!header.IsValid())
+            return;
+
+        switch (header.GetOptionalHeader()->Magic) {
+        case IMAGE_NT_OPTIONAL_HDR32_MAGIC:
+            architecture_ = Architecture::kX32;
+            valid_        = true;
+            break;
+        case IMAGE_NT_OPTIONAL_HDR64_MAGIC:
+            architecture_ = Architecture::kX64;
+            valid_        = Header<Architecture::kX64>(imageBase_, imageSize_, imageType_).IsValid();
+            break;
+        default: break;
+        }
+    }
+
+    /**
+     * @brief Returns true if headers are valid and the architecture is known.
+     */
+    bool IsValid() const noexcept { return valid_; }
+
+    /**
+     * @brief Returns image architecture, meaningful only for the valid image.
+     */
+    Architecture GetArchitecture() const noexcept { return architecture_; }
+
+    /**
+     * @brief Returns image type.
+     */
+    ImageType GetImageType() const noexcept { return imageType_; }
+
+    /**
+     * @brief Calls the visitor with the image of the detected architecture.
+     * @tparam Visitor Callable as visitor(const Image<Arch>&) for both architectures, e.g. generic lambda.
+     * @param visitor Visitor.
+     * @return false if the image is not valid and the visitor was not called.
+     */
+    template<typename Visitor> bool Visit(Visitor&& visitor) const
+    {
+        if (!valid_)
+            return false;
+
+        if (architecture_ == Architecture::kX64)
+            visitor(Image<Architecture::kX64>(imageBase_, imageSize_, imageType_, sectionIndex_));
+        else
+            visitor(Image<Architecture::kX32>(imageBase_, imageSize_, imageType_, sectionIndex_));
+
+        return true;
+    }
+
+private:
+    const BYTE*         imageBase_;
+    size_t              imageSize_;
+    ImageType           imageType_;
+    const SectionIndex* sectionIndex_;
+    Architecture        architecture_ = Architecture::kX32;
+    bool                valid_        = false;
+};
+
+/**
+ * @brief Calls the visitor with the image of the architecture detected by the optional header magic.
+ * @tparam Visitor Callable as visitor(const Image<Arch>&) for both architectures, e.g. generic lambda.
+ * @param imageBase Pointer to the image base.
+ * @param imageType Image type.
+ * @param visitor Visitor.
+ * @return false if the image is not valid and the visitor was not called.
+ */
+template<typename Visitor> bool VisitImage(const BYTE* imageBase, ImageType imageType, Visitor&& visitor)
+{
+    return AnyImage(imageBase, imageType).Visit(visitor);
+}
+
+/**
+ * @brief Calls the visitor with the bounded image of the architecture detected by the optional header magic.
+ * @tparam Visitor Callable as visitor(const Image<Arch>&) for both architectures, e.g. generic lambda.
+ * @param imageBase Pointer to the image base.
+ * @param imageSize Size of the image in bytes.
+ * @param imageType Image type.
+ * @param visitor Visitor.
+ * @return false if the image is not valid and the visitor was not called.
+ */
+template<typename Visitor> bool VisitImage(const BYTE* imageBase, size_t imageSize, ImageType imageType, Visitor&& visitor)
+{
+    return AnyImage(imageBase, imageSize, imageType).Visit(visitor);
+}
+
+}
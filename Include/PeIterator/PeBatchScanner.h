@@ -0,0 +1,204 @@
+#pragma once
+
+#include "PeAnyImage.h"
+#include "PeMappedFile.h"
+#include "PeParallel.h"
+#include "PeTypes.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+namespace pe_iterator {
+
+/**
+ * @brief Options of the batch scanner.
+ */
+struct BatchOptions {
+    size_t Workers  = 0; // Count of workers, 0 for the hardware concurrency, at most ParallelOptions::kMaxTasks.
+    size_t MaxViews = 0; // Maximal count of simultaneously mapped files, 0 for one per worker.
+
+    /**
+     * @brief Returns count of workers for the specified count of files.
+     * @param files Count of files.
+     */
+    size_t GetWorkerCount(size_t files) const noexcept
+    {
+        const size_t workers = Workers ? Workers : std::thread::hardware_concurrency();
+        return std::max<size_t>(1, std::min<size_t>({ workers, ParallelOptions::kMaxTasks, files }));
+    }
+};
+
+/**
+ * @brief Scans a batch of files on a pool of workers.
+ *
+ * Files are split into contiguous ranges, one per worker. A worker takes files from the front of its own range and,
+ * once it is exhausted, steals the back half of the largest remaining range of another worker. Every file is mapped,
+ * its architecture detected, and the visitor called with the bounded Image<Arch> and the state of the worker, so
+ * results are collected per worker without synchronization. The count of simultaneously mapped views is bounded, a
+ * worker waits for a free view before mapping the next file.
+ */
+class BatchScanner {
+public:
+    /**
+     * @brief Initialization constructor.
+     * @param options Batch options.
+     */
+    explicit BatchScanner(const BatchOptions& options = BatchOptions()) noexcept
+        : options_(options)
+    {
+    }
+
+    /**
+     * @brief Returns count of workers the scan of the specified count of files runs on, also the count of states it requires.
+     * @param files Count of files.
+     */
+    size_t GetWorkerCount(size_t files) const noexcept { return options_.GetWorkerCount(files); }
+
+    /**
+     * @brief Scans the files on the threads of the ThreadExecutor.
+     * @tparam Path const char* or const wchar_t*.
+     * @tparam State Worker state type.
+     * @tparam Visitor Callable as visitor(State& state, size_t index, const Image<Arch>& image) for both architectures.
+     * @param paths Pointer to the file paths.
+     * @param count Count of the files.
+     * @param states Pointer to the worker states, GetWorkerCount(count) of them.
+     * @param visitor Visitor invoked for every file mapped as a valid image, concurrently from the workers.
+     * @return Count of files visited.
+     */
+    template<typename Path, typename State, typename Visitor> size_t Scan(const Path* paths, size_t count, State* states, Visitor&& visitor) const
+    {
+        return Scan(paths, count, states, visitor, ThreadExecutor());
+    }
+
+    /**
+     * @brief Scans the files on the tasks of the executor.
+     * @tparam Executor Callable as executor(size_t count, const Task& task), see ParallelOptions. Tasks should run
+     * concurrently, though the scan completes on any executor.
+     */
+    template<typename Path, typename State, typename Visitor, typename Executor>
+    size_t Scan(const Path* paths, size_t count, State* states, Visitor&& visitor, Executor&& executor) const
+    {
+        if (!paths || !count || !states || count > 0xFFFFFFFF)
+            return 0;
+
+        const auto workers = GetWorkerCount(count);
+
+        Range ranges[ParallelOptions::kMaxTasks];
+        for (size_t worker = 0; worker < workers; ++worker)
+            ranges[worker].Store(worker * count / workers, (worker + 1) * count / workers);
+
+        ViewLimiter limiter(options_.MaxViews ? options_.MaxViews : workers);
+
+        std::atomic<size_t> visited(0);
+        executor(workers, [&](size_t worker) {
+            size_t local = 0, index;
+            while (Take(ranges, workers, worker, index)) {
+                limiter.Acquire();
+                MappedFile file(paths[index]);
+                local += file.GetAnyImage().Visit([&](const auto& image) { visitor(states[worker], index, image); });
+                file.Close();
+                limiter.Release();
+            }
+
+            visited.fetch_add(local, std::memory_order_relaxed);
+        });
+
+        return visited.load();
+    }
+
+private:
+    /**
+     * @brief Range of file indices owned by the worker, both bounds packed for the atomic update.
+     */
+    struct alignas(64) Range {
+        std::atomic<uint64_t> Bounds { 0 };
+
+        void Store(uint64_t begin, uint64_t end) noexcept { Bounds.store(begin << 32 | end, std::memory_order_relaxed); }
+    };
+
+    /**
+     * @brief Semaphore bounding the count of mapped views.
+     */
+    class ViewLimiter {
+    public:
+        explicit ViewLimiter(size_t views) noexcept
+            : available_(views)
+        {
+        }
+
+        void Acquire()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this] { return available_ != 0; });
+            --available_;
+        }
+
+        void Release()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++available_;
+            }
+
+            condition_.notify_one();
+        }
+
+    private:
+        std::mutex              mutex_;
+        std::condition_variable condition_;
+        size_t                  available_;
+    };
+
+    /**
+     * @brief Takes the next file of the worker, stealing from other workers if its own range is exhausted.
+     * @param ranges Ranges of the workers.
+     * @param workers Count of the workers.
+     * @param worker Index of the worker.
+     * @param index Receives index of the file.
+     * @return false if all files are taken.
+     */
+    static bool Take(Range* ranges, size_t workers, size_t worker, size_t& index) noexcept
+    {
+        for (;;) {
+            // Own range is taken from the front.
+            auto& own    = ranges[worker].Bounds;
+            auto  bounds = own.load(std::memory_order_acquire);
+            while ((bounds >> 32) < (bounds & 0xFFFFFFFF)) {
+                if (own.compare_exchange_weak(bounds, bounds + (uint64_t(1) << 32), std::memory_order_acq_rel)) {
+                    index = static_cast<size_t>(bounds >> 32);
+                    return true;
+                }
+            }
+
+            // Steal the back half of the largest range, retrying while other workers race for it.
+            size_t victim = workers, largest = 0;
+            for (size_t cx = 0; cx < workers; ++cx) {
+                const auto other     = ranges[cx].Bounds.load(std::memory_order_acquire);
+                const auto remaining = (other & 0xFFFFFFFF) - std::min(other >> 32, other & 0xFFFFFFFF);
+                if (cx != worker && remaining > largest) {
+                    victim  = cx;
+                    largest = static_cast<size_t>(remaining);
+                }
+            }
+
+            if (victim == workers)
+                return false;
+
+            auto       other = ranges[victim].Bounds.load(std::memory_order_acquire);
+            const auto begin = other >> 32, end = other & 0xFFFFFFFF;
+            if (begin >= end)
+                continue;
+
+            const auto middle = end - (end - begin + 1) / 2;
+            if (!ranges[victim].Bounds.compare_exchange_strong(other, begin << 32 | middle, std::memory_order_acq_rel))
+                continue;
+
+            // Only the owner refills its exhausted range, other workers do not steal from the empty one.
+            ranges[worker].Store(middle, end);
+        }
+    }
+
+    BatchOptions options_;
+};
+
+}
@@ -0,0 +1,609 @@
+#pragma once
+
+#include "PeImage.h"
+#include "PeSummary.h"
+#include "PeTypes.h"
+#include <cstring>
+
+namespace pe_iterator {
+
+constexpr uint32_t kColumnarSignature = 0x4C4F4350; // "PCOL"
+constexpr uint32_t kColumnarVersion   = 1;
+constexpr uint32_t kColumnarNoString  = 0xFFFFFFFF; // String offset of the absent string.
+
+/**
+ * @brief Tables of the columnar batch, rows of all images of the batch grouped by image.
+ */
+enum class ColumnarTable : BYTE {
+    kImage,
+    kSection,
+    kModule,  // Imported modules of the image followed by its delay-loaded ones.
+    kImport,  // Imported functions grouped by module.
+    kExport,  // Exported functions, named ones followed by ordinal-only ones.
+    kCount
+};
+
+/**
+ * @brief Column arrays of the columnar batch, each column holds one field of all rows of its table.
+ */
+enum class ColumnarColumn : BYTE {
+    kImageName,              // uint32_t string offset of the name passed with the image, or of the export module name.
+    kImageArchitecture,      // DWORD architecture of the image.
+    kImageMachine,           // DWORD file header machine.
+    kImageTimeDateStamp,     // DWORD file header time stamp.
+    kImageCheckSum,          // DWORD optional header checksum.
+    kImageSizeOfImage,       // DWORD size of the loaded image.
+    kImageFirstSection,      // DWORD index of the first section row of the image, CountOfImages + 1 entries.
+    kImageFirstModule,       // DWORD index of the first module row of the image, CountOfImages + 1 entries.
+    kImageFirstExport,       // DWORD index of the first export row of the image, CountOfImages + 1 entries.
+    kSectionName,            // uint32_t string offset of the section name.
+    kSectionRva,             // RVA of the section.
+    kSectionVirtualSize,     // DWORD virtual size of the section.
+    kSectionRawSize,         // DWORD size of the section data in the file.
+    kSectionCharacteristics, // DWORD section characteristics.
+    kModuleName,             // uint32_t string offset of the imported module name.
+    kModuleFirstImport,      // DWORD index of the first import row of the module, CountOfModules + 1 entries.
+    kModuleFlags,            // DWORD module flags, kSummaryModuleDelayed.
+    kImportName,             // uint32_t string offset of the imported function name, kColumnarNoString if imported by ordinal.
+    kImportOrdinal,          // WORD ordinal of the function imported by ordinal, or hint of the function imported by name.
+    kExportName,             // uint32_t string offset of the exported function name, kColumnarNoString if exported by ordinal.
+    kExportOrdinal,          // WORD ordinal of the exported function.
+    kExportRva,              // RVA of the exported function, 0 if forwarded.
+    kExportForwarder,        // uint32_t string offset of the forwarder, kColumnarNoString if not forwarded.
+    kCount
+};
+
+/**
+ * @brief Location of the column array within the batch, its size prefixes the data.
+ */
+struct ColumnarColumnHeader {
+    uint32_t Offset; // Offset of the array from the batch start.
+    uint32_t Size;   // Size of the array in bytes.
+};
+
+/**
+ * @brief Fixed header of the columnar batch.
+ *
+ * The batch is one contiguous block of the header, column arrays and the string pool shared by all images, referring to
+ * its parts only by offsets from its start: it can be written to disk as is and read back by memory mapping. Every string
+ * is stored once per batch, so module names and common function names take no space after their first row.
+ */
+struct ColumnarBatch {
+    uint32_t             Signature;                                            // kColumnarSignature.
+    uint32_t             Version;                                              // kColumnarVersion.
+    uint32_t             Size;                                                 // Size of the batch in bytes.
+    uint32_t             Rows[static_cast<size_t>(ColumnarTable::kCount)];     // Rows of every table.
+    ColumnarColumnHeader Columns[static_cast<size_t>(ColumnarColumn::kCount)]; // Locations of the column arrays.
+    uint32_t             StringPool;                                           // Offset of the pool of null-terminated strings.
+    uint32_t             StringPoolSize;                                       // Size of the string pool in bytes.
+};
+
+/**
+ * @brief Returns table of the columnar column.
+ * @param column Columnar column.
+ */
+constexpr ColumnarTable GetColumnarTable(ColumnarColumn column) noexcept
+{
+    return column <= ColumnarColumn::kImageFirstExport      ? ColumnarTable::kImage
+        : column <= ColumnarColumn::kSectionCharacteristics ? ColumnarTable::kSection
+        : column <= ColumnarColumn::kModuleFlags            ? ColumnarTable::kModule
+        : column <= ColumnarColumn::kImportOrdinal          ? ColumnarTable::kImport
+                                                            : ColumnarTable::kExport;
+}
+
+/**
+ * @brief Returns size of the element of the columnar column.
+ * @param column Columnar column.
+ */
+constexpr size_t GetColumnarElementSize(ColumnarColumn column) noexcept
+{
+    return column == ColumnarColumn::kImportOrdinal || column == ColumnarColumn::kExportOrdinal ? sizeof(WORD) : sizeof(DWORD);
+}
+
+/**
+ * @brief Returns count of elements of the column for the count of rows of its table.
+ * @param column Columnar column.
+ * @param rows Rows of the table.
+ */
+constexpr uint64_t GetColumnarElementCount(ColumnarColumn column, uint64_t rows) noexcept
+{
+    return column == ColumnarColumn::kImageFirstSection || column == ColumnarColumn::kImageFirstModule || column == ColumnarColumn::kImageFirstExport
+                || column == ColumnarColumn::kModuleFirstImport
+             ? rows + 1
+             : rows;
+}
+
+/**
+ * @brief Read-only view of the columnar batch, validating the batch of an untrusted origin once.
+ */
+class ColumnarView {
+public:
+    /**
+     * @brief Initialization constructor.
+     * @param data Pointer to the batch, aligned as ColumnarBatch.
+     * @param size Size of the data in bytes.
+     */
+    ColumnarView(const void* data, size_t size) noexcept
+        : batch_(Validate(data, size))
+    {
+    }
+
+    /**
+     * @brief Returns true if the batch is valid.
+     */
+    bool IsValid() const noexcept { return batch_ != nullptr; }
+
+    /**
+     * @brief Returns pointer to the batch header.
+     */
+    const ColumnarBatch* GetBatch() const noexcept { return batch_; }
+
+    /**
+     * @brief Returns count of rows of the table.
+     * @param table Columnar table.
+     */
+    uint32_t GetRows(ColumnarTable table) const noexcept { return batch_->Rows[static_cast<size_t>(table)]; }
+
+    /**
+     * @brief Returns pointer to the column array.
+     * @tparam T Element type, of the size of the column element.
+     * @param column Columnar column.
+     * @return Pointer to the array, or nullptr if the element type does not match the column.
+     */
+    template<typename T> const T* GetColumn(ColumnarColumn column) const noexcept
+    {
+        if (sizeof(T) != GetColumnarElementSize(column))
+            return nullptr;
+
+        return reinterpret_cast<const T*>(reinterpret_cast<const BYTE*>(batch_) + batch_->Columns[static_cast<size_t>(column)].Offset);
+    }
+
+    /**
+     * @brief Returns the string of the pool.
+     * @param offset String offset.
+     * @return Pointer to the null-terminated string, or nullptr for kColumnarNoString.
+     */
+    const char* GetString(uint32_t offset) const noexcept
+    {
+        return offset < batch_->StringPoolSize ? reinterpret_cast<const char*>(batch_) + batch_->StringPool + offset : nullptr;
+    }
+
+private:
+    /**
+     * @brief Checks the header, columns and string pool lie within the batch, and the row ranges within their tables.
+     * @return Pointer to the batch, or nullptr if not valid.
+     */
+    static const ColumnarBatch* Validate(const void* data, size_t size) noexcept
+    {
+        const auto batch = static_cast<const ColumnarBatch*>(data);
+        if (!batch || size < sizeof(ColumnarBatch) || reinterpret_cast<uintptr_t>(data) % alignof(ColumnarBatch) != 0)
+            return nullptr;
+
+        if (batch->Signature != kColumnarSignature || batch->Version != kColumnarVersion || batch->Size > size || batch->Size < sizeof(ColumnarBatch))
+            return nullptr;
+
+        for (size_t cx = 0; cx < static_cast<size_t>(ColumnarColumn::kCount); ++cx) {
+            const auto  column = static_cast<ColumnarColumn>(cx);
+            const auto& header = batch->Columns[cx];
+            if (header.Offset % GetColumnarElementSize(column) != 0
+                || header.Size != GetColumnarElementCount(column, batch->Rows[static_cast<size_t>(GetColumnarTable(column))]) * GetColumnarElementSize(column)
+                || static_cast<uint64_t>(header.Offset) + header.Size > batch->Size)
+                return nullptr;
+        }
+
+        if (!IsRangeValid(batch, ColumnarColumn::kImageFirstSection, ColumnarTable::kSection)
+            || !IsRangeValid(batch, ColumnarColumn::kImageFirstModule, ColumnarTable::kModule)
+            || !IsRangeValid(batch, ColumnarColumn::kImageFirstExport, ColumnarTable::kExport)
+            || !IsRangeValid(batch, ColumnarColumn::kModuleFirstImport, ColumnarTable::kImport))
+            return nullptr;
+
+        // The pool ends with a terminator, so every string offset within it reads a terminated string.
+        const auto pool = reinterpret_cast<const char*>(batch) + batch->StringPool;
+        if (static_cast<uint64_t>(batch->StringPool) + batch->StringPoolSize > batch->Size || (batch->StringPoolSize && pool[batch->StringPoolSize - 1] != '\0'))
+            return nullptr;
+
+        return batch;
+    }
+
+    /**
+     * @brief Checks the first row indices of the range column do not decrease and end within the rows of the table.
+     * @param batch Pointer to the batch with the column within it.
+     * @param column Range column, its row count plus one entries.
+     * @param table Table the indices refer to.
+     */
+    static bool IsRangeValid(const ColumnarBatch* batch, ColumnarColumn column, ColumnarTable table) noexcept
+    {
+        const auto& header  = batch->Columns[static_cast<size_t>(column)];
+        const auto  indices = reinterpret_cast<const DWORD*>(reinterpret_cast<const BYTE*>(batch) + header.Offset);
+        const auto  count   = header.Size / sizeof(DWORD);
+
+        for (size_t cx = 1; cx < count; ++cx) {
+            if (indices[cx] < indices[cx - 1])
+                return false;
+        }
+
+        return indices[count - 1] <= batch->Rows[static_cast<size_t>(table)];
+    }
+
+    const ColumnarBatch* batch_;
+};
+
+/**
+ * @brief Capacities of the columnar batch.
+ */
+struct ColumnarCapacity {
+    uint32_t Images;         // Rows of the image table.
+    uint32_t Sections;       // Rows of the section table.
+    uint32_t Modules;        // Rows of the module table.
+    uint32_t Imports;        // Rows of the import table.
+    uint32_t Exports;        // Rows of the export table.
+    uint32_t StringPoolSize; // Size of the string pool in bytes.
+};
+
+/**
+ * @brief Streams images into the columnar batch in a caller-supplied buffer.
+ *
+ * Columns are reserved in the buffer for the capacities, facts are written straight from the iterators into the rows,
+ * strings are interned into the pool through a hash table kept behind it. An image is counted before it is written, so
+ * an image which does not fit leaves the batch intact: the caller finishes the batch and appends the image to the next
+ * one. Finish moves the columns together and drops the hash table, the batch takes no more space than its rows.
+ */
+class ColumnarWriter {
+public:
+    /**
+     * @brief Returns size of the buffer the batch of the capacities needs.
+     * @param capacity Batch capacities.
+     */
+    static uint64_t GetRequiredSize(const ColumnarCapacity& capacity) noexcept
+    {
+        uint64_t size = sizeof(ColumnarBatch);
+        for (size_t cx = 0; cx < static_cast<size_t>(ColumnarColumn::kCount); ++cx) {
+            const auto column = static_cast<ColumnarColumn>(cx);
+            size              = Align(size, sizeof(DWORD));
+            size += GetColumnarElementCount(column, GetRows(capacity, GetColumnarTable(column))) * GetColumnarElementSize(column);
+        }
+
+        return Align(size + capacity.StringPoolSize, sizeof(uint32_t)) + GetSlotCount(capacity) * sizeof(uint32_t);
+    }
+
+    /**
+     * @brief Initialization constructor.
+     * @param buffer Pointer to the buffer, aligned as ColumnarBatch.
+     * @param size Size of the buffer in bytes, see GetRequiredSize.
+     * @param capacity Batch capacities.
+     */
+    ColumnarWriter(void* buffer, size_t size, const ColumnarCapacity& capacity) noexcept
+        : batch_(size >= GetRequiredSize(capacity) && GetRequiredSize(capacity) <= 0xFFFFFFFF && buffer
+                         && reinterpret_cast<uintptr_t>(buffer) % alignof(ColumnarBatch) == 0
+                     ? static_cast<ColumnarBatch*>(buffer)
+                     : nullptr)
+        , capacity_(capacity)
+        , slots_(nullptr)
+        , slotMask_(GetSlotCount(capacity) - 1)
+    {
+        Reset();
+    }
+
+    /**
+     * @brief Initialization constructor, allocating the buffer from the arena.
+     * @param arena Arena the buffer is allocated from.
+     * @param capacity Batch capacities.
+     */
+    ColumnarWriter(Arena& arena, const ColumnarCapacity& capacity) noexcept
+        : ColumnarWriter(Allocate(arena, capacity), static_cast<size_t>(GetRequiredSize(capacity)), capacity)
+    {
+    }
+
+    ColumnarWriter(const ColumnarWriter&)            = delete;
+    ColumnarWriter& operator=(const ColumnarWriter&) = delete;
+
+    /**
+     * @brief Returns true if the buffer holds the batch of the capacities.
+     */
+    bool IsValid() const noexcept { return batch_ != nullptr; }
+
+    /**
+     * @brief Returns count of images appended to the batch.
+     */
+    uint32_t GetCountOfImages() const noexcept { return batch_ ? batch_->Rows[static_cast<size_t>(ColumnarTable::kImage)] : 0; }
+
+    /**
+     * @brief Appends the image to the batch.
+     * @tparam Arch Image architecture.
+     * @param image Image to append.
+     * @param name Name of the image, e.g. its path, or nullptr to use the export module name.
+     * @return false if the image is not valid, the batch is finished, or the image does not fit into the remaining capacity.
+     */
+    template<Architecture Arch> bool Append(const Image<Arch>& image, const char* name = nullptr)
+    {
+        const auto header = image.GetHeader();
+        if (!batch_ || finished_ || !header.IsValid())
+            return false;
+
+        Counter counter;
+        counter.Strings = name ? static_cast<uint64_t>(strlen(name)) + 1 : 0;
+        Summarizer<Arch>::Walk(image, counter);
+
+        // Strings are counted before interning, so the check holds however many of them the pool already has.
+        const auto rows = batch_->Rows;
+        if (rows[static_cast<size_t>(ColumnarTable::kImage)] + 1ull > capacity_.Images
+            || rows[static_cast<size_t>(ColumnarTable::kSection)] + counter.Rows[static_cast<size_t>(ColumnarTable::kSection)] > capacity_.Sections
+            || rows[static_cast<size_t>(ColumnarTable::kModule)] + counter.Rows[static_cast<size_t>(ColumnarTable::kModule)] > capacity_.Modules
+            || rows[static_cast<size_t>(ColumnarTable::kImport)] + counter.Rows[static_cast<size_t>(ColumnarTable::kImport)] > capacity_.Imports
+            || rows[static_cast<size_t>(ColumnarTable::kExport)] + counter.Rows[static_cast<size_t>(ColumnarTable::kExport)] > capacity_.Exports
+            || batch_->StringPoolSize + counter.Strings > capacity_.StringPoolSize)
+            return false;
+
+        const auto nt  = header.GetNtHeaders();
+        const auto row = rows[static_cast<size_t>(ColumnarTable::kImage)]++;
+        Column<uint32_t>(ColumnarColumn::kImageName)[row]       = name ? Intern(name, strlen(name)) : kColumnarNoString;
+        Column<DWORD>(ColumnarColumn::kImageArchitecture)[row]  = static_cast<DWORD>(Arch);
+        Column<DWORD>(ColumnarColumn::kImageMachine)[row]       = nt->FileHeader.Machine;
+        Column<DWORD>(ColumnarColumn::kImageTimeDateStamp)[row] = nt->FileHeader.TimeDateStamp;
+        Column<DWORD>(ColumnarColumn::kImageCheckSum)[row]      = nt->OptionalHeader.CheckSum;
+        Column<DWORD>(ColumnarColumn::kImageSizeOfImage)[row]   = nt->OptionalHeader.SizeOfImage;
+        Column<DWORD>(ColumnarColumn::kImageFirstSection)[row]  = rows[static_cast<size_t>(ColumnarTable::kSection)];
+        Column<DWORD>(ColumnarColumn::kImageFirstModule)[row]   = rows[static_cast<size_t>(ColumnarTable::kModule)];
+        Column<DWORD>(ColumnarColumn::kImageFirstExport)[row]   = rows[static_cast<size_t>(ColumnarTable::kExport)];
+
+        Writer writer(*this, row, name == nullptr);
+        Summarizer<Arch>::Walk(image, writer);
+
+        // Closing entries of the range columns, overwritten by the next image.
+        Column<DWORD>(ColumnarColumn::kImageFirstSection)[row + 1] = rows[static_cast<size_t>(ColumnarTable::kSection)];
+        Column<DWORD>(ColumnarColumn::kImageFirstModule)[row + 1]  = rows[static_cast<size_t>(ColumnarTable::kModule)];
+        Column<DWORD>(ColumnarColumn::kImageFirstExport)[row + 1]  = rows[static_cast<size_t>(ColumnarTable::kExport)];
+        Column<DWORD>(ColumnarColumn::kModuleFirstImport)[rows[static_cast<size_t>(ColumnarTable::kModule)]] = rows[static_cast<size_t>(ColumnarTable::kImport)];
+        return true;
+    }
+
+    /**
+     * @brief Finishes the batch, moving the columns and the string pool next to each other.
+     * @return Pointer to the batch at the start of the buffer, its Size is the count of bytes to write, or nullptr if the
+     * writer is not valid. Reset starts the next batch in the same buffer.
+     */
+    const ColumnarBatch* Finish() noexcept
+    {
+        if (!batch_)
+            return nullptr;
+
+        if (finished_)
+            return batch_;
+
+        // Compacted offsets never exceed the reserved ones, so moving the arrays in order does not overwrite any of them.
+        uint64_t size = sizeof(ColumnarBatch);
+        for (size_t cx = 0; cx < static_cast<size_t>(ColumnarColumn::kCount); ++cx) {
+            const auto column = static_cast<ColumnarColumn>(cx);
+            auto&      header = batch_->Columns[cx];
+            size              = Align(size, sizeof(DWORD));
+            header.Size       = static_cast<uint32_t>(GetColumnarElementCount(column, batch_->Rows[static_cast<size_t>(GetColumnarTable(column))])
+                                                * GetColumnarElementSize(column));
+            memmove(GetData() + size, GetData() + header.Offset, header.Size);
+            header.Offset = static_cast<uint32_t>(size);
+            size += header.Size;
+        }
+
+        memmove(GetData() + size, GetData() + batch_->StringPool, batch_->StringPoolSize);
+        batch_->StringPool = static_cast<uint32_t>(size);
+        size += batch_->StringPoolSize;
+
+        // Padding up to the alignment of the next batch written after this one is zeroed.
+        const auto aligned = Align(size, alignof(ColumnarBatch));
+        memset(GetData() + size, 0, static_cast<size_t>(aligned - size));
+        batch_->Size = static_cast<uint32_t>(aligned);
+        finished_    = true;
+        return batch_;
+    }
+
+    /**
+     * @brief Discards the batch and starts the next one in the same buffer.
+     */
+    void Reset() noexcept
+    {
+        finished_ = false;
+        if (!batch_)
+            return;
+
+        memset(batch_, 0, sizeof(ColumnarBatch));
+        batch_->Signature = kColumnarSignature;
+        batch_->Version   = kColumnarVersion;
+
+        uint64_t size = sizeof(ColumnarBatch);
+        for (size_t cx = 0; cx < static_cast<size_t>(ColumnarColumn::kCount); ++cx) {
+            const auto column          = static_cast<ColumnarColumn>(cx);
+            size                       = Align(size, sizeof(DWORD));
+            batch_->Columns[cx].Offset = static_cast<uint32_t>(size);
+            size += GetColumnarElementCount(column, GetRows(capacity_, GetColumnarTable(column))) * GetColumnarElementSize(column);
+        }
+
+        batch_->StringPool = static_cast<uint32_t>(size);
+        slots_             = reinterpret_cast<uint32_t*>(GetData() + Align(size + capacity_.StringPoolSize, sizeof(uint32_t)));
+        memset(slots_, 0, (static_cast<size_t>(slotMask_) + 1) * sizeof(uint32_t));
+
+        Column<DWORD>(ColumnarColumn::kImageFirstSection)[0] = 0;
+        Column<DWORD>(ColumnarColumn::kImageFirstModule)[0]  = 0;
+        Column<DWORD>(ColumnarColumn::kImageFirstExport)[0]  = 0;
+        Column<DWORD>(ColumnarColumn::kModuleFirstImport)[0] = 0;
+    }
+
+private:
+    /**
+     * @brief Walk sink counting rows and string bytes of the image.
+     */
+    struct Counter {
+        uint64_t Rows[static_cast<size_t>(ColumnarTable::kCount)] = {};
+        uint64_t Strings                                          = 0;
+
+        void ExportModule(const char* name) noexcept { String(name); }
+        void Section(const SectionHeader& section) noexcept
+        {
+            ++Rows[static_cast<size_t>(ColumnarTable::kSection)];
+            Strings += GetSectionNameLength(section) + 1;
+        }
+        void Module(const char* name, DWORD) noexcept
+        {
+            ++Rows[static_cast<size_t>(ColumnarTable::kModule)];
+            String(name);
+        }
+        void Import(const char* name, WORD) noexcept
+        {
+            ++Rows[static_cast<size_t>(ColumnarTable::kImport)];
+            String(name);
+        }
+        void Export(const char* name, Ordinal, RVA, const char* forwarder) noexcept
+        {
+            ++Rows[static_cast<size_t>(ColumnarTable::kExport)];
+            String(name);
+            String(forwarder);
+        }
+        void TlsCallback(RVA) noexcept {}
+
+    private:
+        void String(const char* string) noexcept { Strings += string ? strlen(string) + 1 : 0; }
+    };
+
+    /**
+     * @brief Walk sink writing rows of the image.
+     */
+    class Writer {
+    public:
+        Writer(ColumnarWriter& writer, uint32_t image, bool exportName) noexcept
+            : writer_(writer)
+            , image_(image)
+            , exportName_(exportName)
+        {
+        }
+
+        void ExportModule(const char* name) noexcept
+        {
+            if (exportName_ && name)
+                writer_.Column<uint32_t>(ColumnarColumn::kImageName)[image_] = writer_.Intern(name, strlen(name));
+        }
+        void Section(const SectionHeader& section) noexcept
+        {
+            const auto row      = NextRow(ColumnarTable::kSection);
+            const auto nameSize = GetSectionNameLength(section);
+            writer_.Column<uint32_t>(ColumnarColumn::kSectionName)[row]         = writer_.Intern(reinterpret_cast<const char*>(section.Name), nameSize);
+            writer_.Column<RVA>(ColumnarColumn::kSectionRva)[row]               = section.VirtualAddress;
+            writer_.Column<DWORD>(ColumnarColumn::kSectionVirtualSize)[row]     = section.Misc.VirtualSize;
+            writer_.Column<DWORD>(ColumnarColumn::kSectionRawSize)[row]         = section.SizeOfRawData;
+            writer_.Column<DWORD>(ColumnarColumn::kSectionCharacteristics)[row] = section.Characteristics;
+        }
+        void Module(const char* name, DWORD flags) noexcept
+        {
+            const auto row                                                 = NextRow(ColumnarTable::kModule);
+            writer_.Column<uint32_t>(ColumnarColumn::kModuleName)[row]     = writer_.Intern(name);
+            writer_.Column<DWORD>(ColumnarColumn::kModuleFirstImport)[row] = writer_.batch_->Rows[static_cast<size_t>(ColumnarTable::kImport)];
+            writer_.Column<DWORD>(ColumnarColumn::kModuleFlags)[row]       = flags;
+        }
+        void Import(const char* name, WORD ordinal) noexcept
+        {
+            const auto row                                             = NextRow(ColumnarTable::kImport);
+            writer_.Column<uint32_t>(ColumnarColumn::kImportName)[row] = writer_.Intern(name);
+            writer_.Column<WORD>(ColumnarColumn::kImportOrdinal)[row]  = ordinal;
+        }
+        void Export(const char* name, Ordinal ordinal, RVA rva, const char* forwarder) noexcept
+        {
+            const auto row                                                  = NextRow(ColumnarTable::kExport);
+            writer_.Column<uint32_t>(ColumnarColumn::kExportName)[row]      = writer_.Intern(name);
+            writer_.Column<WORD>(ColumnarColumn::kExportOrdinal)[row]       = ordinal;
+            writer_.Column<RVA>(ColumnarColumn::kExportRva)[row]            = rva;
+            writer_.Column<uint32_t>(ColumnarColumn::kExportForwarder)[row] = writer_.Intern(forwarder);
+        }
+        void TlsCallback(RVA) noexcept {}
+
+    private:
+        uint32_t NextRow(ColumnarTable table) noexcept { return writer_.batch_->Rows[static_cast<size_t>(table)]++; }
+
+        ColumnarWriter& writer_;
+        uint32_t        image_;
+        bool            exportName_;
+    };
+
+    /**
+     * @brief Returns rows of the table in the capacities.
+     */
+    static constexpr uint64_t GetRows(const ColumnarCapacity& capacity, ColumnarTable table) noexcept
+    {
+        return table == ColumnarTable::kImage ? capacity.Images
+            : table == ColumnarTable::kSection ? capacity.Sections
+            : table == ColumnarTable::kModule  ? capacity.Modules
+            : table == ColumnarTable::kImport  ? capacity.Imports
+                                               : capacity.Exports;
+    }
+
+    /**
+     * @brief Returns count of the hash table slots, a power of two with at most 50% load by the string references.
+     */
+    static constexpr uint64_t GetSlotCount(const ColumnarCapacity& capacity) noexcept
+    {
+        const auto references = static_cast<uint64_t>(capacity.Images) + capacity.Sections + capacity.Modules + capacity.Imports + capacity.Exports * 2ull;
+
+        uint64_t count = 2;
+        while (count < references * 2)
+            count <<= 1;
+
+        return count;
+    }
+
+    static constexpr uint64_t Align(uint64_t value, size_t alignment) noexcept { return (value + alignment - 1) & ~static_cast<uint64_t>(alignment - 1); }
+
+    static void* Allocate(Arena& arena, const ColumnarCapacity& capacity) noexcept
+    {
+        const auto size = GetRequiredSize(capacity);
+        return size <= 0xFFFFFFFF ? arena.Allocate(static_cast<size_t>(size), alignof(ColumnarBatch)) : nullptr;
+    }
+
+    /**
+     * @brief Returns length of the section name, which is not terminated if it takes all 8 bytes.
+     */
+    static size_t GetSectionNameLength(const SectionHeader& section) noexcept
+    {
+        size_t length = 0;
+        while (length < IMAGE_SIZEOF_SHORT_NAME && section.Name[length])
+            ++length;
+
+        return length;
+    }
+
+    BYTE* GetData() const noexcept { return reinterpret_cast<BYTE*>(batch_); }
+
+    template<typename T> T* Column(ColumnarColumn column) const noexcept
+    {
+        return reinterpret_cast<T*>(GetData() + batch_->Columns[static_cast<size_t>(column)].Offset);
+    }
+
+    uint32_t Intern(const char* string) noexcept { return string ? Intern(string, strlen(string)) : kColumnarNoString; }
+
+    /**
+     * @brief Returns offset of the string in the pool, appending it if it is not there yet.
+     */
+    uint32_t Intern(const char* string, size_t length) noexcept
+    {
+        const auto pool = reinterpret_cast<char*>(GetData() + batch_->StringPool);
+        for (auto position = static_cast<uint32_t>(HashBytes64(string, length)) & slotMask_;; position = (position + 1) & slotMask_) {
+            auto& slot = slots_[position];
+            if (!slot) {
+                const auto offset = batch_->StringPoolSize;
+                memcpy(pool + offset, string, length);
+                pool[offset + length] = '\0';
+                batch_->StringPoolSize += static_cast<uint32_t>(length) + 1;
+                slot = offset + 1;
+                return offset;
+            }
+
+            // Slots hold the offset plus one, so the zeroed table is empty.
+            const auto stored = pool + slot - 1;
+            if (strncmp(stored, string, length) == 0 && stored[length] == '\0')
+                return slot - 1;
+        }
+    }
+
+    ColumnarBatch*         batch_;
+    const ColumnarCapacity capacity_;
+    uint32_t*              slots_;
+    uint32_t               slotMask_;
+    bool                   finished_ = false;
+};
+
+}
@@ -0,0 +1,374 @@
+#pragma once
+
+#include "PeExportIndex.h"
+#include "PeImage.h"
+#include "PeImport.h"
+#include "PeMapper.h"
+#include "PeTypes.h"
+#include <atomic>
+#include <new>
+
+namespace pe_iterator {
+
+/**
+ * @brief Exports of the module which delayed imports are bound against.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> struct IndexedExportModule {
+    const char*              Name;  // Module name as referenced by the delayed import descriptors, compared ignoring case.
+    const ExportIndex<Arch>* Index; // Hash index of the module exports.
+};
+
+/**
+ * @brief Loader of the delay-loaded module, as LoadLibraryA.
+ * @return Module handle, or nullptr.
+ */
+using DelayModuleLoader = void* (*)(void* context, const char* moduleName);
+
+/**
+ * @brief Resolver of the function of the module returned by DelayModuleLoader, as GetProcAddress.
+ * @return Function address, or nullptr.
+ */
+using DelayFunctionResolver = const void* (*)(void* context, void* module, const char* functionName, WORD ordinal);
+
+/**
+ * @brief Releases the module returned by DelayModuleLoader, as FreeLibrary.
+ */
+using DelayModuleRelease = void (*)(void* context, void* module);
+
+#if defined(_WIN32)
+/**
+ * @brief Loads the module through the system loader.
+ * @param moduleName Module name.
+ */
+inline void* LoadSystemModule(void*, const char* moduleName) noexcept { return LoadLibraryA(moduleName); }
+
+/**
+ * @brief Resolves the function of the module through the system loader, which follows forwarders.
+ * @param module Module handle.
+ * @param functionName Function name, or nullptr if imported by ordinal.
+ * @param ordinal Function ordinal.
+ */
+inline const void* ResolveSystemFunction(void*, void* module, const char* functionName, WORD ordinal) noexcept
+{
+    if (!functionName && !ordinal)
+        return nullptr;
+
+    return reinterpret_cast<const void*>(
+        GetProcAddress(static_cast<HMODULE>(module), functionName ? functionName : reinterpret_cast<LPCSTR>(static_cast<uintptr_t>(ordinal))));
+}
+
+/**
+ * @brief Releases the module loaded through the system loader.
+ * @param module Module handle.
+ */
+inline void ReleaseSystemModule(void*, void* module) noexcept { FreeLibrary(static_cast<HMODULE>(module)); }
+#endif
+
+/**
+ * @brief Fallback of the delayed imports the exporting modules do not resolve, forwarded ones included.
+ *
+ * The module of every descriptor is loaded once: its handle is published into the module handle slot of the descriptor
+ * with a compare-and-swap, the threads losing the race release the module they loaded. Descriptors without the slot in
+ * the image are not resolved by the fallback.
+ */
+struct DelayLoadFallback {
+    DelayModuleLoader     LoadModule      = nullptr; // Loads the module, or nullptr for no fallback.
+    DelayFunctionResolver ResolveFunction = nullptr; // Resolves the function of the loaded module, or nullptr for no fallback.
+    DelayModuleRelease    ReleaseModule   = nullptr; // Releases the module loaded by the losing thread, or nullptr to keep it loaded.
+    void*                 Context         = nullptr; // Context passed to the callbacks.
+};
+
+/**
+ * @brief Binds delayed imports of the mapped image one IAT slot at a time, on the first call of the function.
+ *
+ * The exporting module of every descriptor is looked up once and cached in a caller-supplied array, functions are found
+ * through the export index. Modules none of the exporting modules resolve are loaded once per descriptor by the
+ * fallback, see DelayLoadFallback. The resolved address is published into the IAT slot with a compare-and-swap, so
+ * concurrent first calls through the same slot are safe: all of them return the address stored by the first one.
+ * Startup cost is then proportional to the functions actually used. No memory is allocated.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class DelayImportBinder {
+public:
+    using Function         = typename Export<Arch>::Function;
+    using ModuleIterator   = typename DelayedImport<Arch>::ModuleIterator;
+    using FunctionIterator = typename DelayedImport<Arch>::FunctionIterator;
+    using ModuleCache      = std::atomic<const IndexedExportModule<Arch>*>;
+
+    /**
+     * @brief Initialization constructor.
+     * @param image Mapped image with the writable IAT, must outlive the binder.
+     * @param modules Pointer to the exporting modules, must outlive the binder.
+     * @param count Count of the exporting modules.
+     * @param cache Pointer to the array caching the exporting module of every descriptor, see GetCountOfModules.
+     * @param capacity Count of elements in the array, descriptors beyond it look their module up on every bind.
+     * @param fallback Fallback of the functions not found in the exporting modules, forwarded ones included.
+     */
+    DelayImportBinder(const Image<Arch>& image, const IndexedExportModule<Arch>* modules, size_t count, ModuleCache* cache, size_t capacity,
+                      const DelayLoadFallback& fallback = DelayLoadFallback()) noexcept
+        : header_(image.GetHeader())
+        , imports_(header_)
+        , modules_(modules)
+        , count_(modules ? count : 0)
+        , cache_(cache)
+        , capacity_(cache ? capacity : 0)
+        , fallback_(fallback)
+    {
+        for (size_t cx = 0; cx < capacity_; ++cx)
+            new (&cache_[cx]) ModuleCache(nullptr);
+    }
+
+    /**
+     * @brief Initialization constructor.
+     * @tparam M Count of the exporting modules.
+     * @tparam N Count of elements in the cache.
+     * @param image Mapped image with the writable IAT, must outlive the binder.
+     * @param modules Exporting modules, must outlive the binder.
+     * @param cache Array caching the exporting module of every descriptor.
+     * @param fallback Fallback of the functions not found in the exporting modules.
+     */
+    template<size_t M, size_t N>
+    DelayImportBinder(const Image<Arch>& image, const IndexedExportModule<Arch> (&modules)[M], ModuleCache (&cache)[N],
+                      const DelayLoadFallback& fallback = DelayLoadFallback()) noexcept
+        : DelayImportBinder(image, modules, M, cache, N, fallback)
+    {
+    }
+
+    /**
+     * @brief Initialization constructor, allocating the cache from the arena.
+     * @param image Mapped image with the writable IAT, must outlive the binder.
+     * @param modules Pointer to the exporting modules, must outlive the binder.
+     * @param count Count of the exporting modules.
+     * @param arena Arena the cache is allocated from, modules are looked up on every bind if it is exhausted.
+     * @param fallback Fallback of the functions not found in the exporting modules.
+     */
+    DelayImportBinder(const Image<Arch>& image, const IndexedExportModule<Arch>* modules, size_t count, Arena& arena,
+                      const DelayLoadFallback& fallback = DelayLoadFallback()) noexcept
+        : DelayImportBinder(image, modules, count, nullptr, 0, fallback)
+    {
+        const auto capacity = GetCountOfModules(imports_);
+        if (capacity) {
+            cache_    = arena.Allocate<ModuleCache>(capacity);
+            capacity_ = cache_ ? capacity : 0;
+            for (size_t cx = 0; cx < capacity_; ++cx)
+                new (&cache_[cx]) ModuleCache(nullptr);
+        }
+    }
+
+    DelayImportBinder(const DelayImportBinder&)            = delete;
+    DelayImportBinder& operator=(const DelayImportBinder&) = delete;
+
+    /**
+     * @brief Returns count of the delayed import descriptors, the capacity the cache needs.
+     * @param imports Delayed imports of the image.
+     */
+    static size_t GetCountOfModules(const DelayedImport<Arch>& imports)
+    {
+        size_t modules = 0;
+        if (imports.IsValid()) {
+            for (auto module = imports.begin(); module != imports.end(); ++module)
+                ++modules;
+        }
+
+        return modules;
+    }
+
+    /**
+     * @brief Returns the delayed imports the iterators passed to Bind come from.
+     */
+    const DelayedImport<Arch>& GetImport() const noexcept { return imports_; }
+
+    /**
+     * @brief Returns the exporting module of the descriptor, looked up once per descriptor.
+     * @param module Imported module of GetImport().
+     * @return Pointer to the exporting module, or nullptr if the module is unknown.
+     */
+    const IndexedExportModule<Arch>* GetModule(const ModuleIterator& module) const
+    {
+        const auto index = static_cast<size_t>(module.GetDirectoryDescriptor() - imports_.begin().GetDirectoryDescriptor());
+        if (index >= capacity_)
+            return FindModule(module.GetModuleName());
+
+        // Unknown modules are cached as the end of the modules array, so they are not looked up again either.
+        auto exportModule = cache_[index].load(std::memory_order_acquire);
+        if (!exportModule) {
+            const auto found = FindModule(module.GetModuleName());
+            exportModule     = found ? found : modules_ + count_;
+            cache_[index].store(exportModule, std::memory_order_release);
+        }
+
+        return exportModule != modules_ + count_ ? exportModule : nullptr;
+    }
+
+    /**
+     * @brief Returns the module of the descriptor loaded by the fallback, loaded once per descriptor.
+     * @param module Imported module of GetImport().
+     * @return Module handle, or nullptr if the module is not loaded or the descriptor has no module handle slot in the image.
+     */
+    void* LoadModule(const ModuleIterator& module) const
+    {
+        const auto slot = GetModuleHandleSlot(module);
+        if (!slot || !fallback_.LoadModule)
+            return nullptr;
+
+        auto handle = slot->load(std::memory_order_acquire);
+        if (handle)
+            return reinterpret_cast<void*>(static_cast<uintptr_t>(handle));
+
+        const auto loaded = fallback_.LoadModule(fallback_.Context, module.GetModuleName());
+        if (!loaded)
+            return nullptr;
+
+        // The losing thread drops its reference, so the module is held once per descriptor.
+        if (slot->compare_exchange_strong(handle, static_cast<Thunk>(reinterpret_cast<uintptr_t>(loaded)), std::memory_order_acq_rel))
+            return loaded;
+
+        if (fallback_.ReleaseModule)
+            fallback_.ReleaseModule(fallback_.Context, loaded);
+
+        return reinterpret_cast<void*>(static_cast<uintptr_t>(handle));
+    }
+
+    /**
+     * @brief Resolves the function and stores its address into its IAT slot, unless another thread did it first.
+     * @param module Imported module of GetImport().
+     * @param function Function of the module.
+     * @return Address stored in the IAT slot, or nullptr if the function is not resolved or the slot is not aligned, and
+     * the slot is left intact.
+     */
+    const void* Bind(const ModuleIterator& module, const FunctionIterator& function) const
+    {
+        if (!module.IsValid() || !function.IsValid())
+            return nullptr;
+
+        const auto slot = GetSlot(function);
+        if (!slot)
+            return nullptr;
+
+        const auto expected = slot->load(std::memory_order_acquire);
+
+        // The name of the unbounded image may not translate, the function is then left to the fallback.
+        const auto  name    = function.GetFunctionName();
+        const void* address = nullptr;
+        if (const auto exportModule = GetModule(module)) {
+            const auto result = function.IsImportedByOrdinal() ? exportModule->Index->FindFunction(static_cast<WORD>(function.GetFunctionOrdinal()))
+                              : name                           ? exportModule->Index->FindFunction(name->Name)
+                                                               : typename ExportIndex<Arch>::Function();
+            if (result.IsValid() && !result.IsForwarded())
+                address = result.GetAddress();
+        }
+
+        if (!address && fallback_.ResolveFunction) {
+            if (const auto handle = LoadModule(module))
+                address = fallback_.ResolveFunction(fallback_.Context, handle, name ? name->Name : nullptr, static_cast<WORD>(function.GetFunctionOrdinal()));
+        }
+
+        if (!address)
+            return nullptr;
+
+        // The losing thread returns the winning address, the same function unless the IAT was patched in between.
+        auto current = expected;
+        if (slot->compare_exchange_strong(current, static_cast<Thunk>(reinterpret_cast<uintptr_t>(address)), std::memory_order_acq_rel))
+            return address;
+
+        return reinterpret_cast<const void*>(static_cast<uintptr_t>(current));
+    }
+
+    /**
+     * @brief Resolves the function of the IAT slot, as a delay load helper called by the stub of the slot does.
+     * @param directoryDescriptor Pointer to the delayed import descriptor of GetImport().
+     * @param addressTable Pointer to the IAT slot of the descriptor.
+     * @return Address stored in the IAT slot, or nullptr if the slot does not belong to the descriptor or the function is
+     * not resolved.
+     */
+    const void* Bind(const DelayImportDirectoryDescriptor* directoryDescriptor, const ImportAddressTable<Arch>* addressTable) const
+    {
+        const auto module = imports_.GetModule(directoryDescriptor);
+        if (!module.IsValid() || addressTable < module.GetImportAddressTable())
+            return nullptr;
+
+        // Walking the ILT up to the slot bounds its index by the null terminator.
+        const auto index    = static_cast<size_t>(addressTable - module.GetImportAddressTable());
+        auto       function = module.begin();
+        for (size_t cx = 0; cx < index && function != module.end(); ++cx)
+            ++function;
+
+        return Bind(module, function);
+    }
+
+    /**
+     * @brief Binds all delayed imports, as the eager binding does.
+     * @return Count of bound functions.
+     */
+    size_t BindAll() const
+    {
+        size_t bound = 0;
+        if (imports_.IsValid()) {
+            for (const auto& module : imports_) {
+                for (const auto& function : module)
+                    bound += Bind(module, function) != nullptr;
+            }
+        }
+
+        return bound;
+    }
+
+private:
+    using Thunk = decltype(ImportAddressTable<Arch>{}.u1.Function);
+
+    static_assert(sizeof(std::atomic<Thunk>) == sizeof(Thunk) && std::atomic<Thunk>::is_always_lock_free, "IAT slots are updated in place");
+
+    /**
+     * @brief Returns the IAT slot of the function as an atomic, or nullptr if the slot is not aligned for atomic access.
+     */
+    static std::atomic<Thunk>* GetSlot(const FunctionIterator& function) noexcept
+    {
+        const auto slot = const_cast<Thunk*>(&function.GetImportAddressTable()->u1.Function);
+        return reinterpret_cast<uintptr_t>(slot) % alignof(std::atomic<Thunk>) ? nullptr : reinterpret_cast<std::atomic<Thunk>*>(slot);
+    }
+
+    /**
+     * @brief Returns the module handle slot of the descriptor as an atomic, or nullptr if it is not an aligned slot of the image.
+     */
+    std::atomic<Thunk>* GetModuleHandleSlot(const ModuleIterator& module) const noexcept
+    {
+        const auto rva = module.GetDirectoryDescriptor()->ModuleHandleRVA;
+        if (!rva)
+            return nullptr;
+
+        const auto slot = header_.template RvaToVA<Thunk>(rva);
+        if (!header_.IsRangeValid(slot, sizeof(Thunk)) || reinterpret_cast<uintptr_t>(slot) % alignof(std::atomic<Thunk>))
+            return nullptr;
+
+        return reinterpret_cast<std::atomic<Thunk>*>(slot);
+    }
+
+    /**
+     * @brief Searching exporting module by name ignoring case.
+     * @param name Module name.
+     * @return Pointer to the exporting module, or nullptr.
+     */
+    const IndexedExportModule<Arch>* FindModule(const char* name) const noexcept
+    {
+        if (!name)
+            return nullptr;
+
+        for (size_t cx = 0; cx < count_; ++cx) {
+            if (modules_[cx].Name && modules_[cx].Index && CompareNamesInsensitive(modules_[cx].Name, name) == 0)
+                return &modules_[cx];
+        }
+
+        return nullptr;
+    }
+
+    const Header<Arch>               header_;
+    const DelayedImport<Arch>        imports_;
+    const IndexedExportModule<Arch>* modules_;
+    size_t                           count_;
+    ModuleCache*                     cache_;
+    size_t                           capacity_;
+    const DelayLoadFallback          fallback_;
+};
+
+}
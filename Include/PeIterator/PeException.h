@@ -1,7 +1,11 @@
 #pragma once
 
 #include "PeHeader.h"
+#include "PeInstrumentation.h"
 #include "PeTypes.h"
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
 
 namespace pe_iterator {
 
@@ -13,15 +17,36 @@ template<Architecture Arch> class Exception {
 public:
     /**
      * @brief Class Wrapper over an exception handler function.
+     *
+     * The iterator is random access over the runtime functions and dereferences to itself by value, so its legacy category
+     * is input and random access is its iterator concept.
      */
     class Iterator {
     public:
+        using iterator_category = std::input_iterator_tag;
+        using iterator_concept  = std::random_access_iterator_tag;
+        using value_type        = Iterator;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const Iterator*;
+        using reference         = Iterator;
+
+        /**
+         * @brief Constructs an empty iterator.
+         */
+        Iterator() noexcept
+            : directoryDescriptor_(nullptr)
+            , end_(nullptr)
+        {
+        }
+
         /**
          * @brief Initialization constructor.
          * @param directoryDescriptor Pointer to the exception directory descriptor.
+         * @param end Pointer past the last runtime function of the directory.
          */
-        explicit Iterator(const ExceptionDirectoryDescriptor* directoryDescriptor)
-            : directoryDescriptor_(directoryDescriptor) {};
+        Iterator(const ExceptionDirectoryDescriptor* directoryDescriptor, const ExceptionDirectoryDescriptor* end) noexcept
+            : directoryDescriptor_(directoryDescriptor)
+            , end_(end) {};
 
         /**
          * @brief Returns current runtime function.
@@ -31,31 +56,68 @@ public:
         /**
          * @brief Returns true if current function are valid
          */
-        bool IsValid() const noexcept { return directoryDescriptor_ && directoryDescriptor_->BeginAddress; }
+        bool IsValid() const noexcept { return directoryDescriptor_ && directoryDescriptor_ != end_ && directoryDescriptor_->BeginAddress; }
 
-        Iterator& operator++()
+        Iterator& operator++() noexcept
         {
+            PE_ITERATOR_PROBE(kRuntimeFunctionVisited, 1);
             ++directoryDescriptor_;
             return *this;
         }
 
-        Iterator operator++(int)
+        Iterator operator++(int) noexcept
         {
             auto prev = *this;
-            ++directoryDescriptor_;
+            operator++();
+            return prev;
+        }
+
+        Iterator& operator--() noexcept
+        {
+            --directoryDescriptor_;
+            return *this;
+        }
+
+        Iterator operator--(int) noexcept
+        {
+            auto prev = *this;
+            --directoryDescriptor_;
             return prev;
         }
 
+        Iterator& operator+=(difference_type offset) noexcept
+        {
+            directoryDescriptor_ += offset;
+            return *this;
+        }
+
+        Iterator& operator-=(difference_type offset) noexcept
+        {
+            directoryDescriptor_ -= offset;
+            return *this;
+        }
+
+        Iterator        operator+(difference_type offset) const noexcept { return Iterator(directoryDescriptor_ + offset, end_); }
+        Iterator        operator-(difference_type offset) const noexcept { return Iterator(directoryDescriptor_ - offset, end_); }
+        difference_type operator-(const Iterator& other) const noexcept { return directoryDescriptor_ - other.directoryDescriptor_; }
+        friend Iterator operator+(difference_type offset, const Iterator& iterator) noexcept { return iterator + offset; }
+
         bool operator==(const Iterator& other) const noexcept { return directoryDescriptor_ == other.directoryDescriptor_; }
-        bool operator!=(const Iterator& other) const { return directoryDescriptor_ != other.directoryDescriptor_; }
-        bool operator==(IteratorEnd) const { return IsValid(); }
+        bool operator!=(const Iterator& other) const noexcept { return directoryDescriptor_ != other.directoryDescriptor_; }
+        bool operator<(const Iterator& other) const noexcept { return directoryDescriptor_ < other.directoryDescriptor_; }
+        bool operator>(const Iterator& other) const noexcept { return directoryDescriptor_ > other.directoryDescriptor_; }
+        bool operator<=(const Iterator& other) const noexcept { return directoryDescriptor_ <= other.directoryDescriptor_; }
+        bool operator>=(const Iterator& other) const noexcept { return directoryDescriptor_ >= other.directoryDescriptor_; }
+        bool operator==(IteratorEnd) const { return !IsValid(); }
         bool operator!=(IteratorEnd) const { return IsValid(); }
 
-        const Iterator& operator*() const { return *this; }
-        Iterator&       operator*() { return *this; }
+        Iterator        operator*() const noexcept { return *this; }
+        const Iterator* operator->() const noexcept { return this; }
+        Iterator        operator[](difference_type offset) const noexcept { return *this + offset; }
 
     private:
         const ExceptionDirectoryDescriptor* directoryDescriptor_;
+        const ExceptionDirectoryDescriptor* end_;
     };
 
     /**
@@ -64,8 +126,14 @@ public:
      */
     explicit Exception(const Header<Arch>& header)
         : header_(header)
-        , directoryDescriptor_(header_.GetDirectoryDescriptor<ExceptionDirectoryDescriptor>(ExceptionsDirectoryIndex))
+        , directoryDescriptor_(header_.template GetDirectoryDescriptor<ExceptionDirectoryDescriptor>(ExceptionsDirectoryIndex))
+        , count_(directoryDescriptor_ ? header_.GetDataDirectory(ExceptionsDirectoryIndex)->Size / sizeof(ExceptionDirectoryDescriptor) : 0)
     {
+        // Runtime functions of the bounded image are checked once, iteration stops at the directory size.
+        if (directoryDescriptor_ && !header_.IsArrayValid(directoryDescriptor_, count_)) {
+            directoryDescriptor_ = nullptr;
+            count_               = 0;
+        }
     }
 
     /**
@@ -73,6 +141,41 @@ public:
      */
     const ExceptionDirectoryDescriptor* GetDirectoryDescriptor() const noexcept { return directoryDescriptor_; }
 
+    /**
+     * @brief Returns count of runtime functions in the directory.
+     */
+    size_t GetCount() const noexcept { return count_; }
+
+    /**
+     * @brief Returns runtime function by index.
+     * @param index Index of the runtime function, less than GetCount.
+     */
+    const ExceptionDirectoryDescriptor* GetRuntimeFunction(size_t index) const noexcept { return directoryDescriptor_ + index; }
+
+    /**
+     * @brief Searching runtime function containing the RVA.
+     *
+     * Runtime functions are sorted by the begin address, the search is a branchless binary search over the directory.
+     * @param rva RVA of the instruction.
+     * @return Pointer to the runtime function, or nullptr.
+     */
+    const ExceptionDirectoryDescriptor* FindFunction(RVA rva) const noexcept
+    {
+        if (!count_)
+            return nullptr;
+
+        // Last function beginning at or before the RVA.
+        auto   base   = directoryDescriptor_;
+        size_t length = count_;
+        while (length > 1) {
+            const auto half = length / 2;
+            base            = base[half].BeginAddress <= rva ? base + half : base;
+            length -= half;
+        }
+
+        return base->BeginAddress <= rva && rva < base->EndAddress ? base : nullptr;
+    }
+
     /**
      * @brief Returns true if exceptions directory is not nullptr.
      */
@@ -81,16 +184,24 @@ public:
     /**
      * @brief Returns an iterator pointing to the beginning of functions.
      */
-    Iterator begin() const { return Iterator(directoryDescriptor_); }
+    Iterator begin() const noexcept { return Iterator(directoryDescriptor_, directoryDescriptor_ + count_); }
 
     /**
-     * @brief Returns an iterator pointing to the end of functions.
+     * @brief Returns an iterator pointing past the last runtime function of the directory.
      */
-    IteratorEnd end() const { return {}; }
+    Iterator end() const noexcept { return Iterator(directoryDescriptor_ + count_, directoryDescriptor_ + count_); }
+
+    /**
+     * @brief Returns count of the iterated runtime functions, the same as GetCount.
+     */
+    size_t size() const noexcept { return count_; }
 
 private:
-    const Header<Arch>&                 header_;
+    const Header<Arch>                  header_;
     const ExceptionDirectoryDescriptor* directoryDescriptor_;
+    size_t                              count_;
+
+    static_assert(std::is_trivially_copyable<Iterator>::value, "Iterators are trivially copyable");
 };
 
 }
\ No newline at end of file
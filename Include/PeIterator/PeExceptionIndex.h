@@ -0,0 +1,141 @@
+#pragma once
+
+#include "PeException.h"
+#include "PeTypes.h"
+
+#if defined(PE_ITERATOR_SSE2) || defined(PE_ITERATOR_AVX2)
+#include <immintrin.h>
+#endif
+
+namespace pe_iterator {
+
+/**
+ * @brief Eytzinger layout index of the runtime functions for frequent address lookups.
+ *
+ * Begin addresses are stored in the breadth-first order of the implicit search tree, so the top levels of the tree share
+ * cache lines and the next levels are prefetched while the current one is compared. The index is stored in a
+ * caller-supplied buffer, no memory is allocated.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class ExceptionIndex {
+public:
+    /**
+     * @brief Search tree node.
+     */
+    struct Node {
+        RVA   Begin; // Begin address of the runtime function.
+        DWORD Index; // Index of the runtime function in the directory.
+    };
+
+    /**
+     * @brief Returns count of nodes required to index the specified count of runtime functions.
+     * @param count Count of runtime functions.
+     */
+    static constexpr size_t GetRequiredCapacity(size_t count) noexcept { return count + 1; }
+
+    /**
+     * @brief Initialization constructor, builds the index.
+     * @param exception Image exceptions, copied into the index, the image data must outlive the index.
+     * @param nodes Pointer to the buffer receiving nodes.
+     * @param capacity Count of nodes the buffer can hold, see GetRequiredCapacity.
+     */
+    ExceptionIndex(const Exception<Arch>& exception, Node* nodes, size_t capacity) noexcept
+        : exception_(exception)
+        , nodes_(nodes)
+        , count_(0)
+    {
+        if (!nodes_ || !exception_.IsValid() || !exception_.GetCount() || capacity < GetRequiredCapacity(exception_.GetCount()))
+            return;
+
+        // Node 0 is unused, children of the node k are 2k and 2k + 1.
+        count_      = exception_.GetCount();
+        size_t next = 0;
+        Fill(1, next);
+    }
+
+    /**
+     * @brief Initialization constructor, builds the index.
+     * @tparam N Count of nodes in the buffer.
+     * @param exception Image exceptions, copied into the index, the image data must outlive the index.
+     * @param nodes Buffer receiving nodes.
+     */
+    template<size_t N> ExceptionIndex(const Exception<Arch>& exception, Node (&nodes)[N]) noexcept
+        : ExceptionIndex(exception, nodes, N)
+    {
+    }
+
+    /**
+     * @brief Initialization constructor, builds the index in the nodes allocated from the arena.
+     * @param exception Image exceptions, copied into the index, the image data must outlive the index.
+     * @param arena Arena the nodes are allocated from, the index is not valid if it is exhausted.
+     */
+    ExceptionIndex(const Exception<Arch>& exception, Arena& arena) noexcept
+        : ExceptionIndex(exception, arena.Allocate<Node>(GetRequiredCapacity(exception.GetCount())), GetRequiredCapacity(exception.GetCount()))
+    {
+    }
+
+    /**
+     * @brief Returns true if the index was successfully built.
+     */
+    bool IsValid() const noexcept { return count_ != 0; }
+
+    /**
+     * @brief Returns indexed exceptions.
+     */
+    const Exception<Arch>& GetException() const noexcept { return exception_; }
+
+    /**
+     * @brief Searching runtime function containing the RVA.
+     * @param rva RVA of the instruction.
+     * @return Pointer to the runtime function, same as returned by Exception<Arch>::FindFunction.
+     */
+    const ExceptionDirectoryDescriptor* FindFunction(RVA rva) const noexcept
+    {
+        if (!IsValid())
+            return exception_.FindFunction(rva);
+
+        // Descend to the leaf recording the turns, 8-byte nodes put 16 descendants four levels down on two cache lines.
+        size_t node = 1;
+        while (node <= count_) {
+#if defined(PE_ITERATOR_SSE2) || defined(PE_ITERATOR_AVX2)
+            _mm_prefetch(reinterpret_cast<const char*>(nodes_ + (node * 16 <= count_ ? node * 16 : 0)), _MM_HINT_T0);
+#endif
+            node = 2 * node + (nodes_[node].Begin <= rva);
+        }
+
+        // Dropping the trailing right turns and the last left one gives the first node beginning after the RVA.
+        while (node & 1)
+            node >>= 1;
+        node >>= 1;
+
+        const size_t upper = node ? nodes_[node].Index : count_;
+        if (!upper)
+            return nullptr;
+
+        const auto function = exception_.GetRuntimeFunction(upper - 1);
+        return function->BeginAddress <= rva && rva < function->EndAddress ? function : nullptr;
+    }
+
+private:
+    /**
+     * @brief Fills the subtree in order of the sorted runtime functions.
+     * @param node Subtree root.
+     * @param next Index of the next runtime function.
+     */
+    void Fill(size_t node, size_t& next) noexcept
+    {
+        if (node > count_)
+            return;
+
+        Fill(2 * node, next);
+        nodes_[node] = { exception_.GetRuntimeFunction(next)->BeginAddress, static_cast<DWORD>(next) };
+        ++next;
+        Fill(2 * node + 1, next);
+    }
+
+    const Exception<Arch> exception_;
+    Node*                 nodes_;
+    size_t                count_;
+};
+
+}
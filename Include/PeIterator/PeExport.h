@@ -1,7 +1,11 @@
 #pragma once
 
 #include "PeHeader.h"
+#include "PeInstrumentation.h"
 #include "PeTypes.h"
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
 
 namespace pe_iterator {
 
@@ -18,11 +22,24 @@ template<Architecture Arch> class Export {
     };
 
 public:
+    // Name index of the function exported only by ordinal.
+    static constexpr DWORD kNoName = 0xFFFFFFFF;
+
     /**
      * @brief Wrapper class over the exported function.
      */
     class Function {
     public:
+        /**
+         * @brief Constructs a not found function.
+         */
+        Function()
+            : address_(nullptr)
+            , ordinal_(0)
+            , forwarded_(false)
+        {
+        }
+
         /**
          * @brief Initialization constructor.
          * @param address Pointer to the function.
@@ -56,26 +73,62 @@ public:
          */
         bool IsForwarded() const noexcept { return forwarded_; }
 
+        /**
+         * @brief Returns true if function was found.
+         */
+        bool IsValid() const noexcept { return address_ != nullptr; }
+
     private:
-        const BYTE*   address_;
-        const Ordinal ordinal_;
-        const bool    forwarded_;
+        const BYTE* address_;
+        Ordinal     ordinal_;
+        bool        forwarded_;
     };
 
+    /**
+     * @brief Iterator over the exported functions.
+     *
+     * The state is a copy of the header, the directory descriptor and tables pointers and the index: trivially copyable and
+     * independent of the Export, so iterators can be stored and handed to other threads while the image data exists. The
+     * iterator is random access over the functions table and dereferences to itself by value, so its legacy category is
+     * input and random access is its iterator concept. Names are searched in the names table per call, or looked up in
+     * the name map of ExportNameIndex the iterator was taken from.
+     */
     class Iterator {
     public:
+        using iterator_category = std::input_iterator_tag;
+        using iterator_concept  = std::random_access_iterator_tag;
+        using value_type        = Iterator;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const Iterator*;
+        using reference         = Iterator;
+
+        /**
+         * @brief Constructs an empty iterator.
+         */
+        Iterator() noexcept
+            : header_(nullptr)
+            , directoryDescriptor_(nullptr)
+            , tables_{ nullptr, nullptr, nullptr }
+            , index_(0)
+            , nameIndices_(nullptr)
+        {
+        }
+
         /**
          * @brief Initialization constructor.
-         * @param header Image header
-         * @param moduleExport Export class.
-         * @param tables Export tables.
-         * @param index The base index of the relocations from which the iteration will begin. By default, 0.
+         * @param header Image header.
+         * @param directoryDescriptor Pointer to the exports directory descriptor.
+         * @param tables Exports tables.
+         * @param index The base index of the functions from which the iteration will begin. By default, 0.
+         * @param nameIndices Names table index of every function or kNoName, see ExportNameIndex, or nullptr to search names.
          */
-        Iterator(const Header<Arch>& header, const Export& moduleExport, const Tables& tables, size_t index = 0)
+        Iterator(const Header<Arch>& header, const ExportDirectoryDescriptor* directoryDescriptor, const Tables& tables, size_t index = 0,
+                 const DWORD* nameIndices = nullptr) noexcept
             : header_(header)
-            , export_(moduleExport)
+            , directoryDescriptor_(directoryDescriptor)
             , tables_(tables)
             , index_(index)
+            , nameIndices_(nameIndices)
         {
         }
 
@@ -85,61 +138,109 @@ public:
         size_t GetIndex() const noexcept { return index_; }
 
         /**
-         * @brief Returns function name.
+         * @brief Returns function RVA.
          */
-        const char* GetName() const { return header_.RvaToVA<char>(tables_.Names[index_]); }
+        RVA GetRva() const noexcept { return tables_.Functions[index_]; }
+
+        /**
+         * @brief Returns function name, or nullptr if the function is exported by ordinal only.
+         */
+        const char* GetName() const
+        {
+            if (!nameIndices_)
+                return FindFunctionName(header_, directoryDescriptor_, tables_, static_cast<DWORD>(index_));
+
+            return nameIndices_[index_] != kNoName ? header_.template RvaToVA<char>(tables_.Names[nameIndices_[index_]]) : nullptr;
+        }
 
         /**
          * @brief Returns true if function forwarded.
          */
-        bool IsForwarded() const { return export_.IsForwarded(tables_.Functions[index_]); }
+        bool IsForwarded() const { return Export::IsForwarded(header_, GetRva()); }
 
         /**
          * @brief Returns function ordinal or 0 if function forwarded.
          */
-        Ordinal GetOrdinal() const { return IsForwarded() ? 0 : export_.GetDirectoryDescriptor()->Base + index_; }
+        Ordinal GetOrdinal() const { return IsForwarded() ? 0 : directoryDescriptor_->Base + index_; }
 
         /**
          * @brief Returns function address or nullptr if function forwarded.
          */
-        const BYTE* GetAddress() const { return IsForwarded() ? nullptr : header_.RvaToVA<uint8_t>(tables_.Functions[index_]); }
+        const BYTE* GetAddress() const { return IsForwarded() ? nullptr : header_.template RvaToVA<uint8_t>(GetRva()); }
 
         /**
          * @brief Returns function address or nullptr if function forwarded.
          */
-        const char* GetForwardedName() const { return IsForwarded() ? header_.RvaToVA<char>(tables_.Functions[index_]) : nullptr; }
+        const char* GetForwardedName() const { return IsForwarded() ? header_.template RvaToVA<char>(GetRva()) : nullptr; }
 
         /**
          * @brief Returns true if function are valid.
          */
-        bool Validate() const { return index_ < export_.GetCountFunctions(); }
+        bool Validate() const noexcept { return directoryDescriptor_ && index_ < directoryDescriptor_->NumberOfFunctions; }
 
-        Iterator& operator++()
+        Iterator& operator++() noexcept
         {
+            PE_ITERATOR_PROBE(kExportVisited, 1);
             ++index_;
             return *this;
         }
 
-        Iterator operator++(int)
+        Iterator operator++(int) noexcept
         {
             auto prev = *this;
-            ++index_;
+            operator++();
+            return prev;
+        }
+
+        Iterator& operator--() noexcept
+        {
+            --index_;
+            return *this;
+        }
+
+        Iterator operator--(int) noexcept
+        {
+            auto prev = *this;
+            --index_;
             return prev;
         }
 
+        Iterator& operator+=(difference_type offset) noexcept
+        {
+            index_ += offset;
+            return *this;
+        }
+
+        Iterator& operator-=(difference_type offset) noexcept
+        {
+            index_ -= offset;
+            return *this;
+        }
+
+        Iterator        operator+(difference_type offset) const noexcept { return Iterator(header_, directoryDescriptor_, tables_, index_ + offset, nameIndices_); }
+        Iterator        operator-(difference_type offset) const noexcept { return Iterator(header_, directoryDescriptor_, tables_, index_ - offset, nameIndices_); }
+        difference_type operator-(const Iterator& other) const noexcept { return static_cast<difference_type>(index_ - other.index_); }
+        friend Iterator operator+(difference_type offset, const Iterator& iterator) noexcept { return iterator + offset; }
+
         bool operator==(const Iterator& other) const noexcept { return index_ == other.index_; }
-        bool operator!=(const Iterator& other) const { return index_ != other.index_; }
-        bool operator==(IteratorEnd) const { return Validate(); }
+        bool operator!=(const Iterator& other) const noexcept { return index_ != other.index_; }
+        bool operator<(const Iterator& other) const noexcept { return index_ < other.index_; }
+        bool operator>(const Iterator& other) const noexcept { return index_ > other.index_; }
+        bool operator<=(const Iterator& other) const noexcept { return index_ <= other.index_; }
+        bool operator>=(const Iterator& other) const noexcept { return index_ >= other.index_; }
+        bool operator==(IteratorEnd) const { return !Validate(); }
         bool operator!=(IteratorEnd) const { return Validate(); }
 
-        const Iterator& operator*() const { return *this; }
-        Iterator&       operator*() { return *this; }
+        Iterator        operator*() const noexcept { return *this; }
+        const Iterator* operator->() const noexcept { return this; }
+        Iterator        operator[](difference_type offset) const noexcept { return *this + offset; }
 
     private:
-        const Header<Arch>& header_;
-        const Export&       export_;
-        const Tables&       tables_;
-        size_t              index_;
+        Header<Arch>                     header_;
+        const ExportDirectoryDescriptor* directoryDescriptor_;
+        Tables                           tables_;
+        size_t                           index_;
+        const DWORD*                     nameIndices_;
     };
 
     /**
@@ -148,9 +249,8 @@ public:
      */
     explicit Export(const Header<Arch>& header)
         : header_(header)
-        , directoryDescriptor_(header_.GetDirectoryDescriptor<ExportDirectoryDescriptor>(ExportDirectoryIndex))
-        , tables_ { header_.RvaToVA<DWORD>(directoryDescriptor_->AddressOfNames), header_.RvaToVA<Ordinal>(directoryDescriptor_->AddressOfNameOrdinals),
-                    header_.RvaToVA<RVA>(directoryDescriptor_->AddressOfFunctions) }
+        , directoryDescriptor_(Validate(header, header.template GetDirectoryDescriptor<ExportDirectoryDescriptor>(ExportDirectoryIndex)))
+        , tables_(GetTables(header, directoryDescriptor_))
     {
     }
 
@@ -162,17 +262,17 @@ public:
     /**
      * @brief Returns count of exported functions.
      */
-    DWORD GetCountFunctions() const noexcept { return directoryDescriptor_->NumberOfFunctions; }
+    DWORD GetCountFunctions() const noexcept { return directoryDescriptor_ ? directoryDescriptor_->NumberOfFunctions : 0; }
 
     /**
      * @brief Returns count of exported named functions.
      */
-    DWORD GetCountOfFunctionsNames() const noexcept { return directoryDescriptor_->NumberOfNames; }
+    DWORD GetCountOfFunctionsNames() const noexcept { return directoryDescriptor_ ? directoryDescriptor_->NumberOfNames : 0; }
 
     /**
      * @brief Returns name of the module.
      */
-    const char* GetModuleName() const { return header_.RvaToVA<char>(directoryDescriptor_->Name); }
+    const char* GetModuleName() const { return header_.template RvaToVA<char>(directoryDescriptor_->Name); }
 
     /**
      * @brief Returns true if exports directory descriptor in not nullptr.
@@ -188,12 +288,49 @@ public:
      * @brief Returns true if RVA function is forwarded.
      * @param rva RVA offset
      */
-    bool IsForwarded(RVA rva) const
+    bool IsForwarded(RVA rva) const { return IsForwarded(header_, rva); }
+
+    /**
+     * @brief Returns function name from the names table.
+     * @param nameIndex Index in the names table.
+     */
+    const char* GetFunctionName(DWORD nameIndex) const { return header_.template RvaToVA<char>(tables_.Names[nameIndex]); }
+
+    /**
+     * @brief Returns function RVA from the functions table.
+     * @param functionIndex Index in the functions table.
+     */
+    RVA GetFunctionRva(DWORD functionIndex) const noexcept { return tables_.Functions[functionIndex]; }
+
+    /**
+     * @brief Returns index in the functions table of the named function.
+     * @param nameIndex Index in the names table.
+     */
+    DWORD GetFunctionIndex(DWORD nameIndex) const noexcept { return tables_.Ordinals[nameIndex]; }
+
+    /**
+     * @brief Searching name of the function by index in the functions table, linear in the count of names.
+     * @param functionIndex Index in the functions table.
+     * @return The first name of the function, or nullptr if the function is exported by ordinal only.
+     */
+    const char* FindFunctionName(DWORD functionIndex) const { return FindFunctionName(header_, directoryDescriptor_, tables_, functionIndex); }
+
+    /**
+     * @brief Returns exported function by index in the functions table.
+     * @param functionIndex Index in the functions table.
+     */
+    Function GetFunctionByIndex(DWORD functionIndex) const
     {
-        auto dataDirectory = header_.GetDataDirectory(ExportDirectoryIndex);
-        return rva > dataDirectory->VirtualAddress && rva < dataDirectory->VirtualAddress + dataDirectory->Size;
+        RVA functionRVA = tables_.Functions[functionIndex];
+        return Function(header_.template RvaToVA<uint8_t>(functionRVA), GetDirectoryDescriptor()->Base + functionIndex, IsForwarded(functionRVA));
     }
 
+    /**
+     * @brief Returns exported function by index in the names table.
+     * @param nameIndex Index in the names table.
+     */
+    Function GetFunctionByNameIndex(DWORD nameIndex) const { return GetFunctionByIndex(tables_.Ordinals[nameIndex]); }
+
     /**
      * @brief Searching function by name.
      * @param function Function name.
@@ -206,28 +343,41 @@ public:
 
         // using binary search.
         uint32_t left = 0, right = GetCountOfFunctionsNames();
-        while (left <= right) {
+        while (left < right) {
             auto curPos = left + (right - left) / 2;
-            auto name   = header_.RvaToVA<char>(tables_.Names[curPos]);
-            auto cmpRes = strcmp(name, function);
+            auto cmpRes = strcmp(GetFunctionName(curPos), function);
+            PE_ITERATOR_PROBE(kNameComparison, 1);
 
             if (cmpRes > 0)
                 right = curPos;
             else if (cmpRes < 0)
                 left = curPos + 1;
-            else {
-                left = curPos;
-                break;
-            }
+            else
+                return GetFunctionByNameIndex(curPos);
         }
 
-        if (left == right)
+        return {};
+    }
+
+    /**
+     * @brief Searching function by precalculated name hash.
+     *
+     * Scans the names table comparing the hashes, no strings are compared. Prefer ExportIndex for repeated lookups.
+     * @param hash Function name hash, see HashName and literals::operator""_hash.
+     * @return Exported function.
+     */
+    Function FindFunction(NameHash hash) const
+    {
+        if (!IsValid())
             return {};
 
-        Ordinal functionHint = tables_.Ordinals[left];
-        RVA     functionRVA  = tables_.Functions[functionHint];
+        for (DWORD nameIndex = 0; nameIndex < GetCountOfFunctionsNames(); ++nameIndex) {
+            const auto name = GetFunctionName(nameIndex);
+            if (name && HashName(name) == hash.Value)
+                return GetFunctionByNameIndex(nameIndex);
+        }
 
-        return Function(header_.RvaToVA<uint8_t>(functionRVA), GetDirectoryDescriptor()->Base + functionHint, IsForwarded(functionRVA));
+        return {};
     }
 
     /**
@@ -244,24 +394,121 @@ public:
         if (functionHint >= GetCountFunctions())
             return {};
 
-        RVA functionRVA = tables_.Functions[functionHint];
-        return Function(header_.RvaToVA<uint8_t>(functionRVA), ordinal, IsForwarded(functionRVA));
+        return GetFunctionByIndex(functionHint);
     }
 
     /**
      * @brief Returns an iterator pointing to the beginning of functions.
      */
-    Iterator begin() const { return Iterator(header_, *this, tables_); }
+    Iterator begin() const noexcept { return Iterator(header_, directoryDescriptor_, tables_); }
+
+    /**
+     * @brief Returns an iterator pointing to the beginning of functions, naming them through the name map.
+     * @param nameIndices Names table index of every function or kNoName, see ExportNameIndex.
+     */
+    Iterator begin(const DWORD* nameIndices) const noexcept { return Iterator(header_, directoryDescriptor_, tables_, 0, nameIndices); }
 
     /**
      *@brief Returns an iterator pointing to the end of functions.
      */
-    IteratorEnd end() const { return {}; }
+    Iterator end() const noexcept { return Iterator(header_, directoryDescriptor_, tables_, size()); }
+
+    /**
+     * @brief Returns count of the iterated functions.
+     */
+    size_t size() const noexcept { return GetCountFunctions(); }
 
 private:
-    const Header<Arch>&              header_;
+    /**
+     * @brief Returns true if RVA function is forwarded, pointing into the exports directory.
+     * @param header Image header.
+     * @param rva RVA offset
+     */
+    static bool IsForwarded(const Header<Arch>& header, RVA rva)
+    {
+        auto dataDirectory = header.GetDataDirectory(ExportDirectoryIndex);
+        return rva > dataDirectory->VirtualAddress && rva < dataDirectory->VirtualAddress + dataDirectory->Size;
+    }
+
+    /**
+     * @brief Searching name of the function by index in the functions table, linear in the count of names.
+     * @param header Image header.
+     * @param directoryDescriptor Pointer to the exports directory descriptor.
+     * @param tables Exports tables.
+     * @param functionIndex Index in the functions table.
+     * @return The first name of the function, or nullptr if the function is exported by ordinal only.
+     */
+    static const char* FindFunctionName(const Header<Arch>& header, const ExportDirectoryDescriptor* directoryDescriptor, const Tables& tables, DWORD functionIndex)
+    {
+        const auto countNames = directoryDescriptor ? directoryDescriptor->NumberOfNames : 0;
+        for (DWORD cx = 0; cx < countNames; ++cx) {
+            if (tables.Ordinals[cx] == functionIndex)
+                return header.template RvaToVA<char>(tables.Names[cx]);
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Returns exports tables, or null tables if there are no exports.
+     * @param header Image header.
+     * @param directoryDescriptor Pointer to the exports directory descriptor.
+     */
+    static Tables GetTables(const Header<Arch>& header, const ExportDirectoryDescriptor* directoryDescriptor) noexcept
+    {
+        if (!directoryDescriptor)
+            return { nullptr, nullptr, nullptr };
+
+        return { header.template RvaToVA<const DWORD>(directoryDescriptor->AddressOfNames),
+                 header.template RvaToVA<const Ordinal>(directoryDescriptor->AddressOfNameOrdinals),
+                 header.template RvaToVA<const RVA>(directoryDescriptor->AddressOfFunctions) };
+    }
+
+    /**
+     * @brief Validates tables, names and forwarder strings of the bounded image, unbounded images are not checked.
+     * @param header Image header.
+     * @param directoryDescriptor Pointer to the exports directory descriptor.
+     * @return The descriptor if exports are valid, or nullptr.
+     */
+    static const ExportDirectoryDescriptor* Validate(const Header<Arch>& header, const ExportDirectoryDescriptor* directoryDescriptor) noexcept
+    {
+        if (!directoryDescriptor || !header.GetImageSize())
+            return directoryDescriptor;
+
+        const auto tables         = GetTables(header, directoryDescriptor);
+        const auto countFunctions = directoryDescriptor->NumberOfFunctions;
+        const auto countNames     = directoryDescriptor->NumberOfNames;
+
+        if ((countNames && (!header.IsArrayValid(tables.Names, countNames) || !header.IsArrayValid(tables.Ordinals, countNames)))
+            || (countFunctions && !header.IsArrayValid(tables.Functions, countFunctions)))
+            return nullptr;
+
+        if (directoryDescriptor->Name && !header.IsStringValid(header.template RvaToVA<const char>(directoryDescriptor->Name)))
+            return nullptr;
+
+        for (DWORD cx = 0; cx < countNames; ++cx) {
+            if (tables.Ordinals[cx] >= countFunctions || !header.IsStringValid(header.template RvaToVA<const char>(tables.Names[cx])))
+                return nullptr;
+        }
+
+        const auto dataDirectory = header.GetDataDirectory(ExportDirectoryIndex);
+        for (DWORD cx = 0; cx < countFunctions; ++cx) {
+            const auto rva = tables.Functions[cx];
+            if (rva > dataDirectory->VirtualAddress && rva < dataDirectory->VirtualAddress + dataDirectory->Size
+                && !header.IsStringValid(header.template RvaToVA<const char>(rva)))
+                return nullptr;
+        }
+
+        return directoryDescriptor;
+    }
+
+    const Header<Arch>               header_;
     const ExportDirectoryDescriptor* directoryDescriptor_;
     const Tables                     tables_;
+
+    static_assert(std::is_trivially_copyable<Iterator>::value, "Iterators are trivially copyable");
+    static_assert(sizeof(Iterator) == sizeof(Header<Arch>) + sizeof(Tables) + 3 * sizeof(void*),
+                  "Iterators hold the header and tables copies, their index and the name map only");
 };
 
 }
\ No newline at end of file
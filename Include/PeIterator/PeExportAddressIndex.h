@@ -0,0 +1,160 @@
+#pragma once
+
+#include "PeExport.h"
+#include "PeTypes.h"
+#include <algorithm>
+
+namespace pe_iterator {
+
+/**
+ * @brief Index of the exported functions sorted by address, answering which export contains an address.
+ *
+ * Function RVAs are sorted once together with back-links to the functions and names tables, forwarded and empty
+ * entries are skipped. It is stored in a caller-supplied buffer, no memory is allocated.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class ExportAddressIndex {
+public:
+    using Function = typename Export<Arch>::Function;
+
+    /**
+     * @brief Indexed function.
+     */
+    struct Entry {
+        RVA   Address;       // Function RVA.
+        DWORD FunctionIndex; // Index in the functions table, the ordinal is Base + FunctionIndex.
+        DWORD NameIndex;     // Index in the names table of the first name of the function, or kNoName.
+    };
+
+    // Name index of the function exported only by ordinal.
+    static constexpr DWORD kNoName = 0xFFFFFFFF;
+
+    /**
+     * @brief Returns count of entries required to index the specified count of functions.
+     * @param countFunctions Count of exported functions.
+     */
+    static constexpr size_t GetRequiredCapacity(DWORD countFunctions) noexcept { return countFunctions; }
+
+    /**
+     * @brief Initialization constructor, builds the index.
+     * @param moduleExport Image exports, copied into the index, the image data must outlive the index.
+     * @param entries Pointer to the buffer receiving entries.
+     * @param capacity Count of entries the buffer can hold, see GetRequiredCapacity.
+     */
+    ExportAddressIndex(const Export<Arch>& moduleExport, Entry* entries, size_t capacity)
+        : export_(moduleExport)
+        , entries_(entries)
+        , count_(0)
+        , built_(false)
+    {
+        if (!entries_ || !export_.IsValid() || capacity < GetRequiredCapacity(export_.GetCountFunctions()))
+            return;
+
+        const auto countFunctions = export_.GetCountFunctions();
+        for (DWORD cx = 0; cx < countFunctions; ++cx)
+            entries_[cx] = { export_.GetFunctionRva(cx), cx, kNoName };
+
+        // Walking the names backwards leaves the first name of the functions with several names.
+        for (DWORD nameIndex = export_.GetCountOfFunctionsNames(); nameIndex-- > 0;) {
+            const auto functionIndex = export_.GetFunctionIndex(nameIndex);
+            if (functionIndex < countFunctions)
+                entries_[functionIndex].NameIndex = nameIndex;
+        }
+
+        for (DWORD cx = 0; cx < countFunctions; ++cx) {
+            if (entries_[cx].Address && !export_.IsForwarded(entries_[cx].Address))
+                entries_[count_++] = entries_[cx];
+        }
+
+        std::sort(entries_, entries_ + count_, [](const Entry& first, const Entry& second) {
+            return first.Address < second.Address || (first.Address == second.Address && first.FunctionIndex < second.FunctionIndex);
+        });
+
+        built_ = true;
+    }
+
+    /**
+     * @brief Initialization constructor, builds the index.
+     * @tparam N Count of entries in the buffer.
+     * @param moduleExport Image exports, copied into the index, the image data must outlive the index.
+     * @param entries Buffer receiving entries.
+     */
+    template<size_t N> ExportAddressIndex(const Export<Arch>& moduleExport, Entry (&entries)[N])
+        : ExportAddressIndex(moduleExport, entries, N)
+    {
+    }
+
+    /**
+     * @brief Initialization constructor, builds the index in the entries allocated from the arena.
+     * @param moduleExport Image exports, copied into the index, the image data must outlive the index.
+     * @param arena Arena the entries are allocated from, the index is not valid if it is exhausted.
+     */
+    ExportAddressIndex(const Export<Arch>& moduleExport, Arena& arena)
+        : ExportAddressIndex(moduleExport, arena.Allocate<Entry>(GetRequiredCapacity(moduleExport.GetCountFunctions())),
+                             GetRequiredCapacity(moduleExport.GetCountFunctions()))
+    {
+    }
+
+    /**
+     * @brief Returns true if the index was successfully built.
+     */
+    bool IsValid() const noexcept { return built_; }
+
+    /**
+     * @brief Returns count of indexed functions.
+     */
+    size_t GetCount() const noexcept { return count_; }
+
+    /**
+     * @brief Returns indexed exports.
+     */
+    const Export<Arch>& GetExport() const noexcept { return export_; }
+
+    /**
+     * @brief Searching the nearest function beginning at or before the RVA.
+     *
+     * Exports carry no sizes, so the result is the preceding export even if the address lies past its end.
+     * @param rva RVA of the address.
+     * @return Pointer to the entry, or nullptr if no export precedes the RVA. Of several exports of the same address the
+     * one with the lowest ordinal is returned.
+     */
+    const Entry* FindNearest(RVA rva) const noexcept
+    {
+        const auto upper = std::upper_bound(entries_, entries_ + count_, rva, [](RVA value, const Entry& entry) { return value < entry.Address; });
+        if (upper == entries_)
+            return nullptr;
+
+        // Step back to the first entry of the same address.
+        auto entry = upper - 1;
+        while (entry != entries_ && (entry - 1)->Address == entry->Address)
+            --entry;
+
+        return entry;
+    }
+
+    /**
+     * @brief Returns name of the indexed function, or nullptr if exported only by ordinal.
+     * @param entry Index entry.
+     */
+    const char* GetName(const Entry& entry) const { return entry.NameIndex != kNoName ? export_.GetFunctionName(entry.NameIndex) : nullptr; }
+
+    /**
+     * @brief Returns ordinal of the indexed function.
+     * @param entry Index entry.
+     */
+    Ordinal GetOrdinal(const Entry& entry) const noexcept { return static_cast<Ordinal>(export_.GetDirectoryDescriptor()->Base + entry.FunctionIndex); }
+
+    /**
+     * @brief Returns the indexed function.
+     * @param entry Index entry.
+     */
+    Function GetFunction(const Entry& entry) const { return export_.GetFunctionByIndex(entry.FunctionIndex); }
+
+private:
+    const Export<Arch> export_;
+    Entry*             entries_;
+    size_t             count_;
+    bool               built_;
+};
+
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "PeExport.h"
+#include "PeInstrumentation.h"
+#include "PeTypes.h"
+
+namespace pe_iterator {
+
+/**
+ * @brief Hash index over the export names table providing constant time function lookup.
+ *
+ * The index is an open-addressing hash table of the name hashes mapped to names table indices. It is stored in a
+ * caller-supplied buffer, no memory is allocated.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class ExportIndex {
+public:
+    using Function = typename Export<Arch>::Function;
+
+    /**
+     * @brief Hash table slot.
+     */
+    struct Slot {
+        uint32_t Hash;      // Hash of the function name.
+        DWORD    NameIndex; // Index in the export names table, or kEmptySlot.
+    };
+
+    // Name index of the unused slot.
+    static constexpr DWORD kEmptySlot = 0xFFFFFFFF;
+
+    /**
+     * @brief Returns count of slots required to index the specified count of names.
+     * @param countOfNames Count of exported names.
+     */
+    static constexpr size_t GetRequiredCapacity(DWORD countOfNames) noexcept
+    {
+        // Power of two with at most 50% load.
+        size_t capacity = 2;
+        while (capacity < static_cast<size_t>(countOfNames) * 2)
+            capacity <<= 1;
+
+        return capacity;
+    }
+
+    /**
+     * @brief Initialization constructor, builds the index.
+     * @param moduleExport Image exports, copied into the index, the image data must outlive the index.
+     * @param slots Pointer to the buffer receiving hash table slots.
+     * @param capacity Count of slots the buffer can hold, see GetRequiredCapacity.
+     */
+    ExportIndex(const Export<Arch>& moduleExport, Slot* slots, size_t capacity)
+        : export_(moduleExport)
+        , slots_(slots)
+        , mask_(0)
+    {
+        if (!slots_ || !export_.IsValid() || capacity < GetRequiredCapacity(export_.GetCountOfFunctionsNames()))
+            return;
+
+        // Use the largest power of two fitting the buffer, lower load means shorter probes.
+        size_t size = GetRequiredCapacity(export_.GetCountOfFunctionsNames());
+        while (size * 2 <= capacity)
+            size *= 2;
+
+        for (size_t cx = 0; cx < size; ++cx)
+            slots_[cx] = { 0, kEmptySlot };
+
+        mask_ = size - 1;
+        for (DWORD nameIndex = 0; nameIndex < export_.GetCountOfFunctionsNames(); ++nameIndex) {
+            const auto name = export_.GetFunctionName(nameIndex);
+            if (!name)
+                continue;
+
+            const auto hash = HashName(name);
+
+            auto position = hash & mask_;
+            while (slots_[position].NameIndex != kEmptySlot)
+                position = (position + 1) & mask_;
+
+            slots_[position] = { hash, nameIndex };
+        }
+    }
+
+    /**
+     * @brief Initialization constructor, builds the index.
+     * @tparam N Count of slots in the buffer.
+     * @param moduleExport Image exports, copied into the index, the image data must outlive the index.
+     * @param slots Buffer receiving hash table slots.
+     */
+    template<size_t N> ExportIndex(const Export<Arch>& moduleExport, Slot (&slots)[N])
+        : ExportIndex(moduleExport, slots, N)
+    {
+    }
+
+    /**
+     * @brief Initialization constructor, builds the index in the slots allocated from the arena.
+     * @param moduleExport Image exports, copied into the index, the image data must outlive the index.
+     * @param arena Arena the slots are allocated from, the index is not valid if it is exhausted.
+     */
+    ExportIndex(const Export<Arch>& moduleExport, Arena& arena)
+        : ExportIndex(moduleExport, arena.Allocate<Slot>(GetRequiredCapacity(moduleExport.GetCountOfFunctionsNames())),
+                      GetRequiredCapacity(moduleExport.GetCountOfFunctionsNames()))
+    {
+    }
+
+    /**
+     * @brief Returns true if the index was successfully built.
+     */
+    bool IsValid() const noexcept { return mask_ != 0; }
+
+    /**
+     * @brief Returns indexed exports.
+     */
+    const Export<Arch>& GetExport() const noexcept { return export_; }
+
+    /**
+     * @brief Searching function by name.
+     * @param function Function name.
+     * @return Exported function, same as returned by Export<Arch>::FindFunction.
+     */
+    Function FindFunction(const char* function) const
+    {
+        if (!function)
+            return {};
+
+        if (!IsValid())
+            return export_.FindFunction(function);
+
+        const auto hash = HashName(function);
+        for (auto position = hash & mask_; slots_[position].NameIndex != kEmptySlot; position = (position + 1) & mask_) {
+            const auto& slot = slots_[position];
+            if (slot.Hash != hash)
+                continue;
+
+            PE_ITERATOR_PROBE(kNameComparison, 1);
+            if (strcmp(export_.GetFunctionName(slot.NameIndex), function) == 0)
+                return export_.GetFunctionByNameIndex(slot.NameIndex);
+        }
+
+        return {};
+    }
+
+    /**
+     * @brief Searching function by precalculated name hash.
+     *
+     * Only the stored hashes are compared. A name colliding with the searched one resolves to the first indexed name.
+     * @param hash Function name hash, see HashName and literals::operator""_hash.
+     * @return Exported function.
+     */
+    Function FindFunction(NameHash hash) const
+    {
+        if (!IsValid())
+            return export_.FindFunction(hash);
+
+        for (auto position = hash.Value & mask_; slots_[position].NameIndex != kEmptySlot; position = (position + 1) & mask_) {
+            if (slots_[position].Hash == hash.Value)
+                return export_.GetFunctionByNameIndex(slots_[position].NameIndex);
+        }
+
+        return {};
+    }
+
+    /**
+     * @brief Searching function by ordinal.
+     * @param ordinal Function ordinal.
+     * @return Exported function.
+     */
+    Function FindFunction(WORD ordinal) const { return export_.FindFunction(ordinal); }
+
+private:
+    const Export<Arch> export_;
+    Slot*              slots_;
+    size_t             mask_;
+};
+
+}
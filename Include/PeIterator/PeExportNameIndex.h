@@ -0,0 +1,134 @@
+#pragma once
+
+#include "PeExport.h"
+#include "PeTypes.h"
+
+namespace pe_iterator {
+
+/**
+ * @brief Index of the exported functions names by the functions table index, the inverse of the ordinals table.
+ *
+ * The names table index of every function is stored once, so walking all exports names every function in constant time
+ * instead of searching the ordinals table per function. It is stored in a caller-supplied buffer, no memory is allocated.
+ * Iteration over the index which failed to build falls back to the name search of the Export.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class ExportNameIndex {
+public:
+    using Iterator = typename Export<Arch>::Iterator;
+
+    // Name index of the function exported only by ordinal.
+    static constexpr DWORD kNoName = Export<Arch>::kNoName;
+
+    /**
+     * @brief Returns count of entries required to index the specified count of functions.
+     * @param countFunctions Count of exported functions.
+     */
+    static constexpr size_t GetRequiredCapacity(DWORD countFunctions) noexcept { return countFunctions; }
+
+    /**
+     * @brief Initialization constructor, builds the index.
+     * @param moduleExport Image exports, copied into the index, the image data must outlive the index.
+     * @param nameIndices Pointer to the buffer receiving the names table index of every function.
+     * @param capacity Count of entries the buffer can hold, see GetRequiredCapacity.
+     */
+    ExportNameIndex(const Export<Arch>& moduleExport, DWORD* nameIndices, size_t capacity)
+        : export_(moduleExport)
+        , nameIndices_(nameIndices)
+        , built_(false)
+    {
+        if (!nameIndices_ || !export_.IsValid() || capacity < GetRequiredCapacity(export_.GetCountFunctions()))
+            return;
+
+        const auto countFunctions = export_.GetCountFunctions();
+        for (DWORD cx = 0; cx < countFunctions; ++cx)
+            nameIndices_[cx] = kNoName;
+
+        // Walking the names backwards leaves the first name of the functions with several names.
+        for (DWORD nameIndex = export_.GetCountOfFunctionsNames(); nameIndex-- > 0;) {
+            const auto functionIndex = export_.GetFunctionIndex(nameIndex);
+            if (functionIndex < countFunctions)
+                nameIndices_[functionIndex] = nameIndex;
+        }
+
+        built_ = true;
+    }
+
+    /**
+     * @brief Initialization constructor, builds the index.
+     * @tparam N Count of entries in the buffer.
+     * @param moduleExport Image exports, copied into the index, the image data must outlive the index.
+     * @param nameIndices Buffer receiving the names table index of every function.
+     */
+    template<size_t N> ExportNameIndex(const Export<Arch>& moduleExport, DWORD (&nameIndices)[N])
+        : ExportNameIndex(moduleExport, nameIndices, N)
+    {
+    }
+
+    /**
+     * @brief Initialization constructor, builds the index in the entries allocated from the arena.
+     * @param moduleExport Image exports, copied into the index, the image data must outlive the index.
+     * @param arena Arena the entries are allocated from, the index is not valid if it is exhausted.
+     */
+    ExportNameIndex(const Export<Arch>& moduleExport, Arena& arena)
+        : ExportNameIndex(moduleExport, arena.Allocate<DWORD>(GetRequiredCapacity(moduleExport.GetCountFunctions())),
+                          GetRequiredCapacity(moduleExport.GetCountFunctions()))
+    {
+    }
+
+    /**
+     * @brief Returns true if the index was successfully built.
+     */
+    bool IsValid() const noexcept { return built_; }
+
+    /**
+     * @brief Returns indexed exports.
+     */
+    const Export<Arch>& GetExport() const noexcept { return export_; }
+
+    /**
+     * @brief Returns index in the names table of the first name of the function.
+     * @param functionIndex Index in the functions table.
+     * @return Names table index, or kNoName if the function is exported by ordinal only or the index was not built.
+     */
+    DWORD GetNameIndex(DWORD functionIndex) const noexcept
+    {
+        return built_ && functionIndex < export_.GetCountFunctions() ? nameIndices_[functionIndex] : kNoName;
+    }
+
+    /**
+     * @brief Returns the first name of the function, same as returned by Export<Arch>::FindFunctionName.
+     * @param functionIndex Index in the functions table.
+     * @return The function name, or nullptr if the function is exported by ordinal only.
+     */
+    const char* GetName(DWORD functionIndex) const
+    {
+        if (!built_)
+            return functionIndex < export_.GetCountFunctions() ? export_.FindFunctionName(functionIndex) : nullptr;
+
+        const auto nameIndex = GetNameIndex(functionIndex);
+        return nameIndex != kNoName ? export_.GetFunctionName(nameIndex) : nullptr;
+    }
+
+    /**
+     * @brief Returns an iterator pointing to the beginning of functions, naming them through the index.
+     */
+    Iterator begin() const noexcept { return export_.begin(built_ ? nameIndices_ : nullptr); }
+
+    /**
+     * @brief Returns an iterator pointing to the end of functions.
+     */
+    Iterator end() const noexcept { return export_.end(); }
+
+    /**
+     * @brief Returns count of the iterated functions.
+     */
+    size_t size() const noexcept { return export_.size(); }
+
+private:
+    const Export<Arch> export_;
+    DWORD*             nameIndices_;
+    bool               built_;
+};
+
+}
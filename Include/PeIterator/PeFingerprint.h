@@ -0,0 +1,992 @@
+#pragma once
+
+#include "PeExport.h"
+#include "PeImport.h"
+#include "PeTypes.h"
+#include <cstring>
+
+namespace pe_iterator {
+
+/**
+ * @brief MD5 digest.
+ */
+struct Md5Digest {
+    BYTE Bytes[16] = {};
+
+    /**
+     * @brief Returns true if the digest was computed, the digest of nothing hashed is all zero.
+     */
+    bool IsValid() const noexcept
+    {
+        for (const auto byte : Bytes) {
+            if (byte)
+                return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Writes the digest as 32 lower case hex digits and the terminating null.
+     * @param string Destination buffer.
+     * @return Pointer to the string.
+     */
+    const char* ToString(char (&string)[33]) const noexcept
+    {
+        constexpr char kDigits[] = "0123456789abcdef";
+        for (size_t cx = 0; cx < sizeof(Bytes); ++cx) {
+            string[cx * 2]     = kDigits[Bytes[cx] >> 4];
+            string[cx * 2 + 1] = kDigits[Bytes[cx] & 0xF];
+        }
+
+        string[32] = '\0';
+        return string;
+    }
+
+    bool operator==(const Md5Digest& other) const noexcept { return memcmp(Bytes, other.Bytes, sizeof(Bytes)) == 0; }
+    bool operator!=(const Md5Digest& other) const noexcept { return !(*this == other); }
+};
+
+/**
+ * @brief Incremental MD5 (RFC 1321), the hash of the common imphash definition.
+ */
+class Md5 {
+public:
+    /**
+     * @brief Appends the bytes to the hashed message.
+     * @param data Pointer to the bytes.
+     * @param size Count of bytes.
+     */
+    void Update(const void* data, size_t size) noexcept
+    {
+        auto bytes    = static_cast<const BYTE*>(data);
+        auto buffered = static_cast<size_t>(length_ % kBlockSize);
+        length_ += size;
+
+        if (buffered) {
+            const auto count = size < kBlockSize - buffered ? size : kBlockSize - buffered;
+            memcpy(block_ + buffered, bytes, count);
+            bytes += count;
+            size -= count;
+            buffered += count;
+            if (buffered < kBlockSize)
+                return;
+
+            Transform(block_);
+        }
+
+        for (; size >= kBlockSize; bytes += kBlockSize, size -= kBlockSize)
+            Transform(bytes);
+
+        memcpy(block_, bytes, size);
+    }
+
+    /**
+     * @brief Pads the message and returns its digest, the hasher must not be updated afterwards.
+     */
+    Md5Digest Final() noexcept
+    {
+        const auto bits      = length_ * 8;
+        const BYTE padding[] = { 0x80 };
+        const BYTE zero[kBlockSize]{};
+        const auto buffered = static_cast<size_t>(length_ % kBlockSize);
+
+        Update(padding, sizeof(padding));
+        Update(zero, (buffered < 56 ? 55 : 119) - buffered);
+
+        BYTE length[8];
+        for (size_t cx = 0; cx < sizeof(length); ++cx)
+            length[cx] = static_cast<BYTE>(bits >> (cx * 8));
+        Update(length, sizeof(length));
+
+        Md5Digest digest;
+        for (size_t cx = 0; cx < sizeof(digest.Bytes); ++cx)
+            digest.Bytes[cx] = static_cast<BYTE>(state_[cx / 4] >> (cx % 4 * 8));
+
+        return digest;
+    }
+
+private:
+    static constexpr size_t kBlockSize = 64;
+
+    static uint32_t RotateLeft(uint32_t value, uint32_t count) noexcept { return value << count | value >> (32 - count); }
+
+    /**
+     * @brief Processes one 64-byte block, words are read little-endian regardless of the host byte order.
+     */
+    void Transform(const BYTE* block) noexcept
+    {
+        static constexpr uint32_t kSines[64] = {
+            0xD76AA478, 0xE8C7B756, 0x242070DB, 0xC1BDCEEE, 0xF57C0FAF, 0x4787C62A, 0xA8304613, 0xFD469501,
+            0x698098D8, 0x8B44F7AF, 0xFFFF5BB1, 0x895CD7BE, 0x6B901122, 0xFD987193, 0xA679438E, 0x49B40821,
+            0xF61E2562, 0xC040B340, 0x265E5A51, 0xE9B6C7AA, 0xD62F105D, 0x02441453, 0xD8A1E681, 0xE7D3FBC8,
+            0x21E1CDE6, 0xC33707D6, 0xF4D50D87, 0x455A14ED, 0xA9E3E905, 0xFCEFA3F8, 0x676F02D9, 0x8D2A4C8A,
+            0xFFFA3942, 0x8771F681, 0x6D9D6122, 0xFDE5380C, 0xA4BEEA44, 0x4BDECFA9, 0xF6BB4B60, 0xBEBFBC70,
+            0x289B7EC6, 0xEAA127FA, 0xD4EF3085, 0x04881D05, 0xD9D4D039, 0xE6DB99E5, 0x1FA27CF8, 0xC4AC5665,
+            0xF4292244, 0x432AFF97, 0xAB9423A7, 0xFC93A039, 0x655B59C3, 0x8F0CCC92, 0xFFEFF47D, 0x85845DD1,
+            0x6FA87E4F, 0xFE2CE6E0, 0xA3014314, 0x4E0811A1, 0xF7537E82, 0xBD3AF235, 0x2AD7D2BB, 0xEB86D391,
+        };
+        static constexpr uint32_t kShifts[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+        uint32_t words[16];
+        for (size_t cx = 0; cx < 16; ++cx) {
+            words[cx] = static_cast<uint32_t>(block[cx * 4]) | static_cast<uint32_t>(block[cx * 4 + 1]) << 8 | static_cast<uint32_t>(block[cx * 4 + 2]) << 16
+                | static_cast<uint32_t>(block[cx * 4 + 3]) << 24;
+        }
+
+        auto a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+        for (uint32_t cx = 0; cx < 64; ++cx) {
+            uint32_t mix, word;
+            switch (cx / 16) {
+            case 0:
+                mix  = (b & c) | (~b & d);
+                word = cx;
+                break;
+            case 1:
+                mix  = (d & b) | (~d & c);
+                word = (5 * cx + 1) % 16;
+                break;
+            case 2:
+                mix  = b ^ c ^ d;
+                word = (3 * cx + 5) % 16;
+                break;
+            default:
+                mix  = c ^ (b | ~d);
+                word = (7 * cx) % 16;
+                break;
+            }
+
+            const auto rotated = RotateLeft(a + mix + kSines[cx] + words[word], kShifts[cx / 16 * 4 + cx % 4]);
+            a                  = d;
+            d                  = c;
+            c                  = b;
+            b                  = b + rotated;
+        }
+
+        state_[0] += a;
+        state_[1] += b;
+        state_[2] += c;
+        state_[3] += d;
+    }
+
+    uint32_t state_[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+    uint64_t length_   = 0;
+    BYTE     block_[kBlockSize];
+};
+
+/**
+ * @brief Incremental 64-bit FNV-1a, the fast non-cryptographic fingerprint hash, see HashBytes64.
+ */
+class Fnv64 {
+public:
+    /**
+     * @brief Appends the bytes to the hashed message.
+     * @param data Pointer to the bytes.
+     * @param size Count of bytes.
+     */
+    void Update(const void* data, size_t size) noexcept { hash_ = HashBytes64(data, size, hash_); }
+
+    /**
+     * @brief Returns the hash of the message.
+     */
+    uint64_t Final() const noexcept { return hash_; }
+
+private:
+    uint64_t hash_ = kContentHashOffsetBasis;
+};
+
+/**
+ * @brief Resolver of the name of the function imported by ordinal.
+ * @return Function name, or nullptr to hash the ordinal as "ord<ordinal>".
+ */
+using OrdinalNameResolver = const char* (*)(const char* moduleName, WORD ordinal);
+
+/**
+ * @brief Name of the function exported by ordinal.
+ */
+struct OrdinalName {
+    WORD        Ordinal;
+    const char* Name;
+};
+
+namespace fingerprint {
+
+/**
+ * @brief Returns true if the ordinals of the table are strictly ascending, as FindOrdinalName requires.
+ */
+template<size_t N> constexpr bool IsOrdinalTableSorted(const OrdinalName (&names)[N]) noexcept
+{
+    for (size_t cx = 1; cx < N; ++cx) {
+        if (names[cx - 1].Ordinal >= names[cx].Ordinal)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Searching the name of the ordinal in the table sorted by ordinals.
+ * @param names Ordinal names table.
+ * @param ordinal Function ordinal.
+ * @return Function name, or nullptr if the ordinal is not in the table.
+ */
+template<size_t N> const char* FindOrdinalName(const OrdinalName (&names)[N], WORD ordinal) noexcept
+{
+    size_t left = 0, right = N;
+    while (left < right) {
+        const auto middle = left + (right - left) / 2;
+        if (names[middle].Ordinal < ordinal)
+            left = middle + 1;
+        else if (names[middle].Ordinal > ordinal)
+            right = middle;
+        else
+            return names[middle].Name;
+    }
+
+    return nullptr;
+}
+
+}
+
+/**
+ * @brief Resolves the ordinals of the functions exported by ws2_32.dll and wsock32.dll, as the pefile ordinal tables do.
+ */
+inline const char* ResolveWinsockOrdinal(const char* moduleName, WORD ordinal) noexcept
+{
+    static constexpr OrdinalName kNames[] = {
+        { 1, "accept" },
+        { 2, "bind" },
+        { 3, "closesocket" },
+        { 4, "connect" },
+        { 5, "getpeername" },
+        { 6, "getsockname" },
+        { 7, "getsockopt" },
+        { 8, "htonl" },
+        { 9, "htons" },
+        { 10, "ioctlsocket" },
+        { 11, "inet_addr" },
+        { 12, "inet_ntoa" },
+        { 13, "listen" },
+        { 14, "ntohl" },
+        { 15, "ntohs" },
+        { 16, "recv" },
+        { 17, "recvfrom" },
+        { 18, "select" },
+        { 19, "send" },
+        { 20, "sendto" },
+        { 21, "setsockopt" },
+        { 22, "shutdown" },
+        { 23, "socket" },
+        { 24, "GetAddrInfoW" },
+        { 25, "GetNameInfoW" },
+        { 26, "WSApSetPostRoutine" },
+        { 27, "FreeAddrInfoW" },
+        { 28, "WPUCompleteOverlappedRequest" },
+        { 29, "WSAAccept" },
+        { 30, "WSAAddressToStringA" },
+        { 31, "WSAAddressToStringW" },
+        { 32, "WSACloseEvent" },
+        { 33, "WSAConnect" },
+        { 34, "WSACreateEvent" },
+        { 35, "WSADuplicateSocketA" },
+        { 36, "WSADuplicateSocketW" },
+        { 37, "WSAEnumNameSpaceProvidersA" },
+        { 38, "WSAEnumNameSpaceProvidersW" },
+        { 39, "WSAEnumNetworkEvents" },
+        { 40, "WSAEnumProtocolsA" },
+        { 41, "WSAEnumProtocolsW" },
+        { 42, "WSAEventSelect" },
+        { 43, "WSAGetOverlappedResult" },
+        { 44, "WSAGetQOSByName" },
+        { 45, "WSAGetServiceClassInfoA" },
+        { 46, "WSAGetServiceClassInfoW" },
+        { 47, "WSAGetServiceClassNameByClassIdA" },
+        { 48, "WSAGetServiceClassNameByClassIdW" },
+        { 49, "WSAHtonl" },
+        { 50, "WSAHtons" },
+        { 51, "gethostbyaddr" },
+        { 52, "gethostbyname" },
+        { 53, "getprotobyname" },
+        { 54, "getprotobynumber" },
+        { 55, "getservbyname" },
+        { 56, "getservbyport" },
+        { 57, "gethostname" },
+        { 58, "WSAInstallServiceClassA" },
+        { 59, "WSAInstallServiceClassW" },
+        { 60, "WSAIoctl" },
+        { 61, "WSAJoinLeaf" },
+        { 62, "WSALookupServiceBeginA" },
+        { 63, "WSALookupServiceBeginW" },
+        { 64, "WSALookupServiceEnd" },
+        { 65, "WSALookupServiceNextA" },
+        { 66, "WSALookupServiceNextW" },
+        { 67, "WSANSPIoctl" },
+        { 68, "WSANtohl" },
+        { 69, "WSANtohs" },
+        { 70, "WSAProviderConfigChange" },
+        { 71, "WSARecv" },
+        { 72, "WSARecvDisconnect" },
+        { 73, "WSARecvFrom" },
+        { 74, "WSARemoveServiceClass" },
+        { 75, "WSAResetEvent" },
+        { 76, "WSASend" },
+        { 77, "WSASendDisconnect" },
+        { 78, "WSASendTo" },
+        { 79, "WSASetEvent" },
+        { 80, "WSASetServiceA" },
+        { 81, "WSASetServiceW" },
+        { 82, "WSASocketA" },
+        { 83, "WSASocketW" },
+        { 84, "WSAStringToAddressA" },
+        { 85, "WSAStringToAddressW" },
+        { 86, "WSAWaitForMultipleEvents" },
+        { 87, "WSCDeinstallProvider" },
+        { 88, "WSCEnableNSProvider" },
+        { 89, "WSCEnumProtocols" },
+        { 90, "WSCGetProviderPath" },
+        { 91, "WSCInstallNameSpace" },
+        { 92, "WSCInstallProvider" },
+        { 93, "WSCUnInstallNameSpace" },
+        { 94, "WSCUpdateProvider" },
+        { 95, "WSCWriteNameSpaceOrder" },
+        { 96, "WSCWriteProviderOrder" },
+        { 97, "freeaddrinfo" },
+        { 98, "getaddrinfo" },
+        { 99, "getnameinfo" },
+        { 101, "WSAAsyncSelect" },
+        { 102, "WSAAsyncGetHostByAddr" },
+        { 103, "WSAAsyncGetHostByName" },
+        { 104, "WSAAsyncGetProtoByNumber" },
+        { 105, "WSAAsyncGetProtoByName" },
+        { 106, "WSAAsyncGetServByPort" },
+        { 107, "WSAAsyncGetServByName" },
+        { 108, "WSACancelAsyncRequest" },
+        { 109, "WSASetBlockingHook" },
+        { 110, "WSAUnhookBlockingHook" },
+        { 111, "WSAGetLastError" },
+        { 112, "WSASetLastError" },
+        { 113, "WSACancelBlockingCall" },
+        { 114, "WSAIsBlocking" },
+        { 115, "WSAStartup" },
+        { 116, "WSACleanup" },
+        { 151, "__WSAFDIsSet" },
+        { 500, "WEP" },
+    };
+
+    static_assert(fingerprint::IsOrdinalTableSorted(kNames), "Ordinals are sorted");
+
+    if (CompareNamesInsensitive(moduleName, "ws2_32.dll") != 0 && CompareNamesInsensitive(moduleName, "wsock32.dll") != 0)
+        return nullptr;
+
+    return fingerprint::FindOrdinalName(kNames, ordinal);
+}
+
+/**
+ * @brief Resolves the ordinals of the functions exported by oleaut32.dll, as the pefile ordinal tables do.
+ */
+inline const char* ResolveOleAutOrdinal(const char* moduleName, WORD ordinal) noexcept
+{
+    static constexpr OrdinalName kNames[] = {
+        { 2, "SysAllocString" },
+        { 3, "SysReAllocString" },
+        { 4, "SysAllocStringLen" },
+        { 5, "SysReAllocStringLen" },
+        { 6, "SysFreeString" },
+        { 7, "SysStringLen" },
+        { 8, "VariantInit" },
+        { 9, "VariantClear" },
+        { 10, "VariantCopy" },
+        { 11, "VariantCopyInd" },
+        { 12, "VariantChangeType" },
+        { 13, "VariantTimeToDosDateTime" },
+        { 14, "DosDateTimeToVariantTime" },
+        { 15, "SafeArrayCreate" },
+        { 16, "SafeArrayDestroy" },
+        { 17, "SafeArrayGetDim" },
+        { 18, "SafeArrayGetElemsize" },
+        { 19, "SafeArrayGetUBound" },
+        { 20, "SafeArrayGetLBound" },
+        { 21, "SafeArrayLock" },
+        { 22, "SafeArrayUnlock" },
+        { 23, "SafeArrayAccessData" },
+        { 24, "SafeArrayUnaccessData" },
+        { 25, "SafeArrayGetElement" },
+        { 26, "SafeArrayPutElement" },
+        { 27, "SafeArrayCopy" },
+        { 28, "DispGetParam" },
+        { 29, "DispGetIDsOfNames" },
+        { 30, "DispInvoke" },
+        { 31, "CreateDispTypeInfo" },
+        { 32, "CreateStdDispatch" },
+        { 33, "RegisterActiveObject" },
+        { 34, "RevokeActiveObject" },
+        { 35, "GetActiveObject" },
+        { 36, "SafeArrayAllocDescriptor" },
+        { 37, "SafeArrayAllocData" },
+        { 38, "SafeArrayDestroyDescriptor" },
+        { 39, "SafeArrayDestroyData" },
+        { 40, "SafeArrayRedim" },
+        { 41, "SafeArrayAllocDescriptorEx" },
+        { 42, "SafeArrayCreateEx" },
+        { 43, "SafeArrayCreateVectorEx" },
+        { 44, "SafeArraySetRecordInfo" },
+        { 45, "SafeArrayGetRecordInfo" },
+        { 46, "VarParseNumFromStr" },
+        { 47, "VarNumFromParseNum" },
+        { 48, "VarI2FromUI1" },
+        { 49, "VarI2FromI4" },
+        { 50, "VarI2FromR4" },
+        { 51, "VarI2FromR8" },
+        { 52, "VarI2FromCy" },
+        { 53, "VarI2FromDate" },
+        { 54, "VarI2FromStr" },
+        { 55, "VarI2FromDisp" },
+        { 56, "VarI2FromBool" },
+        { 57, "SafeArraySetIID" },
+        { 58, "VarI4FromUI1" },
+        { 59, "VarI4FromI2" },
+        { 60, "VarI4FromR4" },
+        { 61, "VarI4FromR8" },
+        { 62, "VarI4FromCy" },
+        { 63, "VarI4FromDate" },
+        { 64, "VarI4FromStr" },
+        { 65, "VarI4FromDisp" },
+        { 66, "VarI4FromBool" },
+        { 67, "SafeArrayGetIID" },
+        { 68, "VarR4FromUI1" },
+        { 69, "VarR4FromI2" },
+        { 70, "VarR4FromI4" },
+        { 71, "VarR4FromR8" },
+        { 72, "VarR4FromCy" },
+        { 73, "VarR4FromDate" },
+        { 74, "VarR4FromStr" },
+        { 75, "VarR4FromDisp" },
+        { 76, "VarR4FromBool" },
+        { 77, "SafeArrayGetVartype" },
+        { 78, "VarR8FromUI1" },
+        { 79, "VarR8FromI2" },
+        { 80, "VarR8FromI4" },
+        { 81, "VarR8FromR4" },
+        { 82, "VarR8FromCy" },
+        { 83, "VarR8FromDate" },
+        { 84, "VarR8FromStr" },
+        { 85, "VarR8FromDisp" },
+        { 86, "VarR8FromBool" },
+        { 87, "VarFormat" },
+        { 88, "VarDateFromUI1" },
+        { 89, "VarDateFromI2" },
+        { 90, "VarDateFromI4" },
+        { 91, "VarDateFromR4" },
+        { 92, "VarDateFromR8" },
+        { 93, "VarDateFromCy" },
+        { 94, "VarDateFromStr" },
+        { 95, "VarDateFromDisp" },
+        { 96, "VarDateFromBool" },
+        { 97, "VarFormatDateTime" },
+        { 98, "VarCyFromUI1" },
+        { 99, "VarCyFromI2" },
+        { 100, "VarCyFromI4" },
+        { 101, "VarCyFromR4" },
+        { 102, "VarCyFromR8" },
+        { 103, "VarCyFromDate" },
+        { 104, "VarCyFromStr" },
+        { 105, "VarCyFromDisp" },
+        { 106, "VarCyFromBool" },
+        { 107, "VarFormatNumber" },
+        { 108, "VarBstrFromUI1" },
+        { 109, "VarBstrFromI2" },
+        { 110, "VarBstrFromI4" },
+        { 111, "VarBstrFromR4" },
+        { 112, "VarBstrFromR8" },
+        { 113, "VarBstrFromCy" },
+        { 114, "VarBstrFromDate" },
+        { 115, "VarBstrFromDisp" },
+        { 116, "VarBstrFromBool" },
+        { 117, "VarFormatPercent" },
+        { 118, "VarBoolFromUI1" },
+        { 119, "VarBoolFromI2" },
+        { 120, "VarBoolFromI4" },
+        { 121, "VarBoolFromR4" },
+        { 122, "VarBoolFromR8" },
+        { 123, "VarBoolFromDate" },
+        { 124, "VarBoolFromCy" },
+        { 125, "VarBoolFromStr" },
+        { 126, "VarBoolFromDisp" },
+        { 127, "VarFormatCurrency" },
+        { 128, "VarWeekdayName" },
+        { 129, "VarMonthName" },
+        { 130, "VarUI1FromI2" },
+        { 131, "VarUI1FromI4" },
+        { 132, "VarUI1FromR4" },
+        { 133, "VarUI1FromR8" },
+        { 134, "VarUI1FromCy" },
+        { 135, "VarUI1FromDate" },
+        { 136, "VarUI1FromStr" },
+        { 137, "VarUI1FromDisp" },
+        { 138, "VarUI1FromBool" },
+        { 139, "VarFormatFromTokens" },
+        { 140, "VarTokenizeFormatString" },
+        { 141, "VarAdd" },
+        { 142, "VarAnd" },
+        { 143, "VarDiv" },
+        { 144, "DllCanUnloadNow" },
+        { 145, "DllGetClassObject" },
+        { 146, "DispCallFunc" },
+        { 147, "VariantChangeTypeEx" },
+        { 148, "SafeArrayPtrOfIndex" },
+        { 149, "SysStringByteLen" },
+        { 150, "SysAllocStringByteLen" },
+        { 151, "DllRegisterServer" },
+        { 152, "VarEqv" },
+        { 153, "VarIdiv" },
+        { 154, "VarImp" },
+        { 155, "VarMod" },
+        { 156, "VarMul" },
+        { 157, "VarOr" },
+        { 158, "VarPow" },
+        { 159, "VarSub" },
+        { 160, "CreateTypeLib" },
+        { 161, "LoadTypeLib" },
+        { 162, "LoadRegTypeLib" },
+        { 163, "RegisterTypeLib" },
+        { 164, "QueryPathOfRegTypeLib" },
+        { 165, "LHashValOfNameSys" },
+        { 166, "LHashValOfNameSysA" },
+        { 167, "VarXor" },
+        { 168, "VarAbs" },
+        { 169, "VarFix" },
+        { 170, "OaBuildVersion" },
+        { 171, "ClearCustData" },
+        { 172, "VarInt" },
+        { 173, "VarNeg" },
+        { 174, "VarNot" },
+        { 175, "VarRound" },
+        { 176, "VarCmp" },
+        { 177, "VarDecAdd" },
+        { 178, "VarDecDiv" },
+        { 179, "VarDecMul" },
+        { 180, "CreateTypeLib2" },
+        { 181, "VarDecSub" },
+        { 182, "VarDecAbs" },
+        { 183, "LoadTypeLibEx" },
+        { 184, "SystemTimeToVariantTime" },
+        { 185, "VariantTimeToSystemTime" },
+        { 186, "UnRegisterTypeLib" },
+        { 187, "VarDecFix" },
+        { 188, "VarDecInt" },
+        { 189, "VarDecNeg" },
+        { 190, "VarDecFromUI1" },
+        { 191, "VarDecFromI2" },
+        { 192, "VarDecFromI4" },
+        { 193, "VarDecFromR4" },
+        { 194, "VarDecFromR8" },
+        { 195, "VarDecFromDate" },
+        { 196, "VarDecFromCy" },
+        { 197, "VarDecFromStr" },
+        { 198, "VarDecFromDisp" },
+        { 199, "VarDecFromBool" },
+        { 200, "GetErrorInfo" },
+        { 201, "SetErrorInfo" },
+        { 202, "CreateErrorInfo" },
+        { 203, "VarDecRound" },
+        { 204, "VarDecCmp" },
+        { 205, "VarI2FromI1" },
+        { 206, "VarI2FromUI2" },
+        { 207, "VarI2FromUI4" },
+        { 208, "VarI2FromDec" },
+        { 209, "VarI4FromI1" },
+        { 210, "VarI4FromUI2" },
+        { 211, "VarI4FromUI4" },
+        { 212, "VarI4FromDec" },
+        { 213, "VarR4FromI1" },
+        { 214, "VarR4FromUI2" },
+        { 215, "VarR4FromUI4" },
+        { 216, "VarR4FromDec" },
+        { 217, "VarR8FromI1" },
+        { 218, "VarR8FromUI2" },
+        { 219, "VarR8FromUI4" },
+        { 220, "VarR8FromDec" },
+        { 221, "VarDateFromI1" },
+        { 222, "VarDateFromUI2" },
+        { 223, "VarDateFromUI4" },
+        { 224, "VarDateFromDec" },
+        { 225, "VarCyFromI1" },
+        { 226, "VarCyFromUI2" },
+        { 227, "VarCyFromUI4" },
+        { 228, "VarCyFromDec" },
+        { 229, "VarBstrFromI1" },
+        { 230, "VarBstrFromUI2" },
+        { 231, "VarBstrFromUI4" },
+        { 232, "VarBstrFromDec" },
+        { 233, "VarBoolFromI1" },
+        { 234, "VarBoolFromUI2" },
+        { 235, "VarBoolFromUI4" },
+        { 236, "VarBoolFromDec" },
+        { 237, "VarUI1FromI1" },
+        { 238, "VarUI1FromUI2" },
+        { 239, "VarUI1FromUI4" },
+        { 240, "VarUI1FromDec" },
+        { 241, "VarDecFromI1" },
+        { 242, "VarDecFromUI2" },
+        { 243, "VarDecFromUI4" },
+        { 244, "VarI1FromUI1" },
+        { 245, "VarI1FromI2" },
+        { 246, "VarI1FromI4" },
+        { 247, "VarI1FromR4" },
+        { 248, "VarI1FromR8" },
+        { 249, "VarI1FromDate" },
+        { 250, "VarI1FromCy" },
+        { 251, "VarI1FromStr" },
+        { 252, "VarI1FromDisp" },
+        { 253, "VarI1FromBool" },
+        { 254, "VarI1FromUI2" },
+        { 255, "VarI1FromUI4" },
+        { 256, "VarI1FromDec" },
+        { 257, "VarUI2FromUI1" },
+        { 258, "VarUI2FromI2" },
+        { 259, "VarUI2FromI4" },
+        { 260, "VarUI2FromR4" },
+        { 261, "VarUI2FromR8" },
+        { 262, "VarUI2FromDate" },
+        { 263, "VarUI2FromCy" },
+        { 264, "VarUI2FromStr" },
+        { 265, "VarUI2FromDisp" },
+        { 266, "VarUI2FromBool" },
+        { 267, "VarUI2FromI1" },
+        { 268, "VarUI2FromUI4" },
+        { 269, "VarUI2FromDec" },
+        { 270, "VarUI4FromUI1" },
+        { 271, "VarUI4FromI2" },
+        { 272, "VarUI4FromI4" },
+        { 273, "VarUI4FromR4" },
+        { 274, "VarUI4FromR8" },
+        { 275, "VarUI4FromDate" },
+        { 276, "VarUI4FromCy" },
+        { 277, "VarUI4FromStr" },
+        { 278, "VarUI4FromDisp" },
+        { 279, "VarUI4FromBool" },
+        { 280, "VarUI4FromI1" },
+        { 281, "VarUI4FromUI2" },
+        { 282, "VarUI4FromDec" },
+        { 283, "BSTR_UserSize" },
+        { 284, "BSTR_UserMarshal" },
+        { 285, "BSTR_UserUnmarshal" },
+        { 286, "BSTR_UserFree" },
+        { 287, "VARIANT_UserSize" },
+        { 288, "VARIANT_UserMarshal" },
+        { 289, "VARIANT_UserUnmarshal" },
+        { 290, "VARIANT_UserFree" },
+        { 291, "LPSAFEARRAY_UserSize" },
+        { 292, "LPSAFEARRAY_UserMarshal" },
+        { 293, "LPSAFEARRAY_UserUnmarshal" },
+        { 294, "LPSAFEARRAY_UserFree" },
+        { 295, "LPSAFEARRAY_Size" },
+        { 296, "LPSAFEARRAY_Marshal" },
+        { 297, "LPSAFEARRAY_Unmarshal" },
+        { 298, "VarDecCmpR8" },
+        { 299, "VarCyAdd" },
+        { 300, "DllUnregisterServer" },
+        { 301, "OACreateTypeLib2" },
+        { 303, "VarCyMul" },
+        { 304, "VarCyMulI4" },
+        { 305, "VarCySub" },
+        { 306, "VarCyAbs" },
+        { 307, "VarCyFix" },
+        { 308, "VarCyInt" },
+        { 309, "VarCyNeg" },
+        { 310, "VarCyRound" },
+        { 311, "VarCyCmp" },
+        { 312, "VarCyCmpR8" },
+        { 313, "VarBstrCat" },
+        { 314, "VarBstrCmp" },
+        { 315, "VarR8Pow" },
+        { 316, "VarR4CmpR8" },
+        { 317, "VarR8Round" },
+        { 318, "VarCat" },
+        { 319, "VarDateFromUdateEx" },
+        { 322, "GetRecordInfoFromGuids" },
+        { 323, "GetRecordInfoFromTypeInfo" },
+        { 325, "SetVarConversionLocaleSetting" },
+        { 326, "GetVarConversionLocaleSetting" },
+        { 327, "SetOaNoCache" },
+        { 329, "VarCyMulI8" },
+        { 330, "VarDateFromUdate" },
+        { 331, "VarUdateFromDate" },
+        { 332, "GetAltMonthNames" },
+        { 333, "VarI8FromUI1" },
+        { 334, "VarI8FromI2" },
+        { 335, "VarI8FromR4" },
+        { 336, "VarI8FromR8" },
+        { 337, "VarI8FromCy" },
+        { 338, "VarI8FromDate" },
+        { 339, "VarI8FromStr" },
+        { 340, "VarI8FromDisp" },
+        { 341, "VarI8FromBool" },
+        { 342, "VarI8FromI1" },
+        { 343, "VarI8FromUI2" },
+        { 344, "VarI8FromUI4" },
+        { 345, "VarI8FromDec" },
+        { 346, "VarI2FromI8" },
+        { 347, "VarI2FromUI8" },
+        { 348, "VarI4FromI8" },
+        { 349, "VarI4FromUI8" },
+        { 360, "VarR4FromI8" },
+        { 361, "VarR4FromUI8" },
+        { 362, "VarR8FromI8" },
+        { 363, "VarR8FromUI8" },
+        { 364, "VarDateFromI8" },
+        { 365, "VarDateFromUI8" },
+        { 366, "VarCyFromI8" },
+        { 367, "VarCyFromUI8" },
+        { 368, "VarBstrFromI8" },
+        { 369, "VarBstrFromUI8" },
+        { 370, "VarBoolFromI8" },
+        { 371, "VarBoolFromUI8" },
+        { 372, "VarUI1FromI8" },
+        { 373, "VarUI1FromUI8" },
+        { 374, "VarDecFromI8" },
+        { 375, "VarDecFromUI8" },
+        { 376, "VarI1FromI8" },
+        { 377, "VarI1FromUI8" },
+        { 378, "VarUI2FromI8" },
+        { 379, "VarUI2FromUI8" },
+        { 401, "OleLoadPictureEx" },
+        { 402, "OleLoadPictureFileEx" },
+        { 411, "SafeArrayCreateVector" },
+        { 412, "SafeArrayCopyData" },
+        { 413, "VectorFromBstr" },
+        { 414, "BstrFromVector" },
+        { 415, "OleIconToCursor" },
+        { 416, "OleCreatePropertyFrameIndirect" },
+        { 417, "OleCreatePropertyFrame" },
+        { 418, "OleLoadPicture" },
+        { 419, "OleCreatePictureIndirect" },
+        { 420, "OleCreateFontIndirect" },
+        { 421, "OleTranslateColor" },
+        { 422, "OleLoadPictureFile" },
+        { 423, "OleSavePictureFile" },
+        { 424, "OleLoadPicturePath" },
+        { 425, "VarUI4FromI8" },
+        { 426, "VarUI4FromUI8" },
+        { 427, "VarI8FromUI8" },
+        { 428, "VarUI8FromI8" },
+        { 429, "VarUI8FromUI1" },
+        { 430, "VarUI8FromI2" },
+        { 431, "VarUI8FromR4" },
+        { 432, "VarUI8FromR8" },
+        { 433, "VarUI8FromCy" },
+        { 434, "VarUI8FromDate" },
+        { 435, "VarUI8FromStr" },
+        { 436, "VarUI8FromDisp" },
+        { 437, "VarUI8FromBool" },
+        { 438, "VarUI8FromI1" },
+        { 439, "VarUI8FromUI2" },
+        { 440, "VarUI8FromUI4" },
+        { 441, "VarUI8FromDec" },
+        { 442, "RegisterTypeLibForUser" },
+        { 443, "UnRegisterTypeLibForUser" },
+    };
+
+    static_assert(fingerprint::IsOrdinalTableSorted(kNames), "Ordinals are sorted");
+
+    if (CompareNamesInsensitive(moduleName, "oleaut32.dll") != 0)
+        return nullptr;
+
+    return fingerprint::FindOrdinalName(kNames, ordinal);
+}
+
+/**
+ * @brief Resolves the ordinals of all modules of the pefile ordinal tables, so the import hash matches the pefile imphash.
+ */
+inline const char* ResolveKnownOrdinal(const char* moduleName, WORD ordinal) noexcept
+{
+    const auto name = ResolveWinsockOrdinal(moduleName, ordinal);
+    return name ? name : ResolveOleAutOrdinal(moduleName, ordinal);
+}
+
+/**
+ * @brief Options of the import and export fingerprints.
+ */
+struct FingerprintOptions {
+    OrdinalNameResolver ResolveOrdinal = ResolveKnownOrdinal; // Names of functions imported by ordinal, or nullptr.
+};
+
+namespace fingerprint {
+
+/**
+ * @brief Streams ASCII lower case of the characters into the hasher through a stack buffer.
+ */
+template<typename Hasher> void UpdateLower(Hasher& hasher, const char* string, size_t length) noexcept
+{
+    char buffer[64];
+    while (length) {
+        const auto count = length < sizeof(buffer) ? length : sizeof(buffer);
+        for (size_t cx = 0; cx < count; ++cx)
+            buffer[cx] = ToLowerAscii(string[cx]);
+
+        hasher.Update(buffer, count);
+        string += count;
+        length -= count;
+    }
+}
+
+/**
+ * @brief Streams "ord<ordinal>" into the hasher.
+ */
+template<typename Hasher> void UpdateOrdinal(Hasher& hasher, uint64_t ordinal) noexcept
+{
+    char digits[20];
+    auto position = sizeof(digits);
+    do {
+        digits[--position] = static_cast<char>('0' + ordinal % 10);
+        ordinal /= 10;
+    } while (ordinal);
+
+    hasher.Update("ord", 3);
+    hasher.Update(digits + position, sizeof(digits) - position);
+}
+
+/**
+ * @brief Returns length of the module name without the .dll, .ocx or .sys extension, compared ignoring case.
+ */
+inline size_t GetModuleStemLength(const char* moduleName) noexcept
+{
+    const auto length = strlen(moduleName);
+    if (length < 4 || moduleName[length - 4] != '.')
+        return length;
+
+    const auto extension = moduleName + length - 3;
+    for (const auto known : { "dll", "ocx", "sys" }) {
+        if (CompareNamesInsensitive(extension, known) == 0)
+            return length - 4;
+    }
+
+    return length;
+}
+
+}
+
+/**
+ * @brief Streams the imphash message into the hasher: a comma-separated list of "module.function" entries in directory
+ * order, lower case, the module name without the .dll, .ocx or .sys extension and ordinal imports named by the resolver
+ * or "ord<ordinal>". No strings are built.
+ * @tparam Hasher Hasher with Update(const void* data, size_t size), e.g. Md5 or Fnv64.
+ * @param imports Import directory.
+ * @param hasher Hasher.
+ * @param options Fingerprint options.
+ * @return Count of hashed functions.
+ */
+template<Architecture Arch, typename Hasher> size_t HashImports(const Import<Arch>& imports, Hasher& hasher, const FingerprintOptions& options = {}) noexcept
+{
+    if (!imports.IsValid())
+        return 0;
+
+    size_t count = 0;
+    for (const auto& module : imports) {
+        const auto moduleName = module.GetModuleName();
+        if (!moduleName)
+            continue;
+
+        const auto stemLength = fingerprint::GetModuleStemLength(moduleName);
+        for (const auto& function : module) {
+            const char* name = nullptr;
+            if (function.IsImportedByOrdinal()) {
+                name = options.ResolveOrdinal ? options.ResolveOrdinal(moduleName, static_cast<WORD>(function.GetFunctionOrdinal())) : nullptr;
+            } else {
+                const auto importByName = function.GetFunctionName();
+                if (!importByName)
+                    continue;
+
+                name = importByName->Name;
+            }
+
+            if (count++)
+                hasher.Update(",", 1);
+
+            fingerprint::UpdateLower(hasher, moduleName, stemLength);
+            hasher.Update(".", 1);
+            if (name)
+                fingerprint::UpdateLower(hasher, name, strlen(name));
+            else
+                fingerprint::UpdateOrdinal(hasher, function.GetFunctionOrdinal());
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Streams the export fingerprint message into the hasher: a comma-separated list of the exported names in the
+ * names table order, lower case. Functions exported by ordinal only are not named and not hashed.
+ * @tparam Hasher Hasher with Update(const void* data, size_t size), e.g. Md5 or Fnv64.
+ * @param exports Export directory.
+ * @param hasher Hasher.
+ * @return Count of hashed names.
+ */
+template<Architecture Arch, typename Hasher> size_t HashExports(const Export<Arch>& exports, Hasher& hasher) noexcept
+{
+    if (!exports.IsValid())
+        return 0;
+
+    size_t count = 0;
+    for (DWORD nameIndex = 0; nameIndex < exports.GetCountOfFunctionsNames(); ++nameIndex) {
+        const auto name = exports.GetFunctionName(nameIndex);
+        if (!name)
+            continue;
+
+        if (count++)
+            hasher.Update(",", 1);
+
+        fingerprint::UpdateLower(hasher, name, strlen(name));
+    }
+
+    return count;
+}
+
+/**
+ * @brief Computes the MD5 imphash, compatible with the common (pefile) definition, see HashImports.
+ * @param imports Import directory.
+ * @param options Fingerprint options.
+ * @return Digest, all zero if no function is imported.
+ */
+template<Architecture Arch> Md5Digest ComputeImportHash(const Import<Arch>& imports, const FingerprintOptions& options = {}) noexcept
+{
+    Md5 hasher;
+    return HashImports(imports, hasher, options) ? hasher.Final() : Md5Digest{};
+}
+
+/**
+ * @brief Computes the 64-bit FNV-1a hash of the imphash message, faster than MD5 and not compatible with it.
+ * @param imports Import directory.
+ * @param options Fingerprint options.
+ * @return Hash, or 0 if no function is imported.
+ */
+template<Architecture Arch> uint64_t ComputeImportHash64(const Import<Arch>& imports, const FingerprintOptions& options = {}) noexcept
+{
+    Fnv64 hasher;
+    return HashImports(imports, hasher, options) ? hasher.Final() : 0;
+}
+
+/**
+ * @brief Computes the MD5 hash of the export fingerprint message, see HashExports.
+ * @param exports Export directory.
+ * @return Digest, all zero if no function is exported by name.
+ */
+template<Architecture Arch> Md5Digest ComputeExportHash(const Export<Arch>& exports) noexcept
+{
+    Md5 hasher;
+    return HashExports(exports, hasher) ? hasher.Final() : Md5Digest{};
+}
+
+/**
+ * @brief Computes the 64-bit FNV-1a hash of the export fingerprint message.
+ * @param exports Export directory.
+ * @return Hash, or 0 if no function is exported by name.
+ */
+template<Architecture Arch> uint64_t ComputeExportHash64(const Export<Arch>& exports) noexcept
+{
+    Fnv64 hasher;
+    return HashExports(exports, hasher) ? hasher.Final() : 0;
+}
+
+}
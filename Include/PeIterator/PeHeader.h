@@ -1,6 +1,9 @@
 #pragma once
 
+#include "PeInstrumentation.h"
+#include "PeSectionIndex.h"
 #include "PeTypes.h"
+#include <cstring>
 
 namespace pe_iterator {
 
@@ -10,10 +13,32 @@ public:
      * @brief Initialization header.
      * @param imageBase Pointer to the image base.
      * @param imageType Image type.
+     * @param sectionIndex Optional prebuilt section index used to translate RVAs of the raw file. Must outlive the header.
      */
-    explicit Header(const BYTE* imageBase, const ImageType imageType = ImageType::kModule)
+    explicit Header(const BYTE* imageBase, const ImageType imageType = ImageType::kModule, const SectionIndex* sectionIndex = nullptr)
         : imageBase_(imageBase)
+        , imageSize_(0)
         , imageType_(imageType)
+        , sectionIndex_(sectionIndex)
+    {
+    }
+
+    /**
+     * @brief Initialization header of the bounded image.
+     *
+     * Translated RVAs and headers are checked against the image size, and every directory wrapper validates its tables
+     * once on construction, reporting not valid directory instead of reading out of the image. Iteration of the
+     * validated directory is then free of the checks.
+     * @param imageBase Pointer to the image base.
+     * @param imageSize Size of the image in bytes, the file size for the raw file or SizeOfImage for the module.
+     * @param imageType Image type.
+     * @param sectionIndex Optional prebuilt section index used to translate RVAs of the raw file. Must outlive the header.
+     */
+    Header(const BYTE* imageBase, size_t imageSize, const ImageType imageType = ImageType::kModule, const SectionIndex* sectionIndex = nullptr)
+        : imageBase_(imageBase)
+        , imageSize_(imageBase ? imageSize : 0)
+        , imageType_(imageType)
+        , sectionIndex_(sectionIndex)
     {
     }
 
@@ -53,11 +78,15 @@ public:
      */
     template<typename DirectoryDescriptor> const DirectoryDescriptor* GetDirectoryDescriptor(size_t directory) const
     {
+        if (imageSize_ && (!IsValid() || directory >= GetOptionalHeader()->NumberOfRvaAndSizes))
+            return nullptr;
+
         const auto dataDirectory = GetDataDirectory(directory);
-        if (dataDirectory->VirtualAddress && dataDirectory->Size)
-            return RvaToVA<DirectoryDescriptor>(dataDirectory->VirtualAddress);
+        if (!dataDirectory->VirtualAddress || !dataDirectory->Size)
+            return nullptr;
 
-        return nullptr;
+        const auto descriptor = RvaToVA<DirectoryDescriptor>(dataDirectory->VirtualAddress);
+        return IsRangeValid(descriptor, sizeof(DirectoryDescriptor)) ? descriptor : nullptr;
     }
 
     /**
@@ -68,28 +97,107 @@ public:
      */
     template<typename Return> Return* RvaToVA(RVA rva) const
     {
+        PE_ITERATOR_PROBE(kRvaTranslation, 1);
         if (imageType_ == ImageType::kModule)
-            return (Return*)(imageBase_ + rva);
+            return !imageSize_ || rva < imageSize_ ? (Return*)(imageBase_ + rva) : nullptr;
+
+        if (sectionIndex_ && sectionIndex_->IsValid()) {
+            const auto entry = sectionIndex_->Find(rva);
+            if (!entry)
+                return nullptr;
+
+            const auto offset = static_cast<DWORD>(rva + entry->Delta);
+            return !imageSize_ || offset < imageSize_ ? (Return*)(imageBase_ + offset) : nullptr;
+        }
 
         auto       section       = IMAGE_FIRST_SECTION(GetNtHeaders());
         const auto sectionsCount = GetFileHeader()->NumberOfSections;
         const auto fileAlignment = GetOptionalHeader()->FileAlignment;
 
         for (WORD cx = 0; cx < sectionsCount; ++cx, ++section) {
-            auto realSize       = section->SizeOfRawData + (fileAlignment - 1) & ~(fileAlignment - 1);
+            PE_ITERATOR_PROBE(kSectionScanStep, 1);
+            auto realSize       = (section->SizeOfRawData + (fileAlignment - 1)) & ~(fileAlignment - 1);
             auto virtualAddress = section->VirtualAddress;
 
-            if (rva >= virtualAddress && rva < (virtualAddress + realSize))
-                return (Return*)(imageBase_ + (rva - virtualAddress + section->PointerToRawData));
+            if (rva >= virtualAddress && rva < (virtualAddress + realSize)) {
+                const auto offset = static_cast<DWORD>(rva - virtualAddress + section->PointerToRawData);
+                return !imageSize_ || offset < imageSize_ ? (Return*)(imageBase_ + offset) : nullptr;
+            }
         }
 
         return nullptr;
     }
 
     /**
-     * @brief Return true if headers are valid.
+     * @brief Return true if headers are valid. Headers of the bounded image, including the section table, must lie within the image.
+     */
+    bool IsValid() const
+    {
+        if (imageSize_) {
+            if (imageSize_ < sizeof(DosHeader) || GetDosHeader()->e_magic != IMAGE_DOS_SIGNATURE)
+                return false;
+
+            const auto ntHeadersOffset = GetDosHeader()->e_lfanew;
+            if (ntHeadersOffset < 0 || imageSize_ < sizeof(NtHeaders<Arch>) || static_cast<size_t>(ntHeadersOffset) > imageSize_ - sizeof(NtHeaders<Arch>))
+                return false;
+
+            if (GetNtHeaders()->Signature != IMAGE_NT_SIGNATURE)
+                return false;
+
+            return IsArrayValid(IMAGE_FIRST_SECTION(GetNtHeaders()), GetFileHeader()->NumberOfSections);
+        }
+
+        return GetDosHeader()->e_magic == IMAGE_DOS_SIGNATURE && GetNtHeaders()->Signature == IMAGE_NT_SIGNATURE;
+    }
+
+    /**
+     * @brief Returns true if the range lies within the bounded image, or if the pointer is not nullptr for the unbounded one.
+     * @param pointer Pointer to the range.
+     * @param size Size of the range in bytes.
+     */
+    bool IsRangeValid(const void* pointer, size_t size) const noexcept
+    {
+        if (!pointer)
+            return false;
+
+        if (!imageSize_)
+            return true;
+
+        const auto address = reinterpret_cast<uintptr_t>(pointer);
+        const auto base    = reinterpret_cast<uintptr_t>(imageBase_);
+        return address >= base && address - base <= imageSize_ && size <= imageSize_ - (address - base);
+    }
+
+    /**
+     * @brief Returns true if the array lies within the bounded image, or if the pointer is not nullptr for the unbounded one.
+     * @tparam T Element type.
+     * @param pointer Pointer to the first element.
+     * @param count Count of elements.
      */
-    bool IsValid() const { return GetDosHeader()->e_magic == IMAGE_DOS_SIGNATURE && GetNtHeaders()->Signature == IMAGE_NT_SIGNATURE; }
+    template<typename T> bool IsArrayValid(const T* pointer, size_t count) const noexcept
+    {
+        return IsRangeValid(pointer, 0) && (!imageSize_ || count <= (imageSize_ - (reinterpret_cast<uintptr_t>(pointer) - reinterpret_cast<uintptr_t>(imageBase_))) / sizeof(T));
+    }
+
+    /**
+     * @brief Returns true if the string is terminated within the bounded image, or if the pointer is not nullptr for the unbounded one.
+     * @param string Pointer to the string.
+     */
+    bool IsStringValid(const char* string) const noexcept
+    {
+        if (!imageSize_)
+            return string != nullptr;
+
+        if (!IsRangeValid(string, 0))
+            return false;
+
+        return memchr(string, 0, imageSize_ - static_cast<size_t>(reinterpret_cast<const BYTE*>(string) - imageBase_)) != nullptr;
+    }
+
+    /**
+     * @brief Returns size of the bounded image, or 0 if the image is not bounded.
+     */
+    size_t GetImageSize() const noexcept { return imageSize_; }
 
     /**
      * @brief Returns a pointer to the current image.
@@ -108,9 +216,17 @@ public:
      */
     ImageType GetImageType() const noexcept { return imageType_; }
 
+    /**
+     * @brief Returns section index used for RVA translation, or nullptr.
+     */
+    const SectionIndex* GetSectionIndex() const noexcept { return sectionIndex_; }
+
 private:
-    const BYTE*     imageBase_;
-    const ImageType imageType_;
+    // Not const, so iterators holding a copy of the header stay assignable.
+    const BYTE*         imageBase_;
+    size_t              imageSize_;
+    ImageType           imageType_;
+    const SectionIndex* sectionIndex_;
 };
 
 }
\ No newline at end of file
@@ -9,18 +9,101 @@
 #include "PeTls.h"
 #include "PeTypes.h"
 
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 namespace pe_iterator {
 
+// Directories walked by Image::Visit, the bit of a data directory is its index.
+constexpr uint32_t kVisitExports        = 1u << ExportDirectoryIndex;
+constexpr uint32_t kVisitImports        = 1u << ImportDirectoryIndex;
+constexpr uint32_t kVisitExceptions     = 1u << ExceptionsDirectoryIndex;
+constexpr uint32_t kVisitRelocations    = 1u << BaseRelocationDirectoryIndex;
+constexpr uint32_t kVisitTls            = 1u << TlsDirectoryIndex;
+constexpr uint32_t kVisitDelayedImports = 1u << DelayImportDirectoryIndex;
+constexpr uint32_t kVisitSections       = 1u << 31;
+constexpr uint32_t kVisitAll
+    = kVisitExports | kVisitImports | kVisitExceptions | kVisitRelocations | kVisitTls | kVisitDelayedImports | kVisitSections;
+
+/**
+ * @brief Options of Image::Visit.
+ */
+struct VisitOptions {
+    uint32_t Directories = kVisitAll; // Directories to visit, combination of the kVisit flags.
+    bool     Prefetch    = false;     // Hint the OS to read the directory ranges ahead before the walk.
+};
+
+/**
+ * @brief Range of memory to prefetch.
+ */
+struct MemoryRange {
+    const void* Address;
+    size_t      Size;
+};
+
+/**
+ * @brief Hints the OS to read the ranges of the mapped file in ahead, both calls are advisory and may do nothing.
+ *
+ * Windows 8 and later take all ranges in one PrefetchVirtualMemory call, other platforms advise MADV_WILLNEED for the
+ * pages of every range.
+ * @param ranges Pointer to the ranges.
+ * @param count Count of the ranges.
+ */
+inline void PrefetchRanges(const MemoryRange* ranges, size_t count) noexcept
+{
+#if defined(_WIN32)
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+    WIN32_MEMORY_RANGE_ENTRY entries[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+    while (count) {
+        const auto chunk = count < IMAGE_NUMBEROF_DIRECTORY_ENTRIES ? count : IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+        for (size_t cx = 0; cx < chunk; ++cx)
+            entries[cx] = { const_cast<void*>(ranges[cx].Address), ranges[cx].Size };
+
+        PrefetchVirtualMemory(GetCurrentProcess(), chunk, entries, 0);
+        ranges += chunk;
+        count -= chunk;
+    }
+#else
+    (void)ranges;
+    (void)count;
+#endif
+#else
+    const auto pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    for (size_t cx = 0; cx < count; ++cx) {
+        const auto begin = reinterpret_cast<uintptr_t>(ranges[cx].Address) & ~(pageSize - 1);
+        const auto end   = reinterpret_cast<uintptr_t>(ranges[cx].Address) + ranges[cx].Size;
+        if (ranges[cx].Size)
+            madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+    }
+#endif
+}
+
 template<Architecture Arch> class Image {
 public:
     /**
      * @brief Initialization header.
      * @param imageBase Pointer to the image base.
      * @param imageType Image type.
+     * @param sectionIndex Optional prebuilt section index used to translate RVAs of the raw file. Must outlive the image.
+     */
+    explicit Image(const BYTE* imageBase, ImageType imageType = ImageType::kModule, const SectionIndex* sectionIndex = nullptr)
+        : imageBase_(imageBase)
+        , header_(imageBase, imageType, sectionIndex)
+    {
+    }
+
+    /**
+     * @brief Initialization header of the bounded image, see Header for the checks performed.
+     * @param imageBase Pointer to the image base.
+     * @param imageSize Size of the image in bytes.
+     * @param imageType Image type.
+     * @param sectionIndex Optional prebuilt section index used to translate RVAs of the raw file. Must outlive the image.
      */
-    explicit Image(const BYTE* imageBase, ImageType imageType = ImageType::kModule)
+    Image(const BYTE* imageBase, size_t imageSize, ImageType imageType = ImageType::kModule, const SectionIndex* sectionIndex = nullptr)
         : imageBase_(imageBase)
-        , header_(imageBase, imageType)
+        , header_(imageBase, imageSize, imageType, sectionIndex)
     {
     }
 
@@ -64,7 +147,101 @@ public:
      */
     Tls<Arch> GetTls() const noexcept { return Tls<Arch>(header_); }
 
+    /**
+     * @brief Walks the requested directories once, in ascending order of their offsets in the file.
+     *
+     * The directories are ordered by address, which is the file order for raw files, and every wrapper is constructed,
+     * validated and visited before the next one, so a cold mapped file is read forward instead of jumping between the
+     * directories. The sections are visited first, they follow the headers. Only the present and valid directories are
+     * visited.
+     * @tparam Visitor Callable with each of Section, Import<Arch>, DelayedImport<Arch>, Export<Arch>, Relocation<Arch>,
+     * Exception<Arch> and Tls<Arch>, e.g. a generic lambda or an overload set.
+     * @param visitor Visitor.
+     * @param options Visit options.
+     * @return Count of directories visited.
+     */
+    template<typename Visitor> size_t Visit(Visitor&& visitor, const VisitOptions& options = VisitOptions()) const
+    {
+        static constexpr size_t kDirectories[] = { ExportDirectoryIndex,      ImportDirectoryIndex, ExceptionsDirectoryIndex,
+                                                   BaseRelocationDirectoryIndex, TlsDirectoryIndex,   DelayImportDirectoryIndex };
+
+        if (!header_.IsValid())
+            return 0;
+
+        // Present directories sorted by address, at most six of them.
+        const BYTE* addresses[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+        MemoryRange ranges[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+        size_t      indices[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+        size_t      count = 0;
+        for (const auto directory : kDirectories) {
+            const auto dataDirectory = header_.GetDataDirectory(directory);
+            if (!(options.Directories & (1u << directory)) || !dataDirectory->VirtualAddress || !dataDirectory->Size)
+                continue;
+
+            const auto address = header_.template RvaToVA<BYTE>(dataDirectory->VirtualAddress);
+            if (!address)
+                continue;
+
+            size_t position = count++;
+            for (; position && addresses[position - 1] > address; --position) {
+                addresses[position] = addresses[position - 1];
+                indices[position]   = indices[position - 1];
+            }
+
+            addresses[position] = address;
+            indices[position]   = directory;
+        }
+
+        if (options.Prefetch) {
+            const auto imageEnd = header_.GetImageSize() ? imageBase_ + header_.GetImageSize() : nullptr;
+            for (size_t cx = 0; cx < count; ++cx) {
+                // Sizes of the bounded image are clamped to its end.
+                const size_t size      = header_.GetDataDirectory(indices[cx])->Size;
+                const size_t available = imageEnd ? static_cast<size_t>(imageEnd - addresses[cx]) : size;
+                ranges[cx]             = { addresses[cx], size < available ? size : available };
+            }
+
+            PrefetchRanges(ranges, count);
+        }
+
+        size_t visited = 0;
+        if (options.Directories & kVisitSections) {
+            const auto sections = GetSection();
+            if (!sections.Empty()) {
+                visitor(sections);
+                ++visited;
+            }
+        }
+
+        for (size_t cx = 0; cx < count; ++cx) {
+            switch (indices[cx]) {
+            case ExportDirectoryIndex: visited += VisitDirectory(visitor, GetExport()); break;
+            case ImportDirectoryIndex: visited += VisitDirectory(visitor, GetImport()); break;
+            case ExceptionsDirectoryIndex: visited += VisitDirectory(visitor, GetException()); break;
+            case BaseRelocationDirectoryIndex: visited += VisitDirectory(visitor, GetRelocation()); break;
+            case TlsDirectoryIndex: visited += VisitDirectory(visitor, GetTls()); break;
+            case DelayImportDirectoryIndex: visited += VisitDirectory(visitor, GetDelayedImport()); break;
+            default: break;
+            }
+        }
+
+        return visited;
+    }
+
 private:
+    /**
+     * @brief Calls the visitor with the directory if it is valid.
+     * @return 1 if visited, or 0.
+     */
+    template<typename Visitor, typename Directory> static size_t VisitDirectory(Visitor& visitor, const Directory& directory)
+    {
+        if (!directory.IsValid())
+            return 0;
+
+        visitor(directory);
+        return 1;
+    }
+
     const BYTE*        imageBase_;
     const Header<Arch> header_;
 };
@@ -0,0 +1,545 @@
+#pragma once
+
+#include "PeImage.h"
+#include "PeSectionAnalysis.h"
+#include "PeTypes.h"
+#include <algorithm>
+#include <cstring>
+
+namespace pe_iterator {
+
+/**
+ * @brief Component of the image a difference belongs to.
+ */
+enum class DiffComponent : BYTE {
+    kSection,        // Section header or section data.
+    kImportModule,   // Imported module, its functions are not reported.
+    kImportFunction, // Function imported from the module present in both images.
+    kExport,         // Exported function.
+    kRelocationBlock // Base relocation block of one page.
+};
+
+/**
+ * @brief Kind of the difference.
+ */
+enum class DiffKind : BYTE {
+    kAdded,   // Present in the new image only.
+    kRemoved, // Present in the old image only.
+    kModified // Present in both images, with different contents.
+};
+
+/**
+ * @brief Options of the image comparison.
+ */
+struct ImageDiffOptions {
+    bool Sections    = true; // Reports differences of the sections.
+    bool Imports     = true; // Reports differences of the import sets.
+    bool Exports     = true; // Reports differences of the export tables.
+    bool Relocations = true; // Reports differences of the relocation blocks.
+};
+
+/**
+ * @brief Difference between the old and the new image.
+ */
+struct ImageDifference {
+    DiffComponent        Component;
+    DiffKind             Kind;
+    const SectionHeader* OldSection; // Section of the old image, or nullptr.
+    const SectionHeader* NewSection; // Section of the new image, or nullptr.
+    const char*          Module;     // Imported module name, or nullptr.
+    const char*          Function;   // Imported or exported function name, or nullptr if by ordinal or not a function.
+    DWORD                Ordinal;    // Function ordinal if imported by ordinal or exported, or 0.
+    RVA                  OldRva;     // Exported function or relocation block page RVA of the old image, or 0.
+    RVA                  NewRva;     // Exported function or relocation block page RVA of the new image, or 0.
+};
+
+/**
+ * @brief Result of the image comparison.
+ */
+struct ImageDiffResult {
+    size_t Differences;        // Count of the reported differences.
+    size_t SkippedDirectories; // Count of the directories not walked because their RVA, size and section are unchanged.
+    bool   Complete;           // False if the headers are not valid or the arena is exhausted, the differences may be partial.
+};
+
+/**
+ * @brief Compares section headers, import sets, export tables and relocation blocks of two versions of the image.
+ *
+ * Sections are matched by name and compared by header fields and loaded bytes, the comparison stops at the first
+ * different byte. A directory is walked only if its data directory entry changed, or if the section containing it did:
+ * an unchanged section at the same RVA holds the same directory, the tables linkers emit with it included. The cost of
+ * a comparison is then about the size of the sections plus the size of the changed directories. Both images may be raw
+ * files or modules, in any combination.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class ImageDiff {
+public:
+    /**
+     * @brief Initialization constructor.
+     * @param oldImage Old version of the image, its data must outlive the comparison.
+     * @param newImage New version of the image, its data must outlive the comparison.
+     * @param options Comparison options.
+     */
+    ImageDiff(const Image<Arch>& oldImage, const Image<Arch>& newImage, const ImageDiffOptions& options = ImageDiffOptions()) noexcept
+        : old_(oldImage)
+        , new_(newImage)
+        , options_(options)
+    {
+    }
+
+    /**
+     * @brief Compares the images.
+     * @tparam Callback Callable as callback(const ImageDifference&).
+     * @param arena Arena the scratch tables are allocated from.
+     * @param callback Callback invoked for every difference, grouped by component in the order of the options.
+     * @return Comparison result.
+     */
+    template<typename Callback> ImageDiffResult Compare(Arena& arena, Callback&& callback) const
+    {
+        ImageDiffResult result{ 0, 0, false };
+        if (!old_.GetHeader().IsValid() || !new_.GetHeader().IsValid())
+            return result;
+
+        const auto report = [&](const ImageDifference& difference) {
+            ++result.Differences;
+            callback(difference);
+        };
+
+        const auto matches = MatchSections(arena);
+        if (!matches)
+            return result;
+
+        result.Complete = true;
+        if (options_.Sections)
+            ReportSections(matches, report);
+
+        if (options_.Imports) {
+            if (IsDirectoryUnchanged(ImportDirectoryIndex, matches))
+                ++result.SkippedDirectories;
+            else
+                result.Complete &= CompareImports(arena, report);
+        }
+
+        if (options_.Exports) {
+            if (IsDirectoryUnchanged(ExportDirectoryIndex, matches))
+                ++result.SkippedDirectories;
+            else
+                result.Complete &= CompareExports(arena, report);
+        }
+
+        if (options_.Relocations) {
+            if (IsDirectoryUnchanged(BaseRelocationDirectoryIndex, matches))
+                ++result.SkippedDirectories;
+            else
+                CompareRelocations(report);
+        }
+
+        return result;
+    }
+
+private:
+    /**
+     * @brief Section of the old image matched to the section of the new image.
+     */
+    struct SectionMatch {
+        const SectionHeader* Old;       // Section of the old image with the same name, or nullptr.
+        bool                 Unchanged; // True if the header fields and the loaded bytes are equal.
+    };
+
+    /**
+     * @brief Imported function key, ordered by name and then by ordinal.
+     */
+    struct ImportKey {
+        const char* Name;    // Function name, or nullptr if imported by ordinal.
+        DWORD       Ordinal; // Function ordinal if imported by ordinal.
+
+        bool operator<(const ImportKey& other) const noexcept
+        {
+            if (!Name || !other.Name)
+                return Name == other.Name ? Ordinal < other.Ordinal : !Name;
+
+            return strcmp(Name, other.Name) < 0;
+        }
+    };
+
+    /**
+     * @brief Matches every section of the new image to the first not matched section of the old image with the same name.
+     * @return Array of the matches in the order of the new sections, or nullptr if the arena is exhausted.
+     */
+    SectionMatch* MatchSections(Arena& arena) const
+    {
+        const auto oldSections = old_.GetSection();
+        const auto newSections = new_.GetSection();
+        const auto matches     = arena.Allocate<SectionMatch>(newSections.size() + 1);
+        const auto taken       = arena.Allocate<bool>(oldSections.size() + 1);
+        if (!matches || !taken)
+            return nullptr;
+
+        std::fill(taken, taken + oldSections.size(), false);
+
+        const SectionAnalysisOptions options{ SectionExtent::kVirtual, false, false };
+        const SectionAnalyzer<Arch>  oldAnalyzer(old_, options), newAnalyzer(new_, options);
+        for (size_t index = 0; index < newSections.size(); ++index) {
+            const auto& section = newSections.begin()[index];
+            matches[index]      = { nullptr, false };
+            for (size_t candidate = 0; candidate < oldSections.size(); ++candidate) {
+                const auto& oldSection = oldSections.begin()[candidate];
+                if (taken[candidate] || memcmp(oldSection.Name, section.Name, sizeof(section.Name)) != 0)
+                    continue;
+
+                taken[candidate] = true;
+                matches[index]   = { &oldSection, IsSectionUnchanged(oldAnalyzer, oldSection, newAnalyzer, section) };
+                break;
+            }
+        }
+
+        return matches;
+    }
+
+    /**
+     * @brief Returns true if the section header fields and the loaded bytes are equal.
+     */
+    static bool IsSectionUnchanged(const SectionAnalyzer<Arch>& oldAnalyzer, const SectionHeader& oldSection, const SectionAnalyzer<Arch>& newAnalyzer,
+                                   const SectionHeader& newSection) noexcept
+    {
+        if (oldSection.VirtualAddress != newSection.VirtualAddress || oldSection.Misc.VirtualSize != newSection.Misc.VirtualSize
+            || oldSection.SizeOfRawData != newSection.SizeOfRawData || oldSection.Characteristics != newSection.Characteristics)
+            return false;
+
+        const auto oldRange = oldAnalyzer.GetRange(oldSection);
+        const auto newRange = newAnalyzer.GetRange(newSection);
+        if (oldRange.Size + oldRange.ZeroFill != newRange.Size + newRange.ZeroFill)
+            return false;
+
+        // Raw files and modules of the same image differ in the part of the section read from the image, the rest is zeros.
+        const auto common = std::min(oldRange.Size, newRange.Size);
+        if (common && memcmp(oldRange.Data, newRange.Data, common) != 0)
+            return false;
+
+        const auto& longer = oldRange.Size > newRange.Size ? oldRange : newRange;
+        for (auto cx = common; cx < longer.Size; ++cx) {
+            if (longer.Data[cx])
+                return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Reports sections added, removed and modified.
+     */
+    template<typename Report> void ReportSections(const SectionMatch* matches, Report& report) const
+    {
+        const auto oldSections = old_.GetSection();
+        const auto newSections = new_.GetSection();
+        for (size_t index = 0; index < newSections.size(); ++index) {
+            const auto& match = matches[index];
+            if (!match.Old)
+                report({ DiffComponent::kSection, DiffKind::kAdded, nullptr, &newSections.begin()[index], nullptr, nullptr, 0, 0, 0 });
+            else if (!match.Unchanged)
+                report({ DiffComponent::kSection, DiffKind::kModified, match.Old, &newSections.begin()[index], nullptr, nullptr, 0, 0, 0 });
+        }
+
+        for (const auto& section : oldSections) {
+            const auto matched = std::any_of(matches, matches + newSections.size(), [&](const SectionMatch& match) { return match.Old == &section; });
+            if (!matched)
+                report({ DiffComponent::kSection, DiffKind::kRemoved, &section, nullptr, nullptr, nullptr, 0, 0, 0 });
+        }
+    }
+
+    /**
+     * @brief Returns true if the data directory entry is equal in both images and the section containing it is unchanged.
+     */
+    bool IsDirectoryUnchanged(size_t directory, const SectionMatch* matches) const
+    {
+        const auto oldDirectory = old_.GetHeader().GetDataDirectory(directory);
+        const auto newDirectory = new_.GetHeader().GetDataDirectory(directory);
+        if (oldDirectory->VirtualAddress != newDirectory->VirtualAddress || oldDirectory->Size != newDirectory->Size)
+            return false;
+
+        if (!newDirectory->VirtualAddress)
+            return true;
+
+        const auto newSections = new_.GetSection();
+        for (size_t index = 0; index < newSections.size(); ++index) {
+            const auto& section = newSections.begin()[index];
+            const auto  size    = std::max(section.Misc.VirtualSize, section.SizeOfRawData);
+            if (newDirectory->VirtualAddress >= section.VirtualAddress && newDirectory->VirtualAddress - section.VirtualAddress < size)
+                return matches[index].Unchanged;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Reports imported modules added and removed, and functions added and removed from the modules of both images.
+     * @return False if the arena is exhausted.
+     */
+    template<typename Report> bool CompareImports(Arena& arena, Report& report) const
+    {
+        const auto oldImports = old_.GetImport();
+        const auto newImports = new_.GetImport();
+
+        // One pair of key arrays sized for the largest module serves all modules.
+        size_t capacity = 0;
+        for (const auto* imports : { &oldImports, &newImports }) {
+            if (!imports->IsValid())
+                continue;
+
+            for (const auto& module : *imports) {
+                size_t count = 0;
+                for (auto function = module.begin(); function != module.end(); ++function)
+                    ++count;
+                capacity = std::max(capacity, count);
+            }
+        }
+
+        const auto oldKeys = arena.Allocate<ImportKey>(capacity + 1);
+        const auto newKeys = arena.Allocate<ImportKey>(capacity + 1);
+        if (!oldKeys || !newKeys)
+            return false;
+
+        if (newImports.IsValid()) {
+            for (const auto& module : newImports) {
+                const auto oldModule = FindModule(oldImports, module.GetModuleName());
+                if (!oldModule.IsValid()) {
+                    report({ DiffComponent::kImportModule, DiffKind::kAdded, nullptr, nullptr, module.GetModuleName(), nullptr, 0, 0, 0 });
+                    continue;
+                }
+
+                const auto oldCount = CollectKeys(oldModule, oldKeys);
+                const auto newCount = CollectKeys(module, newKeys);
+                MergeKeys(oldKeys, oldCount, newKeys, newCount, [&](DiffKind kind, const ImportKey& key) {
+                    report({ DiffComponent::kImportFunction, kind, nullptr, nullptr, module.GetModuleName(), key.Name, key.Ordinal, 0, 0 });
+                });
+            }
+        }
+
+        if (oldImports.IsValid()) {
+            for (const auto& module : oldImports) {
+                if (!FindModule(newImports, module.GetModuleName()).IsValid())
+                    report({ DiffComponent::kImportModule, DiffKind::kRemoved, nullptr, nullptr, module.GetModuleName(), nullptr, 0, 0, 0 });
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Searching imported module by name ignoring case.
+     * @return Module iterator, not valid if the module is not imported.
+     */
+    static typename Import<Arch>::ModuleIterator FindModule(const Import<Arch>& imports, const char* name)
+    {
+        if (imports.IsValid() && name) {
+            for (const auto& module : imports) {
+                if (CompareNamesInsensitive(module.GetModuleName(), name) == 0)
+                    return module;
+            }
+        }
+
+        return imports.GetModule(nullptr);
+    }
+
+    /**
+     * @brief Stores keys of the module functions sorted.
+     * @return Count of keys.
+     */
+    static size_t CollectKeys(const typename Import<Arch>::ModuleIterator& module, ImportKey* keys)
+    {
+        size_t count = 0;
+        for (const auto& function : module) {
+            const auto name = function.GetFunctionName();
+            keys[count++]   = { name ? name->Name : nullptr, static_cast<DWORD>(function.GetFunctionOrdinal()) };
+        }
+
+        std::sort(keys, keys + count);
+        return count;
+    }
+
+    /**
+     * @brief Walks both sorted key arrays at once, invoking emit(kind, key) for the keys present in one of them only.
+     */
+    template<typename Emit> static void MergeKeys(const ImportKey* oldKeys, size_t oldCount, const ImportKey* newKeys, size_t newCount, const Emit& emit)
+    {
+        size_t oldIndex = 0, newIndex = 0;
+        while (oldIndex < oldCount || newIndex < newCount) {
+            if (newIndex == newCount || (oldIndex < oldCount && oldKeys[oldIndex] < newKeys[newIndex]))
+                emit(DiffKind::kRemoved, oldKeys[oldIndex++]);
+            else if (oldIndex == oldCount || newKeys[newIndex] < oldKeys[oldIndex])
+                emit(DiffKind::kAdded, newKeys[newIndex++]);
+            else
+                ++oldIndex, ++newIndex;
+        }
+    }
+
+    /**
+     * @brief Reports exported functions added, removed and modified: named ones by name, the rest by ordinal.
+     * @return False if the arena is exhausted.
+     */
+    template<typename Report> bool CompareExports(Arena& arena, Report& report) const
+    {
+        const auto oldExports = old_.GetExport();
+        const auto newExports = new_.GetExport();
+
+        // Function indices reached through the names tables, the others are compared by ordinal.
+        const auto oldNamed = arena.Allocate<bool>(oldExports.GetCountFunctions() + 1);
+        const auto newNamed = arena.Allocate<bool>(newExports.GetCountFunctions() + 1);
+        if (!oldNamed || !newNamed)
+            return false;
+
+        std::fill(oldNamed, oldNamed + oldExports.GetCountFunctions(), false);
+        std::fill(newNamed, newNamed + newExports.GetCountFunctions(), false);
+
+        // Names tables are sorted, as the loader searches them binary.
+        const auto oldNames = oldExports.GetCountOfFunctionsNames(), newNames = newExports.GetCountOfFunctionsNames();
+        DWORD      oldIndex = 0, newIndex = 0;
+        while (oldIndex < oldNames || newIndex < newNames) {
+            const auto oldName = oldIndex < oldNames ? oldExports.GetFunctionName(oldIndex) : nullptr;
+            const auto newName = newIndex < newNames ? newExports.GetFunctionName(newIndex) : nullptr;
+
+            // Names which do not translate are skipped, their functions are then compared by ordinal.
+            if (oldIndex < oldNames && !oldName) {
+                ++oldIndex;
+                continue;
+            }
+            if (newIndex < newNames && !newName) {
+                ++newIndex;
+                continue;
+            }
+
+            const auto order = newIndex == newNames ? -1 : oldIndex == oldNames ? 1 : strcmp(oldName, newName);
+
+            const auto oldFunction = order <= 0 ? MarkNamed(oldExports, oldIndex++, oldNamed) : kNoFunction;
+            const auto newFunction = order >= 0 ? MarkNamed(newExports, newIndex++, newNamed) : kNoFunction;
+            ReportExport(oldExports, oldFunction, newExports, newFunction, order > 0 ? newName : oldName, report);
+        }
+
+        // Each functions table is swept by index, so the work is bounded by the tables rather than by their bases.
+        for (DWORD oldFunction = 0; oldFunction < oldExports.GetCountFunctions(); ++oldFunction) {
+            if (GetUnnamed(oldExports, oldFunction, oldNamed) == kNoFunction)
+                continue;
+
+            const auto newFunction = GetUnnamed(newExports, MapFunction(oldExports, oldFunction, newExports), newNamed);
+            ReportExport(oldExports, oldFunction, newExports, newFunction, nullptr, report);
+        }
+
+        for (DWORD newFunction = 0; newFunction < newExports.GetCountFunctions(); ++newFunction) {
+            if (GetUnnamed(newExports, newFunction, newNamed) != kNoFunction
+                && GetUnnamed(oldExports, MapFunction(newExports, newFunction, oldExports), oldNamed) == kNoFunction)
+                ReportExport(oldExports, kNoFunction, newExports, newFunction, nullptr, report);
+        }
+
+        return true;
+    }
+
+    // Function index of the export not present in the image.
+    static constexpr DWORD kNoFunction = 0xFFFFFFFF;
+
+    /**
+     * @brief Marks the function of the name as named.
+     * @return Function index, or kNoFunction if it is out of the functions table.
+     */
+    static DWORD MarkNamed(const Export<Arch>& exports, DWORD nameIndex, bool* named) noexcept
+    {
+        const auto functionIndex = exports.GetFunctionIndex(nameIndex);
+        if (functionIndex >= exports.GetCountFunctions())
+            return kNoFunction;
+
+        named[functionIndex] = true;
+        return functionIndex;
+    }
+
+    /**
+     * @brief Returns the function index if it is exported and not named, or kNoFunction.
+     */
+    static DWORD GetUnnamed(const Export<Arch>& exports, DWORD functionIndex, const bool* named) noexcept
+    {
+        return functionIndex < exports.GetCountFunctions() && !named[functionIndex] && exports.GetFunctionRva(functionIndex) ? functionIndex : kNoFunction;
+    }
+
+    /**
+     * @brief Returns index of the function with the same ordinal in the other functions table, or kNoFunction.
+     */
+    static DWORD MapFunction(const Export<Arch>& exports, DWORD functionIndex, const Export<Arch>& other) noexcept
+    {
+        if (!other.IsValid())
+            return kNoFunction;
+
+        const auto ordinal = static_cast<ULONGLONG>(exports.GetDirectoryDescriptor()->Base) + functionIndex;
+        const auto base    = other.GetDirectoryDescriptor()->Base;
+        return ordinal >= base && ordinal - base < other.GetCountFunctions() ? static_cast<DWORD>(ordinal - base) : kNoFunction;
+    }
+
+    /**
+     * @brief Reports the export present in one image only, or modified: its ordinal, RVA or forwarder changed.
+     */
+    template<typename Report>
+    static void ReportExport(const Export<Arch>& oldExports, DWORD oldFunction, const Export<Arch>& newExports, DWORD newFunction, const char* name, Report& report)
+    {
+        const auto oldRva     = oldFunction != kNoFunction ? oldExports.GetFunctionRva(oldFunction) : 0;
+        const auto newRva     = newFunction != kNoFunction ? newExports.GetFunctionRva(newFunction) : 0;
+        const auto oldOrdinal = oldFunction != kNoFunction ? oldExports.GetDirectoryDescriptor()->Base + oldFunction : 0;
+        const auto newOrdinal = newFunction != kNoFunction ? newExports.GetDirectoryDescriptor()->Base + newFunction : 0;
+
+        if (oldFunction == kNoFunction && newFunction == kNoFunction)
+            return;
+
+        auto kind = DiffKind::kModified;
+        if (oldFunction == kNoFunction)
+            kind = DiffKind::kAdded;
+        else if (newFunction == kNoFunction)
+            kind = DiffKind::kRemoved;
+        else if (oldOrdinal == newOrdinal && oldExports.IsForwarded(oldRva) == newExports.IsForwarded(newRva)) {
+            // Forwarders are compared by the forwarded name, their strings move with the rest of the section.
+            const auto unchanged = oldExports.IsForwarded(oldRva) ? strcmp(oldExports.GetFunctionByIndex(oldFunction).GetForwardedName(),
+                                                                           newExports.GetFunctionByIndex(newFunction).GetForwardedName()) == 0
+                                                                  : oldRva == newRva;
+            if (unchanged)
+                return;
+        }
+
+        report({ DiffComponent::kExport, kind, nullptr, nullptr, nullptr, name, newOrdinal ? newOrdinal : oldOrdinal, oldRva, newRva });
+    }
+
+    /**
+     * @brief Reports relocation blocks added, removed and modified, matched by the page RVA.
+     *
+     * Linkers emit blocks in the ascending page order, so both directories are walked at once.
+     */
+    template<typename Report> void CompareRelocations(Report& report) const
+    {
+        const auto oldRelocations = old_.GetRelocation();
+        const auto newRelocations = new_.GetRelocation();
+
+        auto oldBlock = oldRelocations.begin();
+        auto newBlock = newRelocations.begin();
+
+        const auto oldValid = [&] { return oldBlock != oldRelocations.end(); };
+        const auto newValid = [&] { return newBlock != newRelocations.end(); };
+        while (oldValid() || newValid()) {
+            const auto oldPage = oldValid() ? oldBlock.GetBlock()->VirtualAddress : 0;
+            const auto newPage = newValid() ? newBlock.GetBlock()->VirtualAddress : 0;
+
+            if (!newValid() || (oldValid() && oldPage < newPage)) {
+                report({ DiffComponent::kRelocationBlock, DiffKind::kRemoved, nullptr, nullptr, nullptr, nullptr, 0, oldPage, 0 });
+                ++oldBlock;
+            } else if (!oldValid() || newPage < oldPage) {
+                report({ DiffComponent::kRelocationBlock, DiffKind::kAdded, nullptr, nullptr, nullptr, nullptr, 0, 0, newPage });
+                ++newBlock;
+            } else {
+                const auto size = oldBlock.GetBlock()->SizeOfBlock;
+                if (size != newBlock.GetBlock()->SizeOfBlock || memcmp(oldBlock.GetBlock(), newBlock.GetBlock(), size) != 0)
+                    report({ DiffComponent::kRelocationBlock, DiffKind::kModified, nullptr, nullptr, nullptr, nullptr, 0, oldPage, newPage });
+                ++oldBlock;
+                ++newBlock;
+            }
+        }
+    }
+
+    const Image<Arch>      old_;
+    const Image<Arch>      new_;
+    const ImageDiffOptions options_;
+};
+
+}
@@ -1,121 +1,151 @@
 #pragma once
 
 #include "PeHeader.h"
+#include "PeInstrumentation.h"
 #include "PeTypes.h"
+#include <type_traits>
 
 namespace pe_iterator {
 
 /**
- * @brief A wrapper class above the imports directory that provides a module iterator.
+ * @brief Returns true if the null-terminated lookup table, its names and the address table of the same length lie within the bounded image.
  * @tparam Arch Image architecture.
+ * @param header Image header.
+ * @param lookupTable Pointer to the ILT.
+ * @param addressTable Pointer to the IAT.
  */
-template<Architecture Arch> class Import {
-public:
-    class ModuleIterator;
+template<Architecture Arch>
+bool ValidateThunks(const Header<Arch>& header, const ImportLookupTable<Arch>* lookupTable, const ImportAddressTable<Arch>* addressTable) noexcept
+{
+    for (size_t cx = 0;; ++cx) {
+        if (!header.IsArrayValid(lookupTable, cx + 1))
+            return false;
+
+        const auto& thunk = lookupTable[cx];
+        if (!thunk.u1.ForwarderString)
+            return header.IsArrayValid(addressTable, cx);
+
+        if (!IsSnapByOrdinal(&thunk)) {
+            const auto name = header.template RvaToVA<const ImportByName>(static_cast<RVA>(thunk.u1.AddressOfData));
+            if (!header.IsRangeValid(name, sizeof(name->Hint)) || !header.IsStringValid(name->Name))
+                return false;
+        }
+    }
+}
 
+/**
+ * @brief Iterator over the functions imported from one module, shared by the imports and the delayed imports.
+ *
+ * The state is a copy of the header, the table pointers and the index: trivially copyable and independent of the import
+ * wrapper, so iterators can be stored and handed to other threads while the image data exists.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class ImportFunctionIterator {
+public:
     /**
-     * @brief Wrapper class over the module imported functions.
+     * @brief Initialization constructor.
+     * @param header Image header.
+     * @param lookupTable Pointer to the ILT of the module.
+     * @param addressTable Pointer to the IAT of the module.
+     * @param index The base index of the functions from which the iteration will begin. By default, 0.
      */
-    class FunctionIterator {
-    public:
-        /**
-         * @brief Initialization constructor.
-         * @param header Image header.
-         * @param moduleIterator Module iterator.
-         * @param index The base index of the relocations from which the iteration will begin. By default, 0.
-         */
-        FunctionIterator(const Header<Arch>& header, const ModuleIterator& moduleIterator, size_t index = 0)
-            : header_(header)
-            , moduleIterator_(moduleIterator)
-            , index_(index)
-        {
-        }
-
-        /**
-         * @brief Returns current index.
-         */
-        size_t GetIndex() const noexcept { return index_; }
+    ImportFunctionIterator(const Header<Arch>& header, const ImportLookupTable<Arch>* lookupTable, const ImportAddressTable<Arch>* addressTable,
+                           size_t index = 0) noexcept
+        : header_(header)
+        , lookupTable_(lookupTable)
+        , addressTable_(addressTable)
+        , index_(index)
+    {
+    }
 
-        /**
-         * @brief Returns pointer to IAT of the function.
-         */
-        const ImportAddressTable<Arch>* GetImportAddressTable() const { return &moduleIterator_.GetImportAddressTable()[index_]; }
+    /**
+     * @brief Returns current index.
+     */
+    size_t GetIndex() const noexcept { return index_; }
 
-        /**
-         * @brief Returns pointer to ILT of the function.
-         */
-        const ImportLookupTable<Arch>* GetImportLookupTable() const { return &moduleIterator_.GetImportLookupTable()[index_]; }
+    /**
+     * @brief Returns pointer to IAT of the function.
+     */
+    const ImportAddressTable<Arch>* GetImportAddressTable() const noexcept { return &addressTable_[index_]; }
 
-        /**
-         * @brief Returns true if current function imported by ordinal.
-         */
-        bool IsImportedByOrdinal() const { return IMAGE_SNAP_BY_ORDINAL(GetImportLookupTable()->u1.Ordinal); }
+    /**
+     * @brief Returns pointer to ILT of the function.
+     */
+    const ImportLookupTable<Arch>* GetImportLookupTable() const noexcept { return &lookupTable_[index_]; }
 
-        /**
-         * @brief Returns a pointer to the IMAGE_IMPORT_BY_NAME structure if the function is exported by name, or nullptr.
-         */
-        const ImportByName* GetFunctionName() const
-        {
-            if (!IsImportedByOrdinal())
-                return header_.RvaToVA<ImportByName>(GetImportLookupTable()->u1.AddressOfData);
+    /**
+     * @brief Returns true if current function imported by ordinal.
+     */
+    bool IsImportedByOrdinal() const noexcept { return IsSnapByOrdinal(GetImportLookupTable()); }
 
-            return nullptr;
-        }
+    /**
+     * @brief Returns a pointer to the IMAGE_IMPORT_BY_NAME structure if the function is exported by name, or nullptr.
+     */
+    const ImportByName* GetFunctionName() const
+    {
+        return IsImportedByOrdinal() ? nullptr : header_.template RvaToVA<ImportByName>(static_cast<RVA>(GetImportLookupTable()->u1.AddressOfData));
+    }
 
-        /**
-         * @brief Returns function ordinal if the function is exported by ordinal, or 0.
-         */
-        uint64_t GetFunctionOrdinal() const
-        {
-            if (!IsImportedByOrdinal())
-                return GetImportLookupTable()->u1.AddressOfData;
+    /**
+     * @brief Returns function ordinal if the function is exported by ordinal, or 0.
+     */
+    uint64_t GetFunctionOrdinal() const noexcept { return IsImportedByOrdinal() ? GetImportLookupTable()->u1.Ordinal & 0xFFFF : 0; }
 
-            return 0;
-        }
+    /**
+     * @brief Returns true if function are valid.
+     */
+    bool IsValid() const noexcept { return lookupTable_ && lookupTable_[index_].u1.ForwarderString; }
 
-        /**
-         * @brief Returns true if function are valid.
-         */
-        bool IsValid() const noexcept { return GetImportLookupTable()->u1.ForwarderString; }
+    ImportFunctionIterator& operator++() noexcept
+    {
+        PE_ITERATOR_PROBE(kImportFunctionVisited, 1);
+        ++index_;
+        return *this;
+    }
 
-        FunctionIterator& operator++()
-        {
-            ++index_;
-            return *this;
-        }
+    ImportFunctionIterator operator++(int) noexcept
+    {
+        const auto prev = *this;
+        operator++();
+        return prev;
+    }
 
-        FunctionIterator operator++(int)
-        {
-            auto prev = *this;
-            ++index_;
-            return prev;
-        }
+    bool operator==(const ImportFunctionIterator& other) const noexcept { return index_ == other.index_; }
+    bool operator!=(const ImportFunctionIterator& other) const noexcept { return index_ != other.index_; }
+    bool operator==(IteratorEnd) const noexcept { return !IsValid(); }
+    bool operator!=(IteratorEnd) const noexcept { return IsValid(); }
 
-        bool operator==(const FunctionIterator& entry) const noexcept { return GetIndex() == entry.GetIndex(); }
-        bool operator!=(const FunctionIterator& entry) const { return GetIndex() != entry.GetIndex(); }
-        bool operator==(IteratorEnd) const { return IsValid(); }
-        bool operator!=(IteratorEnd) const { return IsValid(); }
+    const ImportFunctionIterator& operator*() const noexcept { return *this; }
+    ImportFunctionIterator&       operator*() noexcept { return *this; }
 
-        const FunctionIterator& operator*() const { return *this; }
-        FunctionIterator&       operator*() { return *this; }
+private:
+    Header<Arch>                    header_;
+    const ImportLookupTable<Arch>*  lookupTable_;
+    const ImportAddressTable<Arch>* addressTable_;
+    size_t                          index_;
+};
 
-    private:
-        const Header<Arch>&   header_;
-        const ModuleIterator& moduleIterator_;
-        size_t                index_;
-    };
+/**
+ * @brief A wrapper class above the imports directory that provides a module iterator.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class Import {
+public:
+    using FunctionIterator = ImportFunctionIterator<Arch>;
 
     /**
      * @brief A wrapper class over the imported modules that provides a function iterator.
+     *
+     * The state is a copy of the header and the descriptor pointer, so iterators do not refer to the wrapper.
      */
     class ModuleIterator {
     public:
         /**
          * @bruef Initialization constructor.
          * @param header Image header.
-         * @param directoryDescriptor A pointer to the beginning import directory descriptor.s
+         * @param directoryDescriptor A pointer to the beginning import directory descriptor.
          */
-        ModuleIterator(const Header<Arch>& header, const ImportDirectoryDescriptor* directoryDescriptor)
+        ModuleIterator(const Header<Arch>& header, const ImportDirectoryDescriptor* directoryDescriptor) noexcept
             : header_(header)
             , directoryDescriptor_(directoryDescriptor) {};
 
@@ -127,19 +157,19 @@ public:
         /**
          * @brief Returns pointer to module name string.
          */
-        const char* GetModuleName() const { return header_.RvaToVA<char>(directoryDescriptor_->Name); }
+        const char* GetModuleName() const { return header_.template RvaToVA<char>(directoryDescriptor_->Name); }
 
         /**
          * @brief Returns pointer to the current IAT.
          */
-        const ImportAddressTable<Arch>* GetImportAddressTable() const { return header_.RvaToVA<ImportAddressTable<Arch>>(directoryDescriptor_->FirstThunk); }
+        const ImportAddressTable<Arch>* GetImportAddressTable() const { return header_.template RvaToVA<ImportAddressTable<Arch>>(directoryDescriptor_->FirstThunk); }
 
         /**
          * @brief Returns pointer to the current ILT.
          */
         const ImportLookupTable<Arch>* GetImportLookupTable() const
         {
-            return header_.RvaToVA<ImportLookupTable<Arch>>(directoryDescriptor_->OriginalFirstThunk);
+            return header_.template RvaToVA<ImportLookupTable<Arch>>(directoryDescriptor_->OriginalFirstThunk);
         }
 
         /**
@@ -150,7 +180,7 @@ public:
         /**
          * @brief  Returns an iterator pointing to the beginning of functions.
          */
-        FunctionIterator begin() const noexcept { return { header_, *this }; }
+        FunctionIterator begin() const noexcept { return FunctionIterator(header_, GetImportLookupTable(), GetImportAddressTable()); }
 
         /**
          * @brief  Returns an iterator pointing to the end of functions.
@@ -159,6 +189,7 @@ public:
 
         ModuleIterator& operator++()
         {
+            PE_ITERATOR_PROBE(kImportModuleVisited, 1);
             ++directoryDescriptor_;
             return *this;
         }
@@ -171,15 +202,15 @@ public:
         }
 
         bool operator==(const ModuleIterator& other) const noexcept { return directoryDescriptor_ == other.directoryDescriptor_; }
-        bool operator==(const IteratorEnd) const { return IsValid(); }
+        bool operator==(const IteratorEnd) const { return !IsValid(); }
         bool operator!=(const ModuleIterator& other) const noexcept { return directoryDescriptor_ != other.directoryDescriptor_; }
-        bool operator!=(const IteratorEnd) const { return !IsValid(); }
+        bool operator!=(const IteratorEnd) const { return IsValid(); }
 
         const ModuleIterator& operator*() const { return *this; }
         ModuleIterator&       operator*() { return *this; }
 
     private:
-        const Header<Arch>&              header_;
+        Header<Arch>                     header_;
         const ImportDirectoryDescriptor* directoryDescriptor_;
     };
 
@@ -189,7 +220,7 @@ public:
      */
     explicit Import(const Header<Arch>& header)
         : header_(header)
-        , directoryDescriptor_(header.GetDirectoryDescriptor<ImportDirectoryDescriptor>(ImportDirectoryIndex))
+        , directoryDescriptor_(Validate(header, header.template GetDirectoryDescriptor<ImportDirectoryDescriptor>(ImportDirectoryIndex)))
     {
     }
 
@@ -208,113 +239,67 @@ public:
      */
     IteratorEnd end() const noexcept { return {}; }
 
-private:
-    const Header<Arch>&              header_;
-    const ImportDirectoryDescriptor* directoryDescriptor_;
-};
-
-/**
- * @brief A wrapper class over a catalog of pending imports which provides a module iterator.
- * @tparam Arch Image architecture.
- */
-template<Architecture Arch> class DelayedImport {
-public:
-    class ModuleIterator;
-
     /**
-     * @brief Wrapper class over the module imported functions.
+     * @brief Returns module iterator of the descriptor.
+     * @param directoryDescriptor Pointer to the descriptor of the directory, or nullptr for the not valid iterator.
      */
-    class FunctionIterator {
-    public:
-        /**
-         * @brief Initialization constructor.
-         * @param header Image header.
-         * @param moduleIterator Module iterator.
-         * @param index The base index of the relocations from which the iteration will begin. By default, 0.
-         */
-        FunctionIterator(const Header<Arch>& header, const ModuleIterator& moduleIterator, size_t index = 0)
-            : header_(header)
-            , moduleIterator_(moduleIterator)
-            , index_(index)
-        {
-        }
-
-        /**
-         * @brief Returns current index.
-         */
-        size_t GetIndex() const noexcept { return index_; }
-
-        /**
-         * @brief Returns pointer to IAT of the function.
-         */
-        const ImportAddressTable<Arch>* GetImportAddressTable() const { return &moduleIterator_.GetImportAddressTable()[index_]; }
-
-        /**
-         * @brief Returns pointer to ILT of the function.
-         */
-        const ImportLookupTable<Arch>* GetImportLookupTable() const { return &moduleIterator_.GetImportLookupTable()[index_]; }
-
-        /**
-         * @brief Returns true if current function imported by ordinal.
-         */
-        bool IsImportedByOrdinal() const { return IMAGE_SNAP_BY_ORDINAL(GetImportLookupTable()->u1.Ordinal); }
+    ModuleIterator GetModule(const ImportDirectoryDescriptor* directoryDescriptor) const noexcept { return ModuleIterator(header_, directoryDescriptor); }
 
-        /**
-         * @brief Returns a pointer to the IMAGE_IMPORT_BY_NAME structure if the function is exported by name, or nullptr.
-         */
-        const ImportByName* GetFunctionName() const
-        {
-            return IsImportedByOrdinal() ? nullptr : header_.RvaToVA<ImportByName>(GetImportLookupTable()->u1.AddressOfData);
-        }
-
-        /**
-         * @brief Returns function ordinal if the function is exported by ordinal, or 0.
-         */
-        uint64_t GetFunctionOrdinal() const { return IsImportedByOrdinal() ? 0 : GetImportLookupTable()->u1.AddressOfData; }
+private:
+    /**
+     * @brief Validates descriptors, names and thunks of the bounded image, unbounded images are not checked.
+     * @param header Image header.
+     * @param directoryDescriptor Pointer to the first import directory descriptor.
+     * @return The descriptor if imports are valid, or nullptr.
+     */
+    static const ImportDirectoryDescriptor* Validate(const Header<Arch>& header, const ImportDirectoryDescriptor* directoryDescriptor) noexcept
+    {
+        if (!directoryDescriptor || !header.GetImageSize())
+            return directoryDescriptor;
 
-        /**
-         * @brief Returns true if function are valid.
-         */
-        bool IsValid() const noexcept { return GetImportLookupTable()->u1.ForwarderString; }
+        for (auto descriptor = directoryDescriptor;; ++descriptor) {
+            if (!header.IsArrayValid(descriptor, 1))
+                return nullptr;
 
-        FunctionIterator& operator++()
-        {
-            ++index_;
-            return *this;
-        }
+            if (!descriptor->Characteristics)
+                return directoryDescriptor;
 
-        FunctionIterator operator++(int)
-        {
-            const auto prev = *this;
-            operator++();
-            return prev;
+            if (!header.IsStringValid(header.template RvaToVA<const char>(descriptor->Name))
+                || !ValidateThunks(header, header.template RvaToVA<const ImportLookupTable<Arch>>(descriptor->OriginalFirstThunk),
+                                   header.template RvaToVA<const ImportAddressTable<Arch>>(descriptor->FirstThunk)))
+                return nullptr;
         }
+    }
 
-        bool operator==(const FunctionIterator& entry) const noexcept { return GetIndex() == entry.GetIndex(); }
-        bool operator!=(const FunctionIterator& entry) const { return GetIndex() != entry.GetIndex(); }
-        bool operator==(IteratorEnd) const { return IsValid(); }
-        bool operator!=(IteratorEnd) const { return IsValid(); }
+    const Header<Arch>               header_;
+    const ImportDirectoryDescriptor* directoryDescriptor_;
 
-        const FunctionIterator& operator*() const { return *this; }
-        FunctionIterator&       operator*() { return *this; }
+    static_assert(std::is_trivially_copyable<FunctionIterator>::value && std::is_trivially_copyable<ModuleIterator>::value, "Iterators are trivially copyable");
+    static_assert(sizeof(FunctionIterator) == sizeof(Header<Arch>) + 3 * sizeof(void*) && sizeof(ModuleIterator) == sizeof(Header<Arch>) + sizeof(void*),
+                  "Iterators hold the header copy and their position only");
+};
 
-    private:
-        const Header<Arch>&   header_;
-        const ModuleIterator& moduleIterator_;
-        size_t                index_;
-    };
+/**
+ * @brief A wrapper class over a catalog of pending imports which provides a module iterator.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class DelayedImport {
+public:
+    using FunctionIterator = ImportFunctionIterator<Arch>;
 
     /**
      * @brief A wrapper class over the imported modules that provides a function iterator.
+     *
+     * The state is a copy of the header and the descriptor pointer, so iterators do not refer to the wrapper.
      */
     class ModuleIterator {
     public:
         /**
          * @bruef Initialization constructor.
          * @param header Image header.
-         * @param directoryDescriptor A pointer to the beginning import directory descriptor.s
+         * @param directoryDescriptor A pointer to the beginning import directory descriptor.
          */
-        ModuleIterator(const Header<Arch>& header, const DelayImportDirectoryDescriptor* directoryDescriptor)
+        ModuleIterator(const Header<Arch>& header, const DelayImportDirectoryDescriptor* directoryDescriptor) noexcept
             : header_(header)
             , directoryDescriptor_(directoryDescriptor) {};
 
@@ -326,14 +311,14 @@ public:
         /**
          * @brief Returns pointer to module name string.
          */
-        const char* GetModuleName() const { return header_.RvaToVA<char>(directoryDescriptor_->DllNameRVA); }
+        const char* GetModuleName() const { return header_.template RvaToVA<char>(directoryDescriptor_->DllNameRVA); }
 
         /**
          * @brief Returns pointer to IAT.
          */
         const ImportAddressTable<Arch>* GetImportAddressTable() const
         {
-            return header_.RvaToVA<ImportAddressTable<Arch>>(directoryDescriptor_->ImportAddressTableRVA);
+            return header_.template RvaToVA<ImportAddressTable<Arch>>(directoryDescriptor_->ImportAddressTableRVA);
         }
 
         /**
@@ -341,7 +326,7 @@ public:
          */
         const ImportLookupTable<Arch>* GetImportLookupTable() const
         {
-            return header_.RvaToVA<ImportLookupTable<Arch>>(directoryDescriptor_->ImportNameTableRVA);
+            return header_.template RvaToVA<ImportLookupTable<Arch>>(directoryDescriptor_->ImportNameTableRVA);
         }
 
         /**
@@ -352,7 +337,7 @@ public:
         /**
          * @brief  Returns an iterator pointing to the beginning of functions.
          */
-        FunctionIterator begin() const noexcept { return { header_, *this }; }
+        FunctionIterator begin() const noexcept { return FunctionIterator(header_, GetImportLookupTable(), GetImportAddressTable()); }
 
         /**
          * @brief  Returns an iterator pointing to the end of functions.
@@ -361,6 +346,7 @@ public:
 
         ModuleIterator& operator++()
         {
+            PE_ITERATOR_PROBE(kImportModuleVisited, 1);
             ++directoryDescriptor_;
             return *this;
         }
@@ -373,15 +359,15 @@ public:
         }
 
         bool operator==(const ModuleIterator& other) const noexcept { return directoryDescriptor_ == other.directoryDescriptor_; }
-        bool operator==(const IteratorEnd) const { return IsValid(); }
+        bool operator==(const IteratorEnd) const { return !IsValid(); }
         bool operator!=(const ModuleIterator& other) const noexcept { return directoryDescriptor_ != other.directoryDescriptor_; }
-        bool operator!=(const IteratorEnd) const { return !IsValid(); }
+        bool operator!=(const IteratorEnd) const { return IsValid(); }
 
         const ModuleIterator& operator*() const { return *this; }
         ModuleIterator&       operator*() { return *this; }
 
     private:
-        const Header<Arch>&                   header_;
+        Header<Arch>                          header_;
         const DelayImportDirectoryDescriptor* directoryDescriptor_;
     };
 
@@ -391,7 +377,7 @@ public:
      */
     explicit DelayedImport(const Header<Arch>& header)
         : header_(header)
-        , directoryDescriptor_(header.GetDirectoryDescriptor<DelayImportDirectoryDescriptor>(DelayImportDirectoryIndex))
+        , directoryDescriptor_(Validate(header, header.template GetDirectoryDescriptor<DelayImportDirectoryDescriptor>(DelayImportDirectoryIndex)))
     {
     }
 
@@ -403,16 +389,50 @@ public:
     /**
      * @brief Returns an iterator pointing to the first module.
      */
-    ModuleIterator begin() const noexcept { return { header_, directoryDescriptor_ }; }
+    ModuleIterator begin() const noexcept { return ModuleIterator(header_, directoryDescriptor_); }
 
     /**
      * @brief Returns an iterator pointing to the end of modules.
      */
     IteratorEnd end() const noexcept { return {}; }
 
+    /**
+     * @brief Returns module iterator of the descriptor.
+     * @param directoryDescriptor Pointer to the descriptor of the directory, or nullptr for the not valid iterator.
+     */
+    ModuleIterator GetModule(const DelayImportDirectoryDescriptor* directoryDescriptor) const noexcept { return ModuleIterator(header_, directoryDescriptor); }
+
 private:
-    const Header<Arch>&                   header_;
+    /**
+     * @brief Validates descriptors, names and thunks of the bounded image, unbounded images are not checked.
+     * @param header Image header.
+     * @param directoryDescriptor Pointer to the first delayed import directory descriptor.
+     * @return The descriptor if delayed imports are valid, or nullptr.
+     */
+    static const DelayImportDirectoryDescriptor* Validate(const Header<Arch>& header, const DelayImportDirectoryDescriptor* directoryDescriptor) noexcept
+    {
+        if (!directoryDescriptor || !header.GetImageSize())
+            return directoryDescriptor;
+
+        for (auto descriptor = directoryDescriptor;; ++descriptor) {
+            if (!header.IsArrayValid(descriptor, 1))
+                return nullptr;
+
+            if (!descriptor->DllNameRVA)
+                return directoryDescriptor;
+
+            if (!header.IsStringValid(header.template RvaToVA<const char>(descriptor->DllNameRVA))
+                || !ValidateThunks(header, header.template RvaToVA<const ImportLookupTable<Arch>>(descriptor->ImportNameTableRVA),
+                                   header.template RvaToVA<const ImportAddressTable<Arch>>(descriptor->ImportAddressTableRVA)))
+                return nullptr;
+        }
+    }
+
+    const Header<Arch>                    header_;
     const DelayImportDirectoryDescriptor* directoryDescriptor_;
+
+    static_assert(std::is_trivially_copyable<ModuleIterator>::value, "Iterators are trivially copyable");
+    static_assert(sizeof(ModuleIterator) == sizeof(Header<Arch>) + sizeof(void*), "Iterators hold the header copy and their position only");
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,397 @@
+#pragma once
+
+#include "PeExport.h"
+#include "PeImport.h"
+#include "PeParallel.h"
+#include "PeTypes.h"
+#include <algorithm>
+#include <atomic>
+
+namespace pe_iterator {
+
+/**
+ * @brief Exports of the module which imports are resolved against.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> struct ExportModule {
+    const char*         Name;    // Module name as referenced by the import descriptors, compared ignoring case.
+    const Export<Arch>* Exports; // Module exports.
+};
+
+/**
+ * @brief Binds whole import directories against a set of module exports.
+ *
+ * Functions imported by name are collected per import descriptor, sorted and matched against the sorted export names
+ * table in a single forward pass, instead of a separate binary search of the whole names table per thunk. The scratch
+ * buffer of requests is caller-supplied, no memory is allocated.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class ImportResolver {
+public:
+    using Function = typename Export<Arch>::Function;
+
+    /**
+     * @brief Pending lookup of the function imported by name.
+     */
+    struct Request {
+        const ImportByName* Name;      // Imported function name and hint.
+        DWORD               Slot;      // Index of the thunk in the module IAT.
+        DWORD               NameIndex; // Index in the export names table, or kNotFound.
+    };
+
+    // Name index of the unresolved request.
+    static constexpr DWORD kNotFound = 0xFFFFFFFF;
+
+    /**
+     * @brief Initialization constructor.
+     * @param modules Pointer to the exporting modules, must outlive the resolver.
+     * @param count Count of the exporting modules.
+     * @param requests Pointer to the scratch buffer of requests.
+     * @param capacity Count of requests the scratch buffer can hold. Modules importing more functions by name fall back to
+     * a lookup per function.
+     */
+    ImportResolver(const ExportModule<Arch>* modules, size_t count, Request* requests, size_t capacity) noexcept
+        : modules_(modules)
+        , count_(count)
+        , requests_(requests)
+        , capacity_(requests ? capacity : 0)
+    {
+    }
+
+    /**
+     * @brief Initialization constructor.
+     * @tparam M Count of the exporting modules.
+     * @tparam N Count of requests in the scratch buffer.
+     * @param modules Exporting modules, must outlive the resolver.
+     * @param requests Scratch buffer of requests.
+     */
+    template<size_t M, size_t N> ImportResolver(const ExportModule<Arch> (&modules)[M], Request (&requests)[N]) noexcept
+        : ImportResolver(modules, M, requests, N)
+    {
+    }
+
+    /**
+     * @brief Initialization constructor, allocating the scratch buffer of requests from the arena.
+     * @param modules Pointer to the exporting modules, must outlive the resolver.
+     * @param count Count of the exporting modules.
+     * @param arena Arena the requests are allocated from, all lookups are made per function if it is exhausted.
+     * @param capacity Count of requests to allocate.
+     */
+    ImportResolver(const ExportModule<Arch>* modules, size_t count, Arena& arena, size_t capacity) noexcept
+        : ImportResolver(modules, count, arena.Allocate<Request>(capacity), capacity)
+    {
+    }
+
+    /**
+     * @brief Returns count of the IAT slots of all imported modules.
+     * @tparam ImportType Import<Arch> or DelayedImport<Arch>.
+     * @param imports Image imports.
+     */
+    template<typename ImportType> static size_t GetCountOfSlots(const ImportType& imports)
+    {
+        size_t slots = 0;
+        if (imports.IsValid()) {
+            for (const auto& module : imports) {
+                for (auto function = module.begin(); function != module.end(); ++function)
+                    ++slots;
+            }
+        }
+
+        return slots;
+    }
+
+    /**
+     * @brief Searching exporting module by name ignoring case.
+     * @param name Module name.
+     * @return Pointer to the exporting module, or nullptr.
+     */
+    const ExportModule<Arch>* FindModule(const char* name) const noexcept
+    {
+        if (!name)
+            return nullptr;
+
+        for (size_t cx = 0; cx < count_; ++cx) {
+            if (modules_[cx].Name && CompareNamesInsensitive(modules_[cx].Name, name) == 0)
+                return &modules_[cx];
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Resolves all imported functions.
+     * @tparam ImportType Import<Arch> or DelayedImport<Arch>.
+     * @tparam Callback Callable as callback(const ImportType::ModuleIterator&, const ImportType::FunctionIterator&, const Function&).
+     * @param imports Image imports.
+     * @param callback Callback invoked for every IAT slot in the order of the slots. Unresolved functions are passed as
+     * not valid Function.
+     * @return Count of resolved functions.
+     */
+    template<typename ImportType, typename Callback> size_t Resolve(const ImportType& imports, Callback&& callback) const
+    {
+        if (!imports.IsValid())
+            return 0;
+
+        size_t resolved = 0;
+        for (const auto& module : imports) {
+            const auto exportModule = FindModule(module.GetModuleName());
+            resolved += ResolveModule(module, exportModule ? exportModule->Exports : nullptr, callback);
+        }
+
+        return resolved;
+    }
+
+    /**
+     * @brief Resolves all imported functions into the array.
+     * @tparam ImportType Import<Arch> or DelayedImport<Arch>.
+     * @param imports Image imports.
+     * @param output Pointer to the array receiving functions of all IAT slots of all modules, in the order of the slots.
+     * @param capacity Count of functions the array can hold, remaining slots are not stored.
+     * @return Count of resolved functions.
+     */
+    template<typename ImportType> size_t Resolve(const ImportType& imports, Function* output, size_t capacity) const
+    {
+        size_t slot = 0;
+        return Resolve(imports, [&](const auto&, const auto&, const Function& function) {
+            if (slot < capacity)
+                output[slot] = function;
+            ++slot;
+        });
+    }
+
+    /**
+     * @brief Resolves all imported functions into the array allocated from the arena.
+     * @tparam ImportType Import<Arch> or DelayedImport<Arch>.
+     * @param imports Image imports.
+     * @param arena Arena the array is allocated from.
+     * @param output Receives pointer to the array of functions of all IAT slots, or nullptr if the arena is exhausted.
+     * @param countOfSlots Receives count of functions in the array.
+     * @return Count of resolved functions.
+     */
+    template<typename ImportType> size_t Resolve(const ImportType& imports, Arena& arena, Function*& output, size_t& countOfSlots) const
+    {
+        countOfSlots = GetCountOfSlots(imports);
+        output       = arena.Allocate<Function>(countOfSlots ? countOfSlots : 1);
+        if (!output) {
+            countOfSlots = 0;
+            return 0;
+        }
+
+        return Resolve(imports, output, countOfSlots);
+    }
+
+    /**
+     * @brief Resolves all imported functions, splitting import descriptors across tasks of the executor.
+     *
+     * Every task receives a contiguous range of descriptors with about the same count of thunks and an equal slice of the
+     * requests buffer. The callback is invoked concurrently from the tasks, in the order of the slots within a task.
+     * @tparam Executor Callable as executor(size_t count, const Task& task), see ParallelOptions.
+     * @param imports Image imports.
+     * @param callback Thread-safe callback invoked for every IAT slot.
+     * @param executor Executor running the tasks.
+     * @param options Work partitioning options, small imports are resolved on the calling thread.
+     * @return Count of resolved functions.
+     */
+    template<typename ImportType, typename Callback, typename Executor>
+    size_t ResolveParallel(const ImportType& imports, Callback&& callback, Executor&& executor, const ParallelOptions& options = ParallelOptions()) const
+    {
+        return ResolveTasks(imports, executor, options, [&](size_t) -> Callback& { return callback; });
+    }
+
+    /**
+     * @brief Resolves all imported functions into the array, splitting import descriptors across tasks of the executor.
+     * @tparam Executor Callable as executor(size_t count, const Task& task), see ParallelOptions.
+     * @param imports Image imports.
+     * @param output Pointer to the array receiving functions of all IAT slots of all modules, in the order of the slots.
+     * @param capacity Count of functions the array can hold, remaining slots are not stored.
+     * @param executor Executor running the tasks.
+     * @param options Work partitioning options, small imports are resolved on the calling thread.
+     * @return Count of resolved functions.
+     */
+    template<typename ImportType, typename Executor>
+    size_t ResolveParallel(const ImportType& imports, Function* output, size_t capacity, Executor&& executor, const ParallelOptions& options = ParallelOptions()) const
+    {
+        return ResolveTasks(imports, executor, options, [&](size_t firstSlot) {
+            return [output, capacity, slot = firstSlot](const auto&, const auto&, const Function& function) mutable {
+                if (slot < capacity)
+                    output[slot] = function;
+                ++slot;
+            };
+        });
+    }
+
+private:
+    /**
+     * @brief Splits import descriptors across tasks of the executor.
+     * @param imports Image imports.
+     * @param executor Executor running the tasks.
+     * @param options Work partitioning options.
+     * @param makeCallback Callable returning IAT slot callback of the task by the index of its first slot.
+     * @return Count of resolved functions.
+     */
+    template<typename ImportType, typename Executor, typename MakeCallback>
+    size_t ResolveTasks(const ImportType& imports, Executor& executor, const ParallelOptions& options, const MakeCallback& makeCallback) const
+    {
+        if (!imports.IsValid())
+            return 0;
+
+        size_t modules = 0, slots = 0;
+        for (const auto& module : imports) {
+            ++modules;
+            for (auto function = module.begin(); function != module.end(); ++function)
+                ++slots;
+        }
+
+        const auto tasks = std::min(options.GetTaskCount(slots), modules);
+        if (tasks <= 1) {
+            decltype(auto) callback = makeCallback(0);
+            return Resolve(imports, callback);
+        }
+
+        // First module and first slot of every task, the last entries are the totals.
+        size_t firstModules[ParallelOptions::kMaxTasks + 1], firstSlots[ParallelOptions::kMaxTasks + 1];
+
+        size_t ranged = 0, module = 0, accumulated = 0;
+        for (const auto& descriptor : imports) {
+            if (ranged < tasks && accumulated >= ranged * slots / tasks) {
+                firstModules[ranged] = module;
+                firstSlots[ranged++] = accumulated;
+            }
+
+            ++module;
+            for (auto function = descriptor.begin(); function != descriptor.end(); ++function)
+                ++accumulated;
+        }
+
+        firstModules[ranged] = modules;
+        firstSlots[ranged]   = slots;
+
+        std::atomic<size_t> resolved(0);
+        executor(ranged, [&](size_t task) {
+            const auto     slice = capacity_ / ranged;
+            ImportResolver resolver(modules_, count_, requests_ + task * slice, slice);
+
+            auto descriptor = imports.begin();
+            for (size_t cx = 0; cx < firstModules[task]; ++cx)
+                ++descriptor;
+
+            decltype(auto) callback = makeCallback(firstSlots[task]);
+
+            size_t local = 0;
+            for (size_t cx = firstModules[task]; cx < firstModules[task + 1]; ++cx, ++descriptor) {
+                const auto exportModule = resolver.FindModule(descriptor.GetModuleName());
+                local += resolver.ResolveModule(descriptor, exportModule ? exportModule->Exports : nullptr, callback);
+            }
+
+            resolved.fetch_add(local, std::memory_order_relaxed);
+        });
+
+        return resolved.load();
+    }
+
+    /**
+     * @brief Resolves functions of the single import descriptor.
+     * @param module Imported module.
+     * @param exports Exports of the module, or nullptr if module is unknown.
+     * @param callback IAT slot callback.
+     * @return Count of resolved functions.
+     */
+    template<typename ModuleIterator, typename Callback> size_t ResolveModule(const ModuleIterator& module, const Export<Arch>* exports, Callback& callback) const
+    {
+        size_t count   = 0;
+        bool   batched = exports && exports->IsValid();
+
+        if (batched) {
+            for (const auto& function : module) {
+                // The functions whose name does not translate are reported unresolved without a request.
+                const auto name = function.GetFunctionName();
+                if (function.IsImportedByOrdinal() || !name)
+                    continue;
+
+                if (count == capacity_) {
+                    batched = false;
+                    break;
+                }
+
+                requests_[count++] = { name, static_cast<DWORD>(function.GetIndex()), kNotFound };
+            }
+        }
+
+        if (batched) {
+            std::sort(requests_, requests_ + count, [](const Request& first, const Request& second) { return strcmp(first.Name->Name, second.Name->Name) < 0; });
+            Match(*exports, count);
+            std::sort(requests_, requests_ + count, [](const Request& first, const Request& second) { return first.Slot < second.Slot; });
+        }
+
+        size_t resolved = 0, request = 0;
+        for (const auto& function : module) {
+            Function result;
+            if (exports && exports->IsValid()) {
+                const auto name = function.IsImportedByOrdinal() ? nullptr : function.GetFunctionName();
+                if (function.IsImportedByOrdinal())
+                    result = exports->FindFunction(static_cast<WORD>(function.GetFunctionOrdinal()));
+                else if (name && !batched)
+                    result = exports->FindFunction(name->Name);
+                else if (name && requests_[request].NameIndex != kNotFound)
+                    result = exports->GetFunctionByNameIndex(requests_[request].NameIndex);
+
+                request += batched && name;
+            }
+
+            resolved += result.IsValid();
+            callback(module, function, result);
+        }
+
+        return resolved;
+    }
+
+    /**
+     * @brief Matches requests sorted by name against the export names table.
+     * @param exports Module exports.
+     * @param count Count of requests.
+     */
+    void Match(const Export<Arch>& exports, size_t count) const
+    {
+        const DWORD countOfNames = exports.GetCountOfFunctionsNames();
+
+        DWORD position = 0;
+        for (size_t cx = 0; cx < count; ++cx) {
+            auto&       request = requests_[cx];
+            const char* name    = request.Name->Name;
+
+            // The hint usually points exactly to the name when imports were linked against the same module version.
+            if (request.Name->Hint < countOfNames && strcmp(exports.GetFunctionName(request.Name->Hint), name) == 0) {
+                request.NameIndex = request.Name->Hint;
+                continue;
+            }
+
+            // Gallop forward from the previous match, both sequences are sorted.
+            DWORD low = position, high = position, step = 1;
+            while (high < countOfNames && strcmp(exports.GetFunctionName(high), name) < 0) {
+                low = high + 1;
+                high += step;
+                step *= 2;
+            }
+
+            high = std::min<DWORD>(high + 1, countOfNames);
+            while (low < high) {
+                const auto middle = low + (high - low) / 2;
+                if (strcmp(exports.GetFunctionName(middle), name) < 0)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+
+            position = low;
+            if (low < countOfNames && strcmp(exports.GetFunctionName(low), name) == 0)
+                request.NameIndex = low;
+        }
+    }
+
+    const ExportModule<Arch>* modules_;
+    size_t                    count_;
+    Request*                  requests_;
+    size_t                    capacity_;
+};
+
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Counts the probe of the hot path, compiles to nothing unless PE_ITERATOR_INSTRUMENTATION is defined.
+ * @param probe Probe enumerator name without the scope, e.g. kRvaTranslation.
+ * @param count Count to add, not evaluated when the instrumentation is disabled.
+ */
+#if defined(PE_ITERATOR_INSTRUMENTATION)
+#define PE_ITERATOR_PROBE(probe, count) ::pe_iterator::AddProbe(::pe_iterator::Probe::probe, count)
+#else
+#define PE_ITERATOR_PROBE(probe, count) static_cast<void>(0)
+#endif
+
+namespace pe_iterator {
+
+/**
+ * @brief True if the probes are compiled in.
+ */
+#if defined(PE_ITERATOR_INSTRUMENTATION)
+constexpr bool kInstrumentationEnabled = true;
+#else
+constexpr bool kInstrumentationEnabled = false;
+#endif
+
+/**
+ * @brief Hot path probes counted with PE_ITERATOR_INSTRUMENTATION defined.
+ */
+enum class Probe : uint8_t {
+    kRvaTranslation,          // Header::RvaToVA calls.
+    kSectionScanStep,         // Section headers or section index entries compared while translating RVAs of raw files.
+    kNameComparison,          // strcmp calls of the export lookups by name.
+    kSectionVisited,          // Section iterator increments.
+    kImportModuleVisited,     // Import and delayed import module iterator increments.
+    kImportFunctionVisited,   // Import function iterator increments, thunks included.
+    kExportVisited,           // Export iterator increments.
+    kRelocationBlockVisited,  // Relocation block iterator increments.
+    kRelocationVisited,       // Relocation iterator increments.
+    kRuntimeFunctionVisited,  // Exception iterator increments.
+    kTlsCallbackVisited,      // TLS callback iterator increments.
+    kUnwindCodeVisited,       // Unwind code iterator increments.
+    kCount
+};
+
+/**
+ * @brief Values of the probe counters.
+ */
+struct ProbeCounters {
+    uint64_t Values[static_cast<size_t>(Probe::kCount)] = {};
+
+    uint64_t operator[](Probe probe) const noexcept { return Values[static_cast<size_t>(probe)]; }
+};
+
+/**
+ * @brief Returns the probe counters of the calling thread, the counters are not shared so probes take no locks.
+ */
+inline ProbeCounters& GetThreadProbeCounters() noexcept
+{
+    static thread_local ProbeCounters counters;
+    return counters;
+}
+
+/**
+ * @brief Adds count to the probe counter of the calling thread, see PE_ITERATOR_PROBE.
+ * @param probe Probe.
+ * @param count Count to add.
+ */
+inline void AddProbe(Probe probe, uint64_t count) noexcept { GetThreadProbeCounters().Values[static_cast<size_t>(probe)] += count; }
+
+/**
+ * @brief Returns snapshot of the probe counters of the calling thread, all zero when the instrumentation is disabled.
+ */
+inline ProbeCounters GetProbeCounters() noexcept { return GetThreadProbeCounters(); }
+
+/**
+ * @brief Resets the probe counters of the calling thread.
+ */
+inline void ResetProbeCounters() noexcept { GetThreadProbeCounters() = {}; }
+
+/**
+ * @brief Scope of the probes counted by the calling thread, e.g. one sample.
+ *
+ * With PE_ITERATOR_INSTRUMENTATION_SINK defined as callable as sink(const char* name, const ProbeCounters& counters),
+ * the scope reports its counters on destruction, so they can be forwarded to ETW (TraceLoggingWrite), tracepoints or
+ * any other aggregation. Nested scopes report the counters including the nested ones.
+ */
+class ProbeScope {
+public:
+    /**
+     * @brief Initialization constructor.
+     * @param name Name of the scope passed to the sink, must outlive the scope.
+     */
+    explicit ProbeScope(const char* name = nullptr) noexcept
+        : name_(name)
+        , start_(GetProbeCounters())
+    {
+    }
+
+    ProbeScope(const ProbeScope&)            = delete;
+    ProbeScope& operator=(const ProbeScope&) = delete;
+
+    ~ProbeScope()
+    {
+#if defined(PE_ITERATOR_INSTRUMENTATION) && defined(PE_ITERATOR_INSTRUMENTATION_SINK)
+        PE_ITERATOR_INSTRUMENTATION_SINK(name_, GetCounters());
+#endif
+    }
+
+    /**
+     * @brief Returns the probes counted by the calling thread since the scope was entered.
+     */
+    ProbeCounters GetCounters() const noexcept
+    {
+        auto counters = GetProbeCounters();
+        for (size_t cx = 0; cx < static_cast<size_t>(Probe::kCount); ++cx)
+            counters.Values[cx] -= start_.Values[cx];
+
+        return counters;
+    }
+
+    /**
+     * @brief Returns name of the scope.
+     */
+    const char* GetName() const noexcept { return name_; }
+
+private:
+    const char*   name_;
+    ProbeCounters start_;
+};
+
+}
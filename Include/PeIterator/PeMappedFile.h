@@ -0,0 +1,335 @@
+#pragma once
+
+#include "PeAnyImage.h"
+#include "PeImage.h"
+#include "PeTypes.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace pe_iterator {
+
+/**
+ * @brief View of the file mapped into memory, read-only unless opened for writing.
+ *
+ * Only the pages actually touched by the parser are read from the disk. The view is released on destruction. Windows
+ * files are mapped through the file mapping objects, other platforms use mmap and take paths as char strings only.
+ */
+class MappedFile {
+public:
+    /**
+     * @brief Access of the shared view, see MappedFile(path, access, size).
+     */
+    enum class Access : BYTE {
+        kRead,     // Read-only view, the file may be open by a writer.
+        kReadWrite // Writable view, the file may be open by readers but not by another writer.
+    };
+
+    /**
+     * @brief Constructs an empty view.
+     */
+    MappedFile() noexcept = default;
+
+#if defined(_WIN32)
+    /**
+     * @brief Maps the file.
+     * @param path Path to the file.
+     */
+    explicit MappedFile(const wchar_t* path) noexcept { Map(CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr)); }
+
+    /**
+     * @brief Maps the file.
+     * @param path Path to the file.
+     */
+    explicit MappedFile(const char* path) noexcept { Map(CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr)); }
+
+    /**
+     * @brief Maps the file shared between one writer and any count of readers.
+     *
+     * The writable view keeps the file open until closed, so another writer fails to open it meanwhile.
+     * @param path Path to the file.
+     * @param access View access.
+     * @param size Size the created or empty file is extended to, non-empty files are mapped at their size. Ignored for read-only views.
+     */
+    MappedFile(const wchar_t* path, Access access, size_t size = 0) noexcept
+    {
+        const auto write = access == Access::kReadWrite;
+        Map(CreateFileW(path, write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, write ? FILE_SHARE_READ : FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                        write ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr),
+            access, size);
+    }
+
+    /**
+     * @brief Maps the file shared between one writer and any count of readers.
+     * @param path Path to the file.
+     * @param access View access.
+     * @param size Size the created or empty file is extended to, non-empty files are mapped at their size. Ignored for read-only views.
+     */
+    MappedFile(const char* path, Access access, size_t size = 0) noexcept
+    {
+        const auto write = access == Access::kReadWrite;
+        Map(CreateFileA(path, write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, write ? FILE_SHARE_READ : FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                        write ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr),
+            access, size);
+    }
+#else
+    /**
+     * @brief Maps the file.
+     * @param path Path to the file.
+     */
+    explicit MappedFile(const char* path) noexcept { Map(open(path, O_RDONLY | O_CLOEXEC)); }
+
+    /**
+     * @brief Maps the file shared between one writer and any count of readers.
+     *
+     * The writable view keeps the file open and locked until closed, so another writer fails to open it meanwhile.
+     * @param path Path to the file.
+     * @param access View access.
+     * @param size Size the created or empty file is extended to, non-empty files are mapped at their size. Ignored for read-only views.
+     */
+    MappedFile(const char* path, Access access, size_t size = 0) noexcept
+    {
+        const auto write = access == Access::kReadWrite;
+        Map(write ? open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644) : open(path, O_RDONLY | O_CLOEXEC), access, size);
+    }
+#endif
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept { *this = static_cast<MappedFile&&>(other); }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other) {
+            Close();
+            data_           = other.data_;
+            size_           = other.size_;
+            lastWriteTime_  = other.lastWriteTime_;
+            file_           = other.file_;
+            writable_       = other.writable_;
+            extended_       = other.extended_;
+            other.data_     = nullptr;
+            other.size_     = 0;
+            other.file_     = GetInvalidFile();
+            other.writable_ = false;
+            other.extended_ = false;
+        }
+
+        return *this;
+    }
+
+    ~MappedFile() { Close(); }
+
+    /**
+     * @brief Returns pointer to the beginning of the view, or nullptr.
+     */
+    const BYTE* GetData() const noexcept { return data_; }
+
+    /**
+     * @brief Returns pointer to the beginning of the writable view, or nullptr if the view is read-only.
+     */
+    BYTE* GetWritableData() const noexcept { return writable_ ? const_cast<BYTE*>(data_) : nullptr; }
+
+    /**
+     * @brief Returns size of the view in bytes.
+     */
+    size_t GetSize() const noexcept { return size_; }
+
+    /**
+     * @brief Returns last write time of the file at the time it was mapped, in FILETIME units.
+     */
+    uint64_t GetLastWriteTime() const noexcept { return lastWriteTime_; }
+
+    /**
+     * @brief Returns true if the view is writable.
+     */
+    bool IsWritable() const noexcept { return data_ && writable_; }
+
+    /**
+     * @brief Returns true if the writable view extended the file which was empty or created by the open.
+     */
+    bool IsExtended() const noexcept { return data_ && extended_; }
+
+    /**
+     * @brief Returns true if the file was mapped.
+     */
+    bool IsValid() const noexcept { return data_ != nullptr; }
+
+    /**
+     * @brief Returns raw file image over the view bounded by the file size, the view must outlive the image.
+     * @tparam Arch Image architecture.
+     * @param sectionIndex Optional prebuilt section index.
+     */
+    template<Architecture Arch> Image<Arch> GetImage(const SectionIndex* sectionIndex = nullptr) const
+    {
+        return Image<Arch>(data_, size_, ImageType::kFile, sectionIndex);
+    }
+
+    /**
+     * @brief Returns raw file image of the architecture detected from the headers bounded by the file size, the view must outlive the image.
+     * @param sectionIndex Optional prebuilt section index.
+     */
+    AnyImage GetAnyImage(const SectionIndex* sectionIndex = nullptr) const noexcept { return AnyImage(data_, size_, ImageType::kFile, sectionIndex); }
+
+    /**
+     * @brief Unmaps the file.
+     */
+    void Close() noexcept
+    {
+#if defined(_WIN32)
+        if (data_)
+            UnmapViewOfFile(data_);
+
+        if (file_ != GetInvalidFile())
+            CloseHandle(file_);
+#else
+        if (data_)
+            munmap(const_cast<BYTE*>(data_), size_);
+
+        if (file_ != GetInvalidFile())
+            close(file_);
+#endif
+
+        data_     = nullptr;
+        size_     = 0;
+        file_     = GetInvalidFile();
+        writable_ = false;
+        extended_ = false;
+    }
+
+    /**
+     * @brief Writes modified pages of the writable view to the file.
+     * @return true on success.
+     */
+    bool Flush() const noexcept
+    {
+#if defined(_WIN32)
+        return IsWritable() && FlushViewOfFile(data_, 0);
+#else
+        return IsWritable() && msync(const_cast<BYTE*>(data_), size_, MS_SYNC) == 0;
+#endif
+    }
+
+private:
+#if defined(_WIN32)
+    using FileHandle = HANDLE;
+#else
+    using FileHandle = int;
+#endif
+
+    /**
+     * @brief Returns the handle value of no file.
+     */
+    static FileHandle GetInvalidFile() noexcept
+    {
+#if defined(_WIN32)
+        return INVALID_HANDLE_VALUE;
+#else
+        return -1;
+#endif
+    }
+
+#if defined(_WIN32)
+    /**
+     * @brief Maps the opened file and closes its handles, the view keeps the mapping alive. Writable views keep the file
+     * open to exclude other writers.
+     * @param file File handle.
+     * @param access View access.
+     * @param minimalSize Size the empty file of the writable view is extended to.
+     */
+    void Map(HANDLE file, Access access = Access::kRead, size_t minimalSize = 0) noexcept
+    {
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+
+        const auto    write = access == Access::kReadWrite;
+        LARGE_INTEGER size;
+        FILETIME      lastWriteTime;
+        if (GetFileSizeEx(file, &size) && GetFileTime(file, nullptr, nullptr, &lastWriteTime)) {
+            // Existing contents keep their size, so a file of another format is never grown.
+            const auto extend = write && !size.QuadPart && minimalSize;
+            if (extend)
+                size.QuadPart = static_cast<LONGLONG>(minimalSize);
+
+            if (size.QuadPart > 0 && static_cast<ULONGLONG>(size.QuadPart) <= static_cast<size_t>(-1)) {
+                // The writable mapping of the requested size extends the file.
+                const auto mapping = write ? CreateFileMappingW(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size.QuadPart >> 32), size.LowPart, nullptr)
+                                           : CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping) {
+                    data_          = static_cast<const BYTE*>(MapViewOfFile(mapping, write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+                    size_          = data_ ? static_cast<size_t>(size.QuadPart) : 0;
+                    lastWriteTime_ = static_cast<uint64_t>(lastWriteTime.dwHighDateTime) << 32 | lastWriteTime.dwLowDateTime;
+                    writable_      = data_ && write;
+                    extended_      = writable_ && extend;
+                    CloseHandle(mapping);
+                }
+            }
+        }
+
+        if (writable_)
+            file_ = file;
+        else
+            CloseHandle(file);
+    }
+#else
+    /**
+     * @brief Maps the opened file and closes the descriptor, the view keeps the mapping alive. Writable views keep the
+     * descriptor open with the exclusive lock to exclude other writers, readers do not lock.
+     * @param file File descriptor.
+     * @param access View access.
+     * @param minimalSize Size the empty file of the writable view is extended to.
+     */
+    void Map(int file, Access access = Access::kRead, size_t minimalSize = 0) noexcept
+    {
+        if (file == -1)
+            return;
+
+        const auto  write = access == Access::kReadWrite;
+        struct stat status;
+        if ((!write || flock(file, LOCK_EX | LOCK_NB) == 0) && fstat(file, &status) == 0) {
+            // Existing contents keep their size, so a file of another format is never grown.
+            auto       size   = static_cast<uint64_t>(status.st_size);
+            const auto extend = write && !size && minimalSize;
+            if (extend)
+                size = ftruncate(file, static_cast<off_t>(minimalSize)) == 0 ? minimalSize : 0;
+
+            if (size > 0 && size <= static_cast<size_t>(-1)) {
+                const auto view = mmap(nullptr, static_cast<size_t>(size), write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0);
+                if (view != MAP_FAILED) {
+#if defined(__APPLE__)
+                    const auto& lastWriteTime = status.st_mtimespec;
+#else
+                    const auto& lastWriteTime = status.st_mtim;
+#endif
+                    // FILETIME counts 100-nanosecond intervals since 1601.
+                    data_          = static_cast<const BYTE*>(view);
+                    size_          = static_cast<size_t>(size);
+                    lastWriteTime_ = static_cast<uint64_t>(lastWriteTime.tv_sec) * 10000000 + lastWriteTime.tv_nsec / 100 + 116444736000000000;
+                    writable_      = write;
+                    extended_      = extend;
+                }
+            }
+        }
+
+        if (writable_)
+            file_ = file;
+        else
+            close(file);
+    }
+#endif
+
+    const BYTE* data_          = nullptr;
+    size_t      size_          = 0;
+    uint64_t    lastWriteTime_ = 0;
+    FileHandle  file_          = GetInvalidFile();
+    bool        writable_      = false;
+    bool        extended_      = false;
+};
+
+}
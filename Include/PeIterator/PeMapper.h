@@ -0,0 +1,568 @@
+#pragma once
+
+#include "PeImage.h"
+#include "PeImportResolver.h"
+#include "PeParallel.h"
+#include "PeRelocator.h"
+#include "PeTypes.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(PE_ITERATOR_SSE2) || defined(PE_ITERATOR_AVX2)
+#include <immintrin.h>
+#endif
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace pe_iterator {
+
+/**
+ * @brief Result of mapping the image.
+ */
+enum class MapStatus : BYTE {
+    kSuccess,
+    kInvalidImage,          // Headers are not valid or of the other architecture, or TLS callbacks lie outside the image.
+    kOutOfMemory,           // The image memory could not be reserved or the arena is exhausted.
+    kUnsupportedRelocation, // The image has a relocation type the relocator does not support, a relocation outside the image, or moved without relocations.
+    kUnresolvedImport,      // An imported function was resolved neither by the modules nor by the fallback.
+    kProtectionFailed       // Section protections could not be applied.
+};
+
+/**
+ * @brief Fallback resolver of the imported functions not found in the exporting modules, forwarded ones included.
+ * @return Function address, or nullptr.
+ */
+using ImportFallback = const void* (*)(void* context, const char* moduleName, const char* functionName, WORD ordinal);
+
+#if defined(_WIN32)
+/**
+ * @brief Resolves the imported function through the system loader, which follows forwarders. Loaded modules stay loaded.
+ * @param moduleName Module name.
+ * @param functionName Function name, or nullptr if imported by ordinal.
+ * @param ordinal Function ordinal.
+ */
+inline const void* ResolveSystemImport(void*, const char* moduleName, const char* functionName, WORD ordinal) noexcept
+{
+    const auto module = LoadLibraryA(moduleName);
+    if (!module)
+        return nullptr;
+
+    return reinterpret_cast<const void*>(GetProcAddress(module, functionName ? functionName : reinterpret_cast<LPCSTR>(static_cast<uintptr_t>(ordinal))));
+}
+#endif
+
+/**
+ * @brief Options of the mapping pipeline.
+ */
+struct MapOptions {
+#if defined(_WIN32)
+    ImportFallback ResolveImport = ResolveSystemImport; // Fallback resolver of the imports, or nullptr.
+#else
+    ImportFallback ResolveImport = nullptr; // Fallback resolver of the imports, or nullptr.
+#endif
+    void*  Context              = nullptr;      // Context passed to the fallback resolver.
+    size_t NonTemporalThreshold = 256 * 1024;   // Sections of at least this size are copied bypassing the cache.
+    bool   BindDelayedImports   = false;        // Binds delayed imports eagerly, otherwise they are left to the image.
+    bool   ProtectSections      = true;         // Applies section protections, otherwise the image stays read-write-execute.
+    bool   LargePages           = false;        // Maps the image with large pages, honored only without section protections.
+    bool   RunTls               = true;         // Calls TLS callbacks of native images with DLL_PROCESS_ATTACH.
+};
+
+/**
+ * @brief Copies the bytes with non-temporal stores, so large sections do not evict the cache the parser works in.
+ * @param destination Destination, the copy is unaligned at its ends only.
+ * @param source Source.
+ * @param size Count of bytes.
+ */
+inline void CopyNonTemporal(BYTE* destination, const BYTE* source, size_t size) noexcept
+{
+#if defined(PE_ITERATOR_SSE2) || defined(PE_ITERATOR_AVX2)
+    constexpr size_t kAlignment = 16;
+
+    const auto head = (kAlignment - reinterpret_cast<uintptr_t>(destination) % kAlignment) % kAlignment;
+    if (size < head + 4 * kAlignment) {
+        memcpy(destination, source, size);
+        return;
+    }
+
+    memcpy(destination, source, head);
+    size_t offset = head;
+    for (; offset + 4 * kAlignment <= size; offset += 4 * kAlignment) {
+        const auto from = reinterpret_cast<const __m128i*>(source + offset);
+        const auto to   = reinterpret_cast<__m128i*>(destination + offset);
+        const auto a = _mm_loadu_si128(from), b = _mm_loadu_si128(from + 1), c = _mm_loadu_si128(from + 2), d = _mm_loadu_si128(from + 3);
+        _mm_stream_si128(to, a);
+        _mm_stream_si128(to + 1, b);
+        _mm_stream_si128(to + 2, c);
+        _mm_stream_si128(to + 3, d);
+    }
+
+    memcpy(destination + offset, source + offset, size - offset);
+    _mm_sfence();
+#else
+    memcpy(destination, source, size);
+#endif
+}
+
+/**
+ * @brief Memory of the mapped image, released on destruction.
+ */
+class MappedImage {
+public:
+    /**
+     * @brief Constructs an empty mapping.
+     */
+    MappedImage() noexcept = default;
+
+    MappedImage(const MappedImage&)            = delete;
+    MappedImage& operator=(const MappedImage&) = delete;
+
+    MappedImage(MappedImage&& other) noexcept { *this = static_cast<MappedImage&&>(other); }
+
+    MappedImage& operator=(MappedImage&& other) noexcept
+    {
+        if (this != &other) {
+            Unmap();
+            data_           = other.data_;
+            size_           = other.size_;
+            reserved_       = other.reserved_;
+            other.data_     = nullptr;
+            other.size_     = 0;
+            other.reserved_ = 0;
+        }
+
+        return *this;
+    }
+
+    ~MappedImage() { Unmap(); }
+
+    /**
+     * @brief Returns pointer to the image base, or nullptr.
+     */
+    BYTE* GetData() const noexcept { return data_; }
+
+    /**
+     * @brief Returns size of the image in bytes, SizeOfImage.
+     */
+    size_t GetSize() const noexcept { return size_; }
+
+    /**
+     * @brief Returns true if the memory is mapped.
+     */
+    bool IsValid() const noexcept { return data_ != nullptr; }
+
+    /**
+     * @brief Returns the bounded module image over the mapping, the mapping must outlive the image.
+     * @tparam Arch Image architecture.
+     */
+    template<Architecture Arch> Image<Arch> GetImage() const { return Image<Arch>(data_, size_, ImageType::kModule); }
+
+    /**
+     * @brief Reserves and commits read-write image memory, preferably at the specified address.
+     * @param size Size of the image in bytes.
+     * @param preferredBase Preferred address, or nullptr.
+     * @param largePages Maps read-write-execute large pages if the system allows, falling back to regular pages.
+     * @return true on success.
+     */
+    bool Reserve(size_t size, void* preferredBase, bool largePages) noexcept
+    {
+        Unmap();
+        if (!size)
+            return false;
+
+#if defined(_WIN32)
+        const auto largePage = largePages ? GetLargePageMinimum() : 0;
+        if (largePage) {
+            const auto rounded = (size + largePage - 1) & ~(largePage - 1);
+            data_              = static_cast<BYTE*>(VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_EXECUTE_READWRITE));
+            reserved_          = data_ ? rounded : 0;
+        }
+
+        const DWORD protection = largePages ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE;
+        if (!data_ && preferredBase)
+            data_ = static_cast<BYTE*>(VirtualAlloc(preferredBase, size, MEM_RESERVE | MEM_COMMIT, protection));
+        if (!data_)
+            data_ = static_cast<BYTE*>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, protection));
+        if (data_ && !reserved_)
+            reserved_ = size;
+#else
+        const int protection = largePages ? PROT_READ | PROT_WRITE | PROT_EXEC : PROT_READ | PROT_WRITE;
+        const auto view      = mmap(preferredBase, size, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (view != MAP_FAILED) {
+            data_     = static_cast<BYTE*>(view);
+            reserved_ = size;
+#if defined(MADV_HUGEPAGE)
+            if (largePages)
+                madvise(view, size, MADV_HUGEPAGE);
+#endif
+        }
+#endif
+
+        size_ = data_ ? size : 0;
+        return data_ != nullptr;
+    }
+
+    /**
+     * @brief Releases the memory.
+     */
+    void Unmap() noexcept
+    {
+#if defined(_WIN32)
+        if (data_)
+            VirtualFree(data_, 0, MEM_RELEASE);
+#else
+        if (data_)
+            munmap(data_, reserved_);
+#endif
+
+        data_     = nullptr;
+        size_     = 0;
+        reserved_ = 0;
+    }
+
+private:
+    BYTE*  data_     = nullptr;
+    size_t size_     = 0;
+    size_t reserved_ = 0;
+};
+
+/**
+ * @brief Maps the raw file image into executable memory: reserves the image once, copies the headers and sections,
+ * applies relocations, binds imports, protects sections and runs TLS callbacks.
+ *
+ * Relocations are applied by Relocator and imports are bound by ImportResolver against the exporting modules, the
+ * functions they do not resolve are passed to the fallback resolver. Adjacent pages of the same protection are
+ * protected by one call, pages shared by sections of low-alignment images take the union of their access. Static TLS
+ * data and the entry point are left to the caller.
+ * @tparam Arch Image architecture. TLS callbacks are run for the native architecture only.
+ */
+template<Architecture Arch> class ImageMapper {
+public:
+    using Function = typename Export<Arch>::Function;
+
+    /**
+     * @brief Initialization constructor.
+     * @param file Raw file image, must outlive the mapper.
+     * @param options Mapping options.
+     */
+    explicit ImageMapper(const Image<Arch>& file, const MapOptions& options = MapOptions()) noexcept
+        : file_(file)
+        , options_(options)
+    {
+    }
+
+    /**
+     * @brief Maps the image.
+     * @tparam Executor Callable as executor(size_t count, const Task& task), see ParallelOptions.
+     * @param modules Pointer to the exporting modules, may be nullptr.
+     * @param count Count of the exporting modules.
+     * @param arena Arena the scratch buffers of the import resolver and the protection ranges are allocated from.
+     * @param output Receives the mapped image, released on failure.
+     * @param executor Executor running the relocation and import binding tasks.
+     * @param parallelOptions Work partitioning options, small images are processed on the calling thread.
+     * @return Mapping status.
+     */
+    template<typename Executor = SequentialExecutor>
+    MapStatus Map(const ExportModule<Arch>* modules, size_t count, Arena& arena, MappedImage& output, Executor&& executor = Executor(),
+                  const ParallelOptions& parallelOptions = ParallelOptions()) const
+    {
+        const auto status = MapStages(modules, count, arena, output, executor, parallelOptions);
+        if (status != MapStatus::kSuccess)
+            output.Unmap();
+
+        return status;
+    }
+
+private:
+    // Access bits of the protection ranges.
+    static constexpr BYTE kRead    = 1;
+    static constexpr BYTE kWrite   = 2;
+    static constexpr BYTE kExecute = 4;
+
+    /**
+     * @brief Pages of the same access.
+     */
+    struct ProtectionRange {
+        size_t Begin;
+        size_t End;
+        BYTE   Access;
+    };
+
+    /**
+     * @brief Bound of the unmerged protection range.
+     */
+    struct ProtectionBound {
+        size_t Offset;
+        BYTE   Access;
+        bool   Begin; // True for the range begin, false for its end.
+    };
+
+    template<typename Executor>
+    MapStatus MapStages(const ExportModule<Arch>* modules, size_t count, Arena& arena, MappedImage& output, Executor& executor, const ParallelOptions& parallelOptions) const
+    {
+        const auto header = file_.GetHeader();
+        const WORD magic  = Arch == Architecture::kX64 ? IMAGE_NT_OPTIONAL_HDR64_MAGIC : IMAGE_NT_OPTIONAL_HDR32_MAGIC;
+        if (header.GetImageType() != ImageType::kFile || !header.IsValid() || header.GetOptionalHeader()->Magic != magic || !header.GetOptionalHeader()->SizeOfImage)
+            return MapStatus::kInvalidImage;
+
+        const auto preferredBase = header.GetOptionalHeader()->ImageBase;
+        const auto fitsPointer   = static_cast<uint64_t>(static_cast<uintptr_t>(preferredBase)) == preferredBase;
+        if (!output.Reserve(header.GetOptionalHeader()->SizeOfImage, fitsPointer ? reinterpret_cast<void*>(static_cast<uintptr_t>(preferredBase)) : nullptr,
+                            options_.LargePages && !options_.ProtectSections))
+            return MapStatus::kOutOfMemory;
+
+        if (!CopySections(output))
+            return MapStatus::kInvalidImage;
+
+        const auto image = output.GetImage<Arch>();
+        const auto delta      = static_cast<int64_t>(reinterpret_cast<uintptr_t>(output.GetData()) - static_cast<uintptr_t>(preferredBase));
+        const auto relocation = image.GetRelocation();
+        // As the system loader, an image moved from its preferred base without relocations is refused.
+        if (delta && !relocation.IsValid())
+            return MapStatus::kUnsupportedRelocation;
+
+        if (!Relocator<Arch>(relocation, output.GetData(), output.GetSize()).ApplyParallel(delta, executor, parallelOptions))
+            return MapStatus::kUnsupportedRelocation;
+
+        // The loader reports the actual base, TLS callbacks and the relocated code expect it.
+        const auto ntHeaders                   = reinterpret_cast<NtHeaders<Arch>*>(output.GetData() + header.GetDosHeader()->e_lfanew);
+        ntHeaders->OptionalHeader.ImageBase = static_cast<decltype(ntHeaders->OptionalHeader.ImageBase)>(reinterpret_cast<uintptr_t>(output.GetData()));
+
+        auto status = BindImports(image.GetImport(), modules, count, arena, executor, parallelOptions);
+        if (status == MapStatus::kSuccess && options_.BindDelayedImports)
+            status = BindImports(image.GetDelayedImport(), modules, count, arena, executor, parallelOptions);
+        if (status != MapStatus::kSuccess)
+            return status;
+
+        if (options_.ProtectSections) {
+            status = ProtectSections(output, arena);
+            if (status != MapStatus::kSuccess)
+                return status;
+        }
+
+#if defined(_WIN32)
+        FlushInstructionCache(GetCurrentProcess(), output.GetData(), output.GetSize());
+#else
+        __builtin___clear_cache(reinterpret_cast<char*>(output.GetData()), reinterpret_cast<char*>(output.GetData() + output.GetSize()));
+#endif
+
+        if constexpr (Arch == Architecture::kNative) {
+            if (options_.RunTls) {
+                // The bounded image drops the callbacks table outside the image, every callback must be in it too.
+                const auto tls = image.GetTls();
+                if (!tls.IsValid() && image.GetHeader().template GetDirectoryDescriptor<TlsDirectoryDescriptor<Arch>>(TlsDirectoryIndex))
+                    return MapStatus::kInvalidImage;
+
+                for (const auto& callback : tls) {
+                    if (!callback.GetCallback())
+                        return MapStatus::kInvalidImage;
+                }
+
+                constexpr DWORD kProcessAttach = 1; // DLL_PROCESS_ATTACH
+                for (const auto& callback : tls)
+                    reinterpret_cast<TlsCallback>(const_cast<TlsCallback*>(callback.GetCallback()))(output.GetData(), kProcessAttach, nullptr);
+            }
+        }
+
+        return MapStatus::kSuccess;
+    }
+
+    /**
+     * @brief Copies the headers and the raw data of every section to its RVA, the rest of the fresh memory stays zero.
+     * @return false if a section lies outside the image.
+     */
+    bool CopySections(const MappedImage& output) const noexcept
+    {
+        const auto header    = file_.GetHeader();
+        const auto file      = header.template GetImageBase<const BYTE*>();
+        const auto fileSize  = header.GetImageSize();
+        const auto imageSize = output.GetSize();
+
+        auto headersSize = static_cast<size_t>(header.GetOptionalHeader()->SizeOfHeaders);
+        headersSize      = std::min({ headersSize, imageSize, fileSize ? fileSize : headersSize });
+        memcpy(output.GetData(), file, headersSize);
+
+        for (const auto& section : file_.GetSection()) {
+            const size_t virtualSize = section.Misc.VirtualSize ? section.Misc.VirtualSize : section.SizeOfRawData;
+            size_t       size        = std::min<size_t>(section.SizeOfRawData, virtualSize);
+            if (!section.PointerToRawData || !size)
+                continue;
+
+            if (section.VirtualAddress >= imageSize || (fileSize && section.PointerToRawData >= fileSize))
+                return false;
+
+            size = std::min<size_t>(size, imageSize - section.VirtualAddress);
+            if (fileSize)
+                size = std::min<size_t>(size, fileSize - section.PointerToRawData);
+
+            const auto destination = output.GetData() + section.VirtualAddress;
+            if (size >= options_.NonTemporalThreshold)
+                CopyNonTemporal(destination, file + section.PointerToRawData, size);
+            else
+                memcpy(destination, file + section.PointerToRawData, size);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Binds all IAT slots of the imports, through the exporting modules first and the fallback resolver next.
+     */
+    template<typename ImportType, typename Executor>
+    MapStatus BindImports(const ImportType& imports, const ExportModule<Arch>* modules, size_t count, Arena& arena, Executor& executor,
+                          const ParallelOptions& parallelOptions) const
+    {
+        if (!imports.IsValid())
+            return MapStatus::kSuccess;
+
+        const auto slots = ImportResolver<Arch>::GetCountOfSlots(imports);
+        if (!slots)
+            return MapStatus::kSuccess;
+
+        const auto requests = arena.Allocate<typename ImportResolver<Arch>::Request>(slots);
+        if (!requests)
+            return MapStatus::kOutOfMemory;
+
+        std::atomic<bool> bound(true);
+        ImportResolver<Arch>(modules, modules ? count : 0, requests, slots)
+            .ResolveParallel(
+                imports,
+                [&](const auto& module, const auto& function, const Function& result) {
+                    const void* address = result.IsValid() && !result.IsForwarded() ? result.GetAddress() : nullptr;
+                    if (!address && options_.ResolveImport) {
+                        const auto name = function.IsImportedByOrdinal() ? nullptr : function.GetFunctionName();
+                        address         = options_.ResolveImport(options_.Context, module.GetModuleName(), name ? name->Name : nullptr,
+                                                                 static_cast<WORD>(function.GetFunctionOrdinal()));
+                    }
+
+                    if (!address) {
+                        bound.store(false, std::memory_order_relaxed);
+                        return;
+                    }
+
+                    using Thunk               = decltype(function.GetImportAddressTable()->u1.Function);
+                    const auto addressTable    = const_cast<ImportAddressTable<Arch>*>(function.GetImportAddressTable());
+                    addressTable->u1.Function = static_cast<Thunk>(reinterpret_cast<uintptr_t>(address));
+                },
+                executor, parallelOptions);
+
+        return bound.load() ? MapStatus::kSuccess : MapStatus::kUnresolvedImport;
+    }
+
+    /**
+     * @brief Protects the headers read-only and every section by its characteristics, one call per range of pages of
+     * the same access. Sections are swept in the address order, whatever their order in the section table, and the pages
+     * shared by several of them take the union of their access while the rest of each keeps its own.
+     */
+    MapStatus ProtectSections(const MappedImage& output, Arena& arena) const
+    {
+        const auto sections = file_.GetSection();
+        const auto bounds   = arena.Allocate<ProtectionBound>(2 * (sections.size() + 1));
+        const auto ranges   = arena.Allocate<ProtectionRange>(2 * (sections.size() + 1));
+        if (!bounds || !ranges)
+            return MapStatus::kOutOfMemory;
+
+#if defined(_WIN32)
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        const size_t pageSize = systemInfo.dwPageSize;
+#else
+        const auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+        const auto alignUp = [&](size_t value) { return std::min((value + pageSize - 1) & ~(pageSize - 1), (output.GetSize() + pageSize - 1) & ~(pageSize - 1)); };
+
+        size_t count = 0;
+        const auto add = [&](size_t begin, size_t end, BYTE access) {
+            begin &= ~(pageSize - 1);
+            end = alignUp(end);
+            if (begin < end) {
+                bounds[count++] = { begin, access, true };
+                bounds[count++] = { end, access, false };
+            }
+        };
+
+        add(0, file_.GetHeader().GetOptionalHeader()->SizeOfHeaders, kRead);
+        for (const auto& section : sections) {
+            const size_t virtualSize = section.Misc.VirtualSize ? section.Misc.VirtualSize : section.SizeOfRawData;
+            if (!virtualSize || section.VirtualAddress >= output.GetSize())
+                continue;
+
+            BYTE access = 0;
+            access |= section.Characteristics & IMAGE_SCN_MEM_READ ? kRead : 0;
+            access |= section.Characteristics & IMAGE_SCN_MEM_WRITE ? kWrite : 0;
+            access |= section.Characteristics & IMAGE_SCN_MEM_EXECUTE ? kExecute : 0;
+            add(section.VirtualAddress, static_cast<size_t>(section.VirtualAddress) + virtualSize, access);
+        }
+
+        std::sort(bounds, bounds + count, [](const ProtectionBound& first, const ProtectionBound& second) { return first.Offset < second.Offset; });
+
+        // Pages between two consecutive bounds take the access of all ranges covering them, counted per access bit.
+        size_t covering = 0, merged = 0;
+        size_t active[3] = {};
+        for (size_t cx = 0; cx < count; ++cx) {
+            const auto& bound = bounds[cx];
+            if (covering && bound.Offset > bounds[cx - 1].Offset) {
+                const auto begin  = bounds[cx - 1].Offset;
+                const auto access = static_cast<BYTE>((active[0] ? kRead : 0) | (active[1] ? kWrite : 0) | (active[2] ? kExecute : 0));
+                if (merged && ranges[merged - 1].End == begin && ranges[merged - 1].Access == access)
+                    ranges[merged - 1].End = bound.Offset;
+                else
+                    ranges[merged++] = { begin, bound.Offset, access };
+            }
+
+            covering = bound.Begin ? covering + 1 : covering - 1;
+            for (size_t bit = 0; bit < 3; ++bit) {
+                if (bound.Access & (1 << bit))
+                    active[bit] = bound.Begin ? active[bit] + 1 : active[bit] - 1;
+            }
+        }
+
+        for (size_t cx = 0; cx < merged; ++cx) {
+            if (!Protect(output.GetData() + ranges[cx].Begin, ranges[cx].End - ranges[cx].Begin, ranges[cx].Access))
+                return MapStatus::kProtectionFailed;
+        }
+
+        return MapStatus::kSuccess;
+    }
+
+    /**
+     * @brief Sets access of the pages.
+     */
+    static bool Protect(BYTE* address, size_t size, BYTE access) noexcept
+    {
+#if defined(_WIN32)
+        static constexpr DWORD kProtections[] = { PAGE_NOACCESS,         PAGE_READONLY,     PAGE_READWRITE,         PAGE_READWRITE,
+                                                  PAGE_EXECUTE,          PAGE_EXECUTE_READ, PAGE_EXECUTE_READWRITE, PAGE_EXECUTE_READWRITE };
+        DWORD                   previous;
+        return VirtualProtect(address, size, kProtections[access], &previous) != FALSE;
+#else
+        const int protection = (access & kRead ? PROT_READ : 0) | (access & kWrite ? PROT_WRITE : 0) | (access & kExecute ? PROT_EXEC : 0);
+        return mprotect(address, size, protection) == 0;
+#endif
+    }
+
+    const Image<Arch> file_;
+    const MapOptions  options_;
+};
+
+/**
+ * @brief Maps the raw file image into executable memory, see ImageMapper.
+ * @param file Raw file image.
+ * @param modules Pointer to the exporting modules, may be nullptr.
+ * @param count Count of the exporting modules.
+ * @param arena Arena the scratch buffers are allocated from.
+ * @param output Receives the mapped image, released on failure.
+ * @param options Mapping options.
+ * @return Mapping status.
+ */
+template<Architecture Arch>
+MapStatus MapImage(const Image<Arch>& file, const ExportModule<Arch>* modules, size_t count, Arena& arena, MappedImage& output, const MapOptions& options = MapOptions())
+{
+    return ImageMapper<Arch>(file, options).Map(modules, count, arena, output);
+}
+
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "PeImport.h"
+#include "PeTypes.h"
+
+namespace pe_iterator {
+
+/**
+ * @brief Hash index of the imported module names providing constant time module lookup ignoring case.
+ *
+ * The index is an open-addressing hash table of the case-folded name hashes mapped to descriptor indices, built by a
+ * single walk of the descriptors. It is stored in a caller-supplied buffer, no memory is allocated.
+ * @tparam ImportType Import<Arch> or DelayedImport<Arch>.
+ */
+template<typename ImportType> class ModuleIndex {
+public:
+    using ModuleIterator = typename ImportType::ModuleIterator;
+
+    /**
+     * @brief Hash table slot.
+     */
+    struct Slot {
+        uint32_t Hash;  // Case-folded hash of the module name.
+        DWORD    Index; // Index of the import descriptor, or kEmptySlot.
+    };
+
+    // Descriptor index of the unused slot.
+    static constexpr DWORD kEmptySlot = 0xFFFFFFFF;
+
+    /**
+     * @brief Returns count of slots required to index the specified count of modules.
+     * @param countOfModules Count of imported modules.
+     */
+    static constexpr size_t GetRequiredCapacity(size_t countOfModules) noexcept
+    {
+        // Power of two with at most 50% load.
+        size_t capacity = 2;
+        while (capacity < countOfModules * 2)
+            capacity <<= 1;
+
+        return capacity;
+    }
+
+    /**
+     * @brief Returns count of the imported modules.
+     * @param imports Image imports.
+     */
+    static size_t GetCountOfModules(const ImportType& imports) noexcept
+    {
+        size_t count = 0;
+        if (imports.IsValid()) {
+            for (auto module = imports.begin(); module != imports.end(); ++module)
+                ++count;
+        }
+
+        return count;
+    }
+
+    /**
+     * @brief Initialization constructor, builds the index.
+     * @param imports Image imports, copied into the index, the image data must outlive the index.
+     * @param slots Pointer to the buffer receiving hash table slots.
+     * @param capacity Count of slots the buffer can hold, see GetRequiredCapacity. The smaller buffer leaves the index not
+     * valid and the lookups walk the descriptors.
+     */
+    ModuleIndex(const ImportType& imports, Slot* slots, size_t capacity) noexcept
+        : imports_(imports)
+        , slots_(slots)
+        , mask_(0)
+    {
+        if (!slots_ || !imports_.IsValid() || capacity < GetRequiredCapacity(GetCountOfModules(imports_)))
+            return;
+
+        size_t size = 2;
+        while (size * 2 <= capacity)
+            size *= 2;
+
+        for (size_t cx = 0; cx < size; ++cx)
+            slots_[cx] = { 0, kEmptySlot };
+
+        mask_ = size - 1;
+
+        DWORD index = 0;
+        for (auto module = imports_.begin(); module != imports_.end(); ++module, ++index) {
+            const auto name = module.GetModuleName();
+            const auto hash = name ? HashNameInsensitive(name) : 0;
+
+            auto position = hash & mask_;
+            while (slots_[position].Index != kEmptySlot)
+                position = (position + 1) & mask_;
+
+            slots_[position] = { hash, index };
+        }
+    }
+
+    /**
+     * @brief Initialization constructor, builds the index.
+     * @tparam N Count of slots in the buffer.
+     * @param imports Image imports, copied into the index, the image data must outlive the index.
+     * @param slots Buffer receiving hash table slots.
+     */
+    template<size_t N> ModuleIndex(const ImportType& imports, Slot (&slots)[N]) noexcept
+        : ModuleIndex(imports, slots, N)
+    {
+    }
+
+    /**
+     * @brief Initialization constructor, builds the index in the slots allocated from the arena.
+     * @param imports Image imports, copied into the index, the image data must outlive the index.
+     * @param arena Arena the slots are allocated from, lookups walk the descriptors if it is exhausted.
+     */
+    ModuleIndex(const ImportType& imports, Arena& arena) noexcept
+        : ModuleIndex(imports, arena, GetRequiredCapacity(GetCountOfModules(imports)))
+    {
+    }
+
+    /**
+     * @brief Returns true if the index was successfully built.
+     */
+    bool IsValid() const noexcept { return mask_ != 0; }
+
+    /**
+     * @brief Returns indexed imports.
+     */
+    const ImportType& GetImport() const noexcept { return imports_; }
+
+    /**
+     * @brief Searching imported module by name ignoring case.
+     * @param name Module name.
+     * @return Module iterator, not valid if the module is not imported.
+     */
+    ModuleIterator Find(const char* name) const noexcept
+    {
+        if (!name || !imports_.IsValid())
+            return imports_.GetModule(nullptr);
+
+        if (!IsValid()) {
+            for (auto module = imports_.begin(); module != imports_.end(); ++module) {
+                const auto moduleName = module.GetModuleName();
+                if (moduleName && CompareNamesInsensitive(moduleName, name) == 0)
+                    return module;
+            }
+
+            return imports_.GetModule(nullptr);
+        }
+
+        const auto hash  = HashNameInsensitive(name);
+        const auto first = imports_.begin().GetDirectoryDescriptor();
+        for (auto position = hash & mask_; slots_[position].Index != kEmptySlot; position = (position + 1) & mask_) {
+            if (slots_[position].Hash != hash)
+                continue;
+
+            const auto module     = imports_.GetModule(first + slots_[position].Index);
+            const auto moduleName = module.GetModuleName();
+            if (moduleName && CompareNamesInsensitive(moduleName, name) == 0)
+                return module;
+        }
+
+        return imports_.GetModule(nullptr);
+    }
+
+private:
+    ModuleIndex(const ImportType& imports, Arena& arena, size_t capacity) noexcept
+        : ModuleIndex(imports, arena.Allocate<Slot>(capacity), capacity)
+    {
+    }
+
+    const ImportType imports_;
+    Slot*            slots_;
+    size_t           mask_;
+};
+
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "PeTypes.h"
+#include <algorithm>
+#include <iterator>
+#include <thread>
+
+#if defined(__has_include)
+#if __has_include(<execution>)
+#include <execution>
+#endif
+#endif
+
+namespace pe_iterator {
+
+/**
+ * @brief Work partitioning options of the parallel engines.
+ *
+ * An executor is any callable as executor(size_t count, const Task& task) which invokes task(index) for every index
+ * in [0, count), possibly concurrently, and returns when all tasks are finished.
+ */
+struct ParallelOptions {
+    // Maximal count of tasks the work is split into.
+    static constexpr size_t kMaxTasks = 64;
+
+    size_t Threshold = 16384; // Count of work items (relocations, thunks) below which the work runs on the calling thread.
+    size_t Tasks     = 0;     // Count of tasks, 0 for the hardware concurrency.
+
+    /**
+     * @brief Returns count of tasks for the specified count of work items, 1 for the single-threaded run.
+     * @param items Count of work items.
+     */
+    size_t GetTaskCount(size_t items) const noexcept
+    {
+        if (items < Threshold)
+            return 1;
+
+        const size_t tasks = Tasks ? Tasks : std::thread::hardware_concurrency();
+        return std::max<size_t>(1, std::min<size_t>({ tasks, kMaxTasks, items }));
+    }
+};
+
+/**
+ * @brief Executor running all tasks on the calling thread.
+ */
+class SequentialExecutor {
+public:
+    template<typename Task> void operator()(size_t count, const Task& task) const
+    {
+        for (size_t index = 0; index < count; ++index)
+            task(index);
+    }
+};
+
+/**
+ * @brief Executor running tasks on up to ParallelOptions::kMaxTasks threads, including the calling one.
+ */
+class ThreadExecutor {
+public:
+    template<typename Task> void operator()(size_t count, const Task& task) const
+    {
+        const size_t workers = std::min(count, ParallelOptions::kMaxTasks);
+        const auto   run     = [&](size_t worker) {
+            for (size_t index = worker; index < count; index += workers)
+                task(index);
+        };
+
+        std::thread threads[ParallelOptions::kMaxTasks];
+        for (size_t worker = 1; worker < workers; ++worker)
+            threads[worker] = std::thread(run, worker);
+
+        if (workers)
+            run(0);
+
+        for (size_t worker = 1; worker < workers; ++worker)
+            threads[worker].join();
+    }
+};
+
+#if defined(__cpp_lib_execution)
+/**
+ * @brief Executor running tasks through a standard parallel algorithm with the specified execution policy.
+ * @tparam Policy Execution policy type, e.g. std::execution::parallel_policy.
+ */
+template<typename Policy> class PolicyExecutor {
+public:
+    /**
+     * @brief Random access iterator over task indices.
+     */
+    class Iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type        = size_t;
+        using difference_type   = ptrdiff_t;
+        using pointer           = const size_t*;
+        using reference         = size_t;
+
+        Iterator() = default;
+        explicit Iterator(size_t index) noexcept
+            : index_(index)
+        {
+        }
+
+        size_t operator*() const noexcept { return index_; }
+        size_t operator[](difference_type offset) const noexcept { return index_ + offset; }
+
+        Iterator& operator++() noexcept
+        {
+            ++index_;
+            return *this;
+        }
+
+        Iterator operator++(int) noexcept
+        {
+            const auto prev = *this;
+            ++index_;
+            return prev;
+        }
+
+        Iterator& operator--() noexcept
+        {
+            --index_;
+            return *this;
+        }
+
+        Iterator operator--(int) noexcept
+        {
+            const auto prev = *this;
+            --index_;
+            return prev;
+        }
+
+        Iterator& operator+=(difference_type offset) noexcept
+        {
+            index_ += offset;
+            return *this;
+        }
+
+        Iterator& operator-=(difference_type offset) noexcept
+        {
+            index_ -= offset;
+            return *this;
+        }
+
+        friend Iterator        operator+(Iterator it, difference_type offset) noexcept { return it += offset; }
+        friend Iterator        operator+(difference_type offset, Iterator it) noexcept { return it += offset; }
+        friend Iterator        operator-(Iterator it, difference_type offset) noexcept { return it -= offset; }
+        friend difference_type operator-(Iterator first, Iterator second) noexcept { return first.index_ - second.index_; }
+
+        bool operator==(const Iterator& other) const noexcept { return index_ == other.index_; }
+        bool operator!=(const Iterator& other) const noexcept { return index_ != other.index_; }
+        bool operator<(const Iterator& other) const noexcept { return index_ < other.index_; }
+        bool operator>(const Iterator& other) const noexcept { return index_ > other.index_; }
+        bool operator<=(const Iterator& other) const noexcept { return index_ <= other.index_; }
+        bool operator>=(const Iterator& other) const noexcept { return index_ >= other.index_; }
+
+    private:
+        size_t index_ = 0;
+    };
+
+    /**
+     * @brief Initialization constructor.
+     * @param policy Execution policy.
+     */
+    explicit PolicyExecutor(Policy policy)
+        : policy_(policy)
+    {
+    }
+
+    template<typename Task> void operator()(size_t count, const Task& task) const { std::for_each(policy_, Iterator(0), Iterator(count), task); }
+
+private:
+    Policy policy_;
+};
+#endif
+
+}
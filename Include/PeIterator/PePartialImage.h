@@ -0,0 +1,541 @@
+#pragma once
+
+#include "PeImage.h"
+#include "PeSectionIndex.h"
+#include "PeTypes.h"
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace pe_iterator {
+
+/**
+ * @brief Byte source reading the file through the handle, or the descriptor on other platforms, which is not owned.
+ *
+ * Any type providing size_t Read(uint64_t offset, void* buffer, size_t size), returning count of bytes read, can be
+ * used as PartialImage source, e.g. a network stream or an archive entry.
+ */
+class FileSource {
+public:
+#if defined(_WIN32)
+    /**
+     * @brief Initialization constructor.
+     * @param file File handle opened for reading.
+     */
+    explicit FileSource(HANDLE file) noexcept
+        : file_(file)
+    {
+    }
+#else
+    /**
+     * @brief Initialization constructor.
+     * @param file File descriptor opened for reading.
+     */
+    explicit FileSource(int file) noexcept
+        : file_(file)
+    {
+    }
+#endif
+
+    /**
+     * @brief Reads bytes at the file offset.
+     * @param offset File offset.
+     * @param buffer Pointer to the buffer receiving bytes.
+     * @param size Count of bytes to read.
+     * @return Count of bytes read.
+     */
+    size_t Read(uint64_t offset, void* buffer, size_t size) const noexcept
+    {
+        size_t total = 0;
+        while (total < size) {
+#if defined(_WIN32)
+            OVERLAPPED overlapped = {};
+            overlapped.Offset     = static_cast<DWORD>(offset + total);
+            overlapped.OffsetHigh = static_cast<DWORD>((offset + total) >> 32);
+            const auto chunk      = static_cast<DWORD>(size - total < 0x40000000 ? size - total : 0x40000000);
+            DWORD      read       = 0;
+
+            if (!ReadFile(file_, static_cast<BYTE*>(buffer) + total, chunk, &read, &overlapped) || !read)
+                break;
+#else
+            const auto read = pread(file_, static_cast<BYTE*>(buffer) + total, size - total, static_cast<off_t>(offset + total));
+            if (read < 0 && errno == EINTR)
+                continue;
+
+            if (read <= 0)
+                break;
+#endif
+
+            total += static_cast<size_t>(read);
+        }
+
+        return total;
+    }
+
+private:
+#if defined(_WIN32)
+    HANDLE file_;
+#else
+    int file_;
+#endif
+};
+
+/**
+ * @brief Raw file image loaded from a byte source by parts, fetching only the sections referenced by the requested directories.
+ *
+ * Headers are read first. Every fetch then runs in phases: the directory itself, then the tables referenced by its
+ * descriptors, then the names referenced by the tables. Sections required by a phase are sorted by file offset and
+ * read with one request per run of nearby sections. Fetched sections are packed into the caller-supplied buffer and
+ * mapped by the section index of the image, so RVAs of the sections not fetched translate to nullptr.
+ * @tparam Arch Image architecture.
+ * @tparam Source Byte source type, see FileSource.
+ * @tparam MaxSections Maximal count of sections of the image.
+ */
+template<Architecture Arch, typename Source, size_t MaxSections = 96> class PartialImage {
+public:
+    // Size of the first read, covering headers of most images.
+    static constexpr size_t kHeadersRead = 0x1000;
+
+    // Sections separated by at most this count of bytes are read by a single request.
+    static constexpr size_t kCoalesceGap = 0x1000;
+
+    /**
+     * @brief Returns mask of the directory for Fetch.
+     * @param directory Directory index.
+     */
+    static constexpr DWORD DirectoryMask(size_t directory) noexcept { return 1u << directory; }
+
+    /**
+     * @brief Initialization constructor, reads the headers.
+     * @param source Byte source, must outlive the image.
+     * @param buffer Pointer to the buffer receiving headers and fetched sections, must outlive the image.
+     * @param capacity Size of the buffer in bytes.
+     */
+    PartialImage(Source& source, BYTE* buffer, size_t capacity) noexcept
+        : source_(source)
+        , buffer_(buffer)
+        , capacity_(buffer ? capacity : 0)
+        , index_(entries_)
+    {
+        valid_ = LoadHeaders();
+    }
+
+    /**
+     * @brief Initialization constructor, reads the headers into the buffer allocated from the arena.
+     * @param source Byte source, must outlive the image.
+     * @param arena Arena the buffer is allocated from, the image is not valid if it is exhausted.
+     * @param capacity Size of the buffer in bytes.
+     */
+    PartialImage(Source& source, Arena& arena, size_t capacity) noexcept
+        : PartialImage(source, static_cast<BYTE*>(arena.Allocate(capacity)), capacity)
+    {
+    }
+
+    PartialImage(const PartialImage&)            = delete;
+    PartialImage& operator=(const PartialImage&) = delete;
+
+    /**
+     * @brief Returns true if the headers were read.
+     */
+    bool IsValid() const noexcept { return valid_; }
+
+    /**
+     * @brief Returns image over the used part of the buffer, valid while the partial image exists and until the next fetch.
+     */
+    Image<Arch> GetImage() const noexcept { return Image<Arch>(buffer_, size_, ImageType::kFile, &index_); }
+
+    /**
+     * @brief Returns image header over the used part of the buffer, valid while the partial image exists and until the next fetch.
+     */
+    Header<Arch> GetHeader() const noexcept { return Header<Arch>(buffer_, size_, ImageType::kFile, &index_); }
+
+    /**
+     * @brief Returns count of buffer bytes in use.
+     */
+    size_t GetSize() const noexcept { return size_; }
+
+    /**
+     * @brief Returns count of bytes read from the source.
+     */
+    size_t GetBytesRead() const noexcept { return bytesRead_; }
+
+    /**
+     * @brief Returns count of read requests issued to the source.
+     */
+    size_t GetReadCount() const noexcept { return readCount_; }
+
+    /**
+     * @brief Fetches sections required to parse the directories.
+     *
+     * Import, delayed import, export and TLS directories are followed to their tables and names; other directories
+     * fetch only their own range.
+     * @param directories Mask of the directories, see DirectoryMask.
+     * @return false if the buffer is too small or the source failed.
+     */
+    bool Fetch(DWORD directories) noexcept
+    {
+        if (!valid_)
+            return false;
+
+        const auto header = GetHeader();
+        for (size_t directory = 0; directory < IMAGE_NUMBEROF_DIRECTORY_ENTRIES; ++directory) {
+            const auto dataDirectory = header.GetDataDirectory(directory);
+            if ((directories & DirectoryMask(directory)) && directory != IMAGE_DIRECTORY_ENTRY_SECURITY)
+                RequireRange(dataDirectory->VirtualAddress, dataDirectory->Size);
+        }
+
+        if (!Flush())
+            return false;
+
+        if (directories & DirectoryMask(ImportDirectoryIndex))
+            RequireImportTables();
+        if (directories & DirectoryMask(DelayImportDirectoryIndex))
+            RequireDelayImportTables();
+        if (directories & DirectoryMask(ExportDirectoryIndex))
+            RequireExportTables();
+        if (directories & DirectoryMask(TlsDirectoryIndex))
+            RequireTlsTables();
+
+        if (!Flush())
+            return false;
+
+        if (directories & DirectoryMask(ImportDirectoryIndex))
+            RequireImportNames();
+        if (directories & DirectoryMask(DelayImportDirectoryIndex))
+            RequireDelayImportNames();
+        if (directories & DirectoryMask(ExportDirectoryIndex))
+            RequireExportNames();
+
+        return Flush();
+    }
+
+    /**
+     * @brief Fetches sections covering the RVA range.
+     * @param rva First RVA of the range.
+     * @param size Size of the range.
+     * @return false if the buffer is too small or the source failed.
+     */
+    bool FetchRange(RVA rva, DWORD size) noexcept
+    {
+        if (!valid_)
+            return false;
+
+        RequireRange(rva, size);
+        return Flush();
+    }
+
+private:
+    /**
+     * @brief Reads DOS header, NT headers and the section table.
+     */
+    bool LoadHeaders() noexcept
+    {
+        if (capacity_ < sizeof(DosHeader))
+            return false;
+
+        size_ = Read(0, buffer_, capacity_ < kHeadersRead ? capacity_ : kHeadersRead);
+        if (size_ < sizeof(DosHeader))
+            return false;
+
+        const auto dosHeader = reinterpret_cast<const DosHeader*>(buffer_);
+        if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE || dosHeader->e_lfanew < 0)
+            return false;
+
+        const size_t ntHeaders = static_cast<size_t>(dosHeader->e_lfanew);
+        if (!Extend(ntHeaders + sizeof(NtHeaders<Arch>)))
+            return false;
+
+        // The section table may not be read yet, so the headers are not bounded until it is.
+        const Header<Arch> header(buffer_, ImageType::kFile);
+        if (!header.IsValid() || !IsMagicValid(header))
+            return false;
+
+        sections_ = header.GetFileHeader()->NumberOfSections;
+        if (sections_ > MaxSections)
+            return false;
+
+        const auto sectionTable = reinterpret_cast<const BYTE*>(IMAGE_FIRST_SECTION(header.GetNtHeaders())) - buffer_;
+        if (!Extend(static_cast<size_t>(sectionTable) + sections_ * sizeof(SectionHeader)) || !GetHeader().IsValid())
+            return false;
+
+        // Sections are packed after the headers.
+        size_ = AlignEnd(size_);
+        index_.Reset();
+        return true;
+    }
+
+    /**
+     * @brief Returns true if the optional header magic matches the architecture.
+     */
+    static bool IsMagicValid(const Header<Arch>& header) noexcept
+    {
+        const WORD magic = Arch == Architecture::kX64 ? IMAGE_NT_OPTIONAL_HDR64_MAGIC : IMAGE_NT_OPTIONAL_HDR32_MAGIC;
+        return header.GetOptionalHeader()->Magic == magic;
+    }
+
+    /**
+     * @brief Returns the end rounded up to 16 bytes, or the capacity if the rounded end does not fit, so the size never
+     * exceeds the capacity.
+     * @param end Offset past the last used byte, at most the capacity.
+     */
+    size_t AlignEnd(size_t end) const noexcept
+    {
+        const auto aligned = (end + 15) & ~static_cast<size_t>(15);
+        return aligned <= capacity_ ? aligned : capacity_;
+    }
+
+    /**
+     * @brief Reads more headers bytes if the buffer does not cover the offset yet.
+     * @param end Offset past the last required byte.
+     */
+    bool Extend(size_t end) noexcept
+    {
+        if (end <= size_)
+            return true;
+
+        if (end > capacity_ || Read(size_, buffer_ + size_, end - size_) != end - size_)
+            return false;
+
+        size_ = end;
+        return true;
+    }
+
+    /**
+     * @brief Reads bytes from the source, counting the requests.
+     */
+    size_t Read(uint64_t offset, BYTE* buffer, size_t size) noexcept
+    {
+        ++readCount_;
+        const auto read = source_.Read(offset, buffer, size);
+        bytesRead_ += read;
+        return read;
+    }
+
+    /**
+     * @brief Returns pointer to the section header.
+     * @param section Section index in the section table.
+     */
+    const SectionHeader* GetSectionHeader(size_t section) const noexcept { return IMAGE_FIRST_SECTION(GetHeader().GetNtHeaders()) + section; }
+
+    /**
+     * @brief Returns size of the section in the file.
+     * @param section Pointer to the section header.
+     */
+    DWORD GetRawSize(const SectionHeader* section) const noexcept
+    {
+        const auto fileAlignment = GetHeader().GetOptionalHeader()->FileAlignment;
+        return (section->SizeOfRawData + (fileAlignment - 1)) & ~(fileAlignment - 1);
+    }
+
+    /**
+     * @brief Marks the section containing the RVA as required, returns its index in the section table or MaxSections.
+     * @param rva RVA.
+     */
+    size_t Require(RVA rva) noexcept
+    {
+        if (!rva)
+            return MaxSections;
+
+        for (size_t cx = 0; cx < sections_; ++cx) {
+            const auto section = GetSectionHeader(cx);
+            if (rva >= section->VirtualAddress && rva < section->VirtualAddress + GetRawSize(section)) {
+                if (state_[cx] == SectionState::kAbsent)
+                    state_[cx] = SectionState::kRequired;
+
+                return cx;
+            }
+        }
+
+        return MaxSections;
+    }
+
+    /**
+     * @brief Marks all sections intersecting the RVA range as required.
+     * @param rva First RVA of the range.
+     * @param size Size of the range.
+     */
+    void RequireRange(RVA rva, DWORD size) noexcept
+    {
+        const RVA end = rva + size;
+        if (!rva || !size || end < rva)
+            return;
+
+        while (rva < end) {
+            const auto section = Require(rva);
+            if (section == MaxSections)
+                return;
+
+            const auto header = GetSectionHeader(section);
+            rva               = header->VirtualAddress + GetRawSize(header);
+        }
+    }
+
+    /**
+     * @brief Marks sections of the null-terminated thunk array names as required.
+     * @tparam Thunk Thunk type.
+     * @param table RVA of the thunk array.
+     */
+    template<typename Thunk> void RequireThunkNames(RVA table) noexcept
+    {
+        const auto header = GetHeader();
+        for (RVA rva = table; rva; rva += sizeof(Thunk)) {
+            const auto thunk = header.template RvaToVA<const Thunk>(rva);
+            if (!thunk || !thunk->u1.AddressOfData)
+                return;
+
+            if (!IsSnapByOrdinal(thunk))
+                Require(static_cast<RVA>(thunk->u1.AddressOfData));
+        }
+    }
+
+    void RequireImportTables() noexcept
+    {
+        const auto header = GetHeader();
+        for (auto descriptor = header.template GetDirectoryDescriptor<const ImportDirectoryDescriptor>(ImportDirectoryIndex); descriptor && descriptor->Characteristics;
+             ++descriptor) {
+            Require(descriptor->Name);
+            Require(descriptor->OriginalFirstThunk);
+            Require(descriptor->FirstThunk);
+        }
+    }
+
+    void RequireImportNames() noexcept
+    {
+        const auto header = GetHeader();
+        for (auto descriptor = header.template GetDirectoryDescriptor<const ImportDirectoryDescriptor>(ImportDirectoryIndex); descriptor && descriptor->Characteristics;
+             ++descriptor)
+            RequireThunkNames<ImportLookupTable<Arch>>(descriptor->OriginalFirstThunk ? descriptor->OriginalFirstThunk : descriptor->FirstThunk);
+    }
+
+    void RequireDelayImportTables() noexcept
+    {
+        const auto header = GetHeader();
+        for (auto descriptor = header.template GetDirectoryDescriptor<const DelayImportDirectoryDescriptor>(DelayImportDirectoryIndex); descriptor && descriptor->DllNameRVA;
+             ++descriptor) {
+            Require(descriptor->DllNameRVA);
+            Require(descriptor->ImportNameTableRVA);
+            Require(descriptor->ImportAddressTableRVA);
+        }
+    }
+
+    void RequireDelayImportNames() noexcept
+    {
+        const auto header = GetHeader();
+        for (auto descriptor = header.template GetDirectoryDescriptor<const DelayImportDirectoryDescriptor>(DelayImportDirectoryIndex); descriptor && descriptor->DllNameRVA;
+             ++descriptor)
+            RequireThunkNames<ImportNameTable<Arch>>(descriptor->ImportNameTableRVA);
+    }
+
+    void RequireExportTables() noexcept
+    {
+        const auto descriptor = GetHeader().template GetDirectoryDescriptor<const ExportDirectoryDescriptor>(ExportDirectoryIndex);
+        if (!descriptor)
+            return;
+
+        Require(descriptor->Name);
+        RequireRange(descriptor->AddressOfFunctions, descriptor->NumberOfFunctions * sizeof(DWORD));
+        RequireRange(descriptor->AddressOfNames, descriptor->NumberOfNames * sizeof(DWORD));
+        RequireRange(descriptor->AddressOfNameOrdinals, descriptor->NumberOfNames * sizeof(WORD));
+    }
+
+    void RequireExportNames() noexcept
+    {
+        const auto header     = GetHeader();
+        const auto descriptor = header.template GetDirectoryDescriptor<const ExportDirectoryDescriptor>(ExportDirectoryIndex);
+        if (!descriptor)
+            return;
+
+        for (DWORD cx = 0; cx < descriptor->NumberOfNames; ++cx) {
+            const auto name = header.template RvaToVA<const DWORD>(descriptor->AddressOfNames + cx * sizeof(DWORD));
+            if (!name)
+                return;
+
+            Require(*name);
+        }
+    }
+
+    void RequireTlsTables() noexcept
+    {
+        const auto header     = GetHeader();
+        const auto descriptor = header.template GetDirectoryDescriptor<const TlsDirectoryDescriptor<Arch>>(TlsDirectoryIndex);
+        if (descriptor && descriptor->AddressOfCallBacks)
+            Require(static_cast<RVA>(descriptor->AddressOfCallBacks - header.GetOptionalHeader()->ImageBase));
+    }
+
+    /**
+     * @brief Reads all required sections, coalescing nearby ones into a single read.
+     * @return false if the buffer is too small or the source failed.
+     */
+    bool Flush() noexcept
+    {
+        // Required sections sorted by file offset.
+        size_t order[MaxSections], count = 0;
+        for (size_t cx = 0; cx < sections_; ++cx) {
+            if (state_[cx] != SectionState::kRequired)
+                continue;
+
+            auto position = count++;
+            for (; position && GetSectionHeader(order[position - 1])->PointerToRawData > GetSectionHeader(cx)->PointerToRawData; --position)
+                order[position] = order[position - 1];
+
+            order[position] = cx;
+        }
+
+        for (size_t first = 0; first < count;) {
+            // Extend the run while the next section starts close to the end of the previous one.
+            const uint64_t begin = GetSectionHeader(order[first])->PointerToRawData;
+            uint64_t       end   = begin + GetRawSize(GetSectionHeader(order[first]));
+
+            size_t last = first + 1;
+            for (; last < count; ++last) {
+                const auto section = GetSectionHeader(order[last]);
+                if (section->PointerToRawData > end + kCoalesceGap)
+                    break;
+
+                if (section->PointerToRawData + static_cast<uint64_t>(GetRawSize(section)) > end)
+                    end = section->PointerToRawData + static_cast<uint64_t>(GetRawSize(section));
+            }
+
+            const auto length = static_cast<size_t>(end - begin);
+            if (size_ > capacity_ || length > capacity_ - size_)
+                return false;
+
+            // The file may end before the aligned raw size.
+            const auto read = Read(begin, buffer_ + size_, length);
+            memset(buffer_ + size_ + read, 0, length - read);
+
+            for (size_t cx = first; cx < last; ++cx) {
+                const auto section = GetSectionHeader(order[cx]);
+                const auto offset  = static_cast<DWORD>(size_ + (section->PointerToRawData - begin));
+                if (!index_.Add({ section->VirtualAddress, section->VirtualAddress + GetRawSize(section), offset - section->VirtualAddress }))
+                    return false;
+
+                state_[order[cx]] = SectionState::kFetched;
+            }
+
+            size_ = AlignEnd(size_ + length);
+            first = last;
+        }
+
+        return true;
+    }
+
+    enum class SectionState : BYTE { kAbsent, kRequired, kFetched };
+
+    Source&             source_;
+    BYTE*               buffer_;
+    size_t              capacity_;
+    size_t              size_               = 0;
+    size_t              bytesRead_          = 0;
+    size_t              readCount_          = 0;
+    size_t              sections_           = 0;
+    bool                valid_              = false;
+    SectionState        state_[MaxSections] = {};
+    SectionIndex::Entry entries_[MaxSections];
+    SectionIndex        index_;
+};
+
+}
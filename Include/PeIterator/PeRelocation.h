@@ -1,7 +1,9 @@
 #pragma once
 
 #include "PeHeader.h"
+#include "PeInstrumentation.h"
 #include "PeTypes.h"
+#include <type_traits>
 
 namespace pe_iterator {
 
@@ -13,17 +15,22 @@ template<Architecture Arch> class Relocation {
 public:
     /**
      * @brief Relocations iterator.
+     *
+     * Iterators hold a copy of the header, the block pointer and the indices: trivially copyable and independent of the
+     * Relocation, so they can be stored and handed to other threads while the image data exists.
      */
     class RelocationIterator {
     public:
         /**
          * @brief Initialization constructor.
+         * @param header Image header.
          * @param directoryDescriptor Pointer to the relocation block.
          * @param count Count of the relocations in the relocation block.
          * @param index The base index of the relocations from which the iteration will begin. By default, 0.
          */
-        RelocationIterator(const BaseRelocationDirectoryDescriptor* directoryDescriptor, size_t count, size_t index = 0)
-            : directoryDescriptor_(directoryDescriptor)
+        RelocationIterator(const Header<Arch>& header, const BaseRelocationDirectoryDescriptor* directoryDescriptor, size_t count, size_t index = 0) noexcept
+            : header_(header)
+            , directoryDescriptor_(directoryDescriptor)
             , count_(count)
             , index_(index) {};
 
@@ -41,10 +48,15 @@ public:
             return &relocsList[index_];
         }
 
+        /**
+         * @brief Returns RVA to fix of the current relocation.
+         */
+        RVA GetRva() const { return directoryDescriptor_->VirtualAddress + GetRelocation()->offset; }
+
         /**
          * @brief Returns address to fix of the current relocation.
          */
-        const BYTE* GetAddress() const { return reinterpret_cast<const BYTE*>(directoryDescriptor_) + GetRelocation()->offset; }
+        const BYTE* GetAddress() const { return header_.template RvaToVA<BYTE>(GetRva()); }
 
         /**
          * @brief Returns true if the pointer is valid and the iteration has not gone beyond.
@@ -53,6 +65,7 @@ public:
 
         RelocationIterator& operator++()
         {
+            PE_ITERATOR_PROBE(kRelocationVisited, 1);
             ++index_;
             return *this;
         }
@@ -60,20 +73,21 @@ public:
         RelocationIterator operator++(int)
         {
             auto prev = *this;
-            ++index_;
+            operator++();
             return prev;
         }
 
         // Compare operators.
         bool operator==(const RelocationIterator& entry) const noexcept { return GetIndex() == entry.GetIndex(); }
         bool operator!=(const RelocationIterator& entry) const { return GetIndex() != entry.GetIndex(); }
-        bool operator==(IteratorEnd) const { return IsValid(); }
+        bool operator==(IteratorEnd) const { return !IsValid(); }
         bool operator!=(IteratorEnd) const { return IsValid(); }
 
         const RelocationIterator& operator*() const { return *this; }
         RelocationIterator&       operator*() { return *this; }
 
     private:
+        Header<Arch>                             header_;
         const BaseRelocationDirectoryDescriptor* directoryDescriptor_;
         size_t                                   count_;
         size_t                                   index_;
@@ -81,15 +95,22 @@ public:
 
     /**
      * @brief Relocation block iterator.
+     *
+     * The state is a copy of the header, the block pointer and the directory end, so iterators do not refer to the
+     * Relocation. As by the loader, blocks are walked up to the directory size or the terminating block.
      */
     class BlockIterator {
     public:
         /**
          * @brief Initialization constructor.
+         * @param header Image header.
          * @param directoryDescriptor Pointer to the relocation directory descriptor.
+         * @param directoryEnd Pointer past the relocation directory.
          */
-        explicit BlockIterator(const BaseRelocationDirectoryDescriptor* directoryDescriptor)
-            : directoryDescriptor_(directoryDescriptor) {};
+        BlockIterator(const Header<Arch>& header, const BaseRelocationDirectoryDescriptor* directoryDescriptor, const BYTE* directoryEnd) noexcept
+            : header_(header)
+            , directoryDescriptor_(directoryDescriptor)
+            , directoryEnd_(directoryEnd) {};
 
         /**
          * @brief Returns pointer to the current relocation block.
@@ -102,14 +123,19 @@ public:
         size_t GetRelocationsCount() const noexcept { return (directoryDescriptor_->SizeOfBlock - sizeof(*directoryDescriptor_)) / sizeof(IMAGE_RELOC); }
 
         /**
-         * @brief Returns true if the current relaxation block is valid.
+         * @brief Returns true if the current relocation block is valid and begins within the directory.
          */
-        bool IsValid() const noexcept { return directoryDescriptor_ && directoryDescriptor_->SizeOfBlock && directoryDescriptor_->VirtualAddress; }
+        bool IsValid() const noexcept
+        {
+            return directoryDescriptor_ && reinterpret_cast<const BYTE*>(directoryDescriptor_) < directoryEnd_
+                && static_cast<size_t>(directoryEnd_ - reinterpret_cast<const BYTE*>(directoryDescriptor_)) >= sizeof(*directoryDescriptor_)
+                && directoryDescriptor_->SizeOfBlock && directoryDescriptor_->VirtualAddress;
+        }
 
         /**
          * @brief Returns an iterator pointing to the beginning of relocations in the current reloc block.
          */
-        RelocationIterator begin() const noexcept { return RelocationIterator(directoryDescriptor_, GetRelocationsCount()); }
+        RelocationIterator begin() const noexcept { return RelocationIterator(header_, directoryDescriptor_, GetRelocationsCount()); }
 
         /**
          * @brief Returns an iterator pointing to the end of the relocations in the current reloc block.
@@ -118,6 +144,7 @@ public:
 
         BlockIterator& operator++()
         {
+            PE_ITERATOR_PROBE(kRelocationBlockVisited, 1);
             directoryDescriptor_ = reinterpret_cast<const BaseRelocationDirectoryDescriptor*>(reinterpret_cast<const BYTE*>(directoryDescriptor_)
                                                                                               + directoryDescriptor_->SizeOfBlock);
             return *this;
@@ -132,14 +159,16 @@ public:
 
         bool operator==(const BlockIterator& other) const noexcept { return directoryDescriptor_ == other.directoryDescriptor_; }
         bool operator!=(const BlockIterator& other) const noexcept { return directoryDescriptor_ != other.directoryDescriptor_; }
-        bool operator==(const IteratorEnd) const { return IsValid(); }
-        bool operator!=(const IteratorEnd) const { return !IsValid(); }
+        bool operator==(const IteratorEnd) const { return !IsValid(); }
+        bool operator!=(const IteratorEnd) const { return IsValid(); }
 
         const BlockIterator& operator*() const { return *this; }
         BlockIterator&       operator*() { return *this; }
 
     private:
+        Header<Arch>                             header_;
         const BaseRelocationDirectoryDescriptor* directoryDescriptor_;
+        const BYTE*                              directoryEnd_;
     };
 
     /**
@@ -148,8 +177,10 @@ public:
      */
     explicit Relocation(const Header<Arch>& header)
         : header_(header)
-        , directoryDescriptor_(header_.GetDirectoryDescriptor<BaseRelocationDirectoryDescriptor>(BaseRelocationDirectoryIndex))
+        , directoryDescriptor_(header.template GetDirectoryDescriptor<BaseRelocationDirectoryDescriptor>(BaseRelocationDirectoryIndex))
+        , directoryEnd_(directoryDescriptor_ ? reinterpret_cast<const BYTE*>(directoryDescriptor_) + header.GetDataDirectory(BaseRelocationDirectoryIndex)->Size : nullptr)
     {
+        directoryDescriptor_ = Validate(header, directoryDescriptor_, directoryEnd_);
     }
 
     /**
@@ -165,7 +196,7 @@ public:
     /**
      * @brief Returns an iterator pointing to the beginning of the blocks.
      */
-    BlockIterator begin() const noexcept { return BlockIterator(directoryDescriptor_); }
+    BlockIterator begin() const noexcept { return BlockIterator(header_, directoryDescriptor_, directoryEnd_); }
 
     /**
      * @brief Returns an iterator pointing to the end of blocks.
@@ -173,8 +204,41 @@ public:
     IteratorEnd end() const noexcept { return {}; }
 
 private:
-    const Header<Arch>&                      header_;
+    /**
+     * @brief Validates relocation blocks of the bounded image up to the directory end or the terminating block, unbounded
+     * images are not checked.
+     * @param header Image header.
+     * @param directoryDescriptor Pointer to the first relocation block.
+     * @param directoryEnd Pointer past the relocation directory.
+     * @return The descriptor if all blocks are valid and lie within the directory, or nullptr.
+     */
+    static const BaseRelocationDirectoryDescriptor* Validate(const Header<Arch>& header, const BaseRelocationDirectoryDescriptor* directoryDescriptor,
+                                                             const BYTE* directoryEnd) noexcept
+    {
+        if (!directoryDescriptor || !header.GetImageSize())
+            return directoryDescriptor;
+
+        for (BlockIterator block(header, directoryDescriptor, directoryEnd);; ++block) {
+            if (reinterpret_cast<const BYTE*>(block.GetBlock()) < directoryEnd && !header.IsRangeValid(block.GetBlock(), sizeof(BaseRelocationDirectoryDescriptor)))
+                return nullptr;
+
+            if (!block.IsValid())
+                return directoryDescriptor;
+
+            const auto available = static_cast<size_t>(directoryEnd - reinterpret_cast<const BYTE*>(block.GetBlock()));
+            if (block.GetBlock()->SizeOfBlock < sizeof(BaseRelocationDirectoryDescriptor) || block.GetBlock()->SizeOfBlock > available
+                || !header.IsRangeValid(block.GetBlock(), block.GetBlock()->SizeOfBlock))
+                return nullptr;
+        }
+    }
+
+    const Header<Arch>                       header_;
     const BaseRelocationDirectoryDescriptor* directoryDescriptor_;
+    const BYTE*                              directoryEnd_;
+
+    static_assert(std::is_trivially_copyable<RelocationIterator>::value && std::is_trivially_copyable<BlockIterator>::value, "Iterators are trivially copyable");
+    static_assert(sizeof(RelocationIterator) == sizeof(Header<Arch>) + 3 * sizeof(void*) && sizeof(BlockIterator) == sizeof(Header<Arch>) + 2 * sizeof(void*),
+                  "Iterators hold the header copy and their position only");
 };
 
 }
\ No newline at end of file
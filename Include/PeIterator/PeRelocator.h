@@ -0,0 +1,269 @@
+#pragma once
+
+#include "PeParallel.h"
+#include "PeRelocation.h"
+#include "PeTypes.h"
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+#if defined(PE_ITERATOR_SSE2) || defined(PE_ITERATOR_AVX2)
+#include <immintrin.h>
+#endif
+
+namespace pe_iterator {
+
+/**
+ * @brief Applies base relocations to an image mapped by sections.
+ *
+ * Relocation entries are decoded directly from the WORD array of every block. With SSE2/AVX2 available, 8/16 entries
+ * are decoded at once and groups consisting only of the native pointer-sized type (IMAGE_REL_BASED_DIR64 for x64,
+ * IMAGE_REL_BASED_HIGHLOW for x86) are patched without per-entry type dispatch; other groups use the scalar path.
+ * Blocks are walked within the relocation directory size, and relocations are bounded by the image size: blocks of
+ * pages ending past it are applied by the scalar path, which checks every relocation against the image end.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class Relocator {
+public:
+    using BlockIterator = typename Relocation<Arch>::BlockIterator;
+
+    // Relocation type of the image pointers.
+    static constexpr WORD kNativeType = Arch == Architecture::kX64 ? IMAGE_REL_BASED_DIR64 : IMAGE_REL_BASED_HIGHLOW;
+
+    /**
+     * @brief Initialization constructor.
+     * @param relocation Image relocations, copied into the relocator, the image data must outlive the relocator.
+     * @param imageBase Pointer to the writable image with sections placed at their RVAs.
+     * @param imageSize Size of the writable image in bytes.
+     */
+    Relocator(const Relocation<Arch>& relocation, BYTE* imageBase, size_t imageSize) noexcept
+        : relocation_(relocation)
+        , imageBase_(imageBase)
+        , imageSize_(imageSize)
+    {
+    }
+
+    /**
+     * @brief Applies relocations of all blocks.
+     * @param delta Difference between the actual and the preferred image base.
+     * @return false if an unsupported relocation type was found.
+     */
+    bool Apply(int64_t delta) const
+    {
+        if (!delta || !relocation_.IsValid())
+            return true;
+
+        for (const auto& block : relocation_) {
+            if (!ApplyBlock(block.GetBlock(), delta))
+                return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Applies relocations of all blocks, splitting blocks across tasks of the executor.
+     *
+     * Every task receives a contiguous range of blocks with about the same count of relocations. A block covers a
+     * single page, so tasks never patch the same page except for values straddling the boundary of two ranges.
+     * @tparam Executor Callable as executor(size_t count, const Task& task), see ParallelOptions.
+     * @param delta Difference between the actual and the preferred image base.
+     * @param executor Executor running the tasks.
+     * @param options Work partitioning options, small images are relocated on the calling thread.
+     * @return false if an unsupported relocation type was found.
+     */
+    template<typename Executor> bool ApplyParallel(int64_t delta, Executor&& executor, const ParallelOptions& options = ParallelOptions()) const
+    {
+        if (!delta || !relocation_.IsValid())
+            return true;
+
+        size_t count = 0;
+        for (const auto& block : relocation_)
+            count += block.GetRelocationsCount();
+
+        const auto tasks = options.GetTaskCount(count);
+        if (tasks <= 1)
+            return Apply(delta);
+
+        // Boundaries of the block ranges, the last one points past the final block.
+        const BaseRelocationDirectoryDescriptor* ranges[ParallelOptions::kMaxTasks + 1];
+
+        size_t ranged = 0, accumulated = 0;
+        for (const auto& block : relocation_) {
+            if (ranged < tasks && accumulated >= ranged * count / tasks)
+                ranges[ranged++] = block.GetBlock();
+
+            accumulated += block.GetRelocationsCount();
+            ranges[ranged] = reinterpret_cast<const BaseRelocationDirectoryDescriptor*>(reinterpret_cast<const BYTE*>(block.GetBlock())
+                                                                                        + block.GetBlock()->SizeOfBlock);
+        }
+
+        std::atomic<bool> succeeded(true);
+        executor(ranged, [&](size_t task) {
+            for (auto block = ranges[task]; block != ranges[task + 1];
+                 block      = reinterpret_cast<const BaseRelocationDirectoryDescriptor*>(reinterpret_cast<const BYTE*>(block) + block->SizeOfBlock)) {
+                if (!ApplyBlock(block, delta))
+                    succeeded.store(false, std::memory_order_relaxed);
+            }
+        });
+
+        return succeeded.load();
+    }
+
+    /**
+     * @brief Applies relocations of the single block.
+     * @param block Pointer to the relocation block.
+     * @param delta Difference between the actual and the preferred image base.
+     * @return false if an unsupported relocation type was found or a relocation lies outside the image.
+     */
+    bool ApplyBlock(const BaseRelocationDirectoryDescriptor* block, int64_t delta) const
+    {
+        if (block->VirtualAddress >= imageSize_)
+            return false;
+
+        const auto page      = imageBase_ + block->VirtualAddress;
+        const auto entries   = reinterpret_cast<const WORD*>(block + 1);
+        const auto count     = (block->SizeOfBlock - sizeof(*block)) / sizeof(WORD);
+        const auto available = imageSize_ - block->VirtualAddress;
+
+        // Pages ending past the image leave every relocation to the bounds-checked scalar path.
+        size_t index = 0;
+        if (available < kPageExtent)
+            return ApplyEntries(page, available, entries, index, count, count, delta);
+
+#if defined(PE_ITERATOR_AVX2)
+        const auto nativeType16 = _mm256_set1_epi16(kNativeType);
+        const auto offsetMask16 = _mm256_set1_epi16(0x0FFF);
+        while (index + 16 <= count) {
+            const auto words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(entries + index));
+            const auto match = _mm256_cmpeq_epi16(_mm256_srli_epi16(words, 12), nativeType16);
+
+            if (_mm256_movemask_epi8(match) == -1) {
+                alignas(32) WORD offsets[16];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(offsets), _mm256_and_si256(words, offsetMask16));
+                PatchNative<16>(page, offsets, delta);
+                index += 16;
+            } else if (!ApplyEntries(page, available, entries, index, index + 16, count, delta)) {
+                return false;
+            }
+        }
+#endif
+#if defined(PE_ITERATOR_SSE2)
+        const auto nativeType8 = _mm_set1_epi16(kNativeType);
+        const auto offsetMask8 = _mm_set1_epi16(0x0FFF);
+        while (index + 8 <= count) {
+            const auto words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(entries + index));
+            const auto match = _mm_cmpeq_epi16(_mm_srli_epi16(words, 12), nativeType8);
+
+            if (_mm_movemask_epi8(match) == 0xFFFF) {
+                alignas(16) WORD offsets[8];
+                _mm_store_si128(reinterpret_cast<__m128i*>(offsets), _mm_and_si128(words, offsetMask8));
+                PatchNative<8>(page, offsets, delta);
+                index += 8;
+            } else if (!ApplyEntries(page, available, entries, index, index + 8, count, delta)) {
+                return false;
+            }
+        }
+#endif
+        return ApplyEntries(page, available, entries, index, count, count, delta);
+    }
+
+private:
+    // Integer type of the image pointers.
+    using ImageWord = typename std::conditional<Arch == Architecture::kX64, ULONGLONG, DWORD>::type;
+
+    // Bytes past the page start any relocation of the block may patch, the largest offset plus the widest fixup.
+    static constexpr size_t kPageExtent = 0x0FFF + sizeof(ULONGLONG);
+
+    /**
+     * @brief Patches a group of native pointer-sized relocations.
+     * @tparam N Count of relocations in the group.
+     * @param page Pointer to the relocated page.
+     * @param offsets Offsets of the relocations in the page.
+     * @param delta Difference between the actual and the preferred image base.
+     */
+    template<size_t N> static void PatchNative(BYTE* page, const WORD* offsets, int64_t delta) noexcept
+    {
+        for (size_t cx = 0; cx < N; ++cx)
+            Patch<ImageWord>(page + offsets[cx], static_cast<ImageWord>(delta));
+    }
+
+    /**
+     * @brief Adds value to the possibly unaligned integer.
+     */
+    template<typename T> static void Patch(BYTE* target, T value) noexcept
+    {
+        T current;
+        memcpy(&current, target, sizeof(current));
+        current = static_cast<T>(current + value);
+        memcpy(target, &current, sizeof(current));
+    }
+
+    /**
+     * @brief Applies relocations one by one.
+     * @param page Pointer to the relocated page.
+     * @param available Count of image bytes from the page start to the image end.
+     * @param entries Pointer to the block entries.
+     * @param index Index of the first entry, receives index past the last applied entry.
+     * @param end Index past the last entry to apply.
+     * @param count Count of entries in the block.
+     * @param delta Difference between the actual and the preferred image base.
+     * @return false if an unsupported relocation type was found or a relocation lies outside the image.
+     */
+    static bool ApplyEntries(BYTE* page, size_t available, const WORD* entries, size_t& index, size_t end, size_t count, int64_t delta) noexcept
+    {
+        for (; index < end; ++index) {
+            const auto offset = static_cast<size_t>(entries[index] & 0x0FFF);
+            const auto type   = entries[index] >> 12;
+            const auto target = page + offset;
+
+            if (type != IMAGE_REL_BASED_ABSOLUTE && offset + GetFixupSize(type) > available)
+                return false;
+
+            switch (type) {
+            case IMAGE_REL_BASED_ABSOLUTE: break;
+            case IMAGE_REL_BASED_HIGHLOW: Patch<DWORD>(target, static_cast<DWORD>(delta)); break;
+            case IMAGE_REL_BASED_DIR64: Patch<ULONGLONG>(target, static_cast<ULONGLONG>(delta)); break;
+            case IMAGE_REL_BASED_HIGH: Patch<WORD>(target, static_cast<WORD>(static_cast<DWORD>(delta) >> 16)); break;
+            case IMAGE_REL_BASED_LOW: Patch<WORD>(target, static_cast<WORD>(delta)); break;
+            case IMAGE_REL_BASED_HIGHADJ: {
+                // The low half of the adjusted value is stored in the next entry.
+                if (index + 1 >= count)
+                    return false;
+
+                WORD high;
+                memcpy(&high, target, sizeof(high));
+
+                auto value = static_cast<int32_t>((static_cast<uint32_t>(high) << 16) + static_cast<int16_t>(entries[++index]));
+                value      = static_cast<int32_t>(static_cast<uint32_t>(value) + static_cast<uint32_t>(delta) + 0x8000);
+                high       = static_cast<WORD>(static_cast<uint32_t>(value) >> 16);
+                memcpy(target, &high, sizeof(high));
+                break;
+            }
+            default: return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Returns count of bytes patched by the relocation type, the widest fixup for unsupported types.
+     */
+    static constexpr size_t GetFixupSize(unsigned type) noexcept
+    {
+        switch (type) {
+        case IMAGE_REL_BASED_HIGHLOW: return sizeof(DWORD);
+        case IMAGE_REL_BASED_HIGH:
+        case IMAGE_REL_BASED_LOW:
+        case IMAGE_REL_BASED_HIGHADJ: return sizeof(WORD);
+        default: return sizeof(ULONGLONG);
+        }
+    }
+
+    const Relocation<Arch> relocation_;
+    BYTE*                  imageBase_;
+    size_t                 imageSize_;
+};
+
+}
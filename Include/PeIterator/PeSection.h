@@ -1,6 +1,9 @@
 #pragma once
 
+#include "PeInstrumentation.h"
 #include "PeTypes.h"
+#include <cstddef>
+#include <iterator>
 
 namespace pe_iterator {
 
@@ -9,8 +12,28 @@ namespace pe_iterator {
  */
 class Section {
 public:
+    /**
+     * @brief Random access iterator over the section headers.
+     */
     class Iterator {
     public:
+        using iterator_category = std::random_access_iterator_tag;
+        using iterator_concept  = std::random_access_iterator_tag;
+        using value_type        = SectionHeader;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const SectionHeader*;
+        using reference         = const SectionHeader&;
+
+        /**
+         * @brief Constructs an empty iterator.
+         */
+        Iterator() noexcept
+            : section_(nullptr)
+            , count_(0)
+            , index_(0)
+        {
+        }
+
         /**
          * @brief Initialization constructor.
          * @param section Pointer to the header of the first section.
@@ -36,6 +59,7 @@ public:
 
         Iterator& operator++() noexcept
         {
+            PE_ITERATOR_PROBE(kSectionVisited, 1);
             ++index_;
             return *this;
         }
@@ -43,19 +67,54 @@ public:
         Iterator operator++(int) noexcept
         {
             const auto prev = *this;
-            ++index_;
+            operator++();
+            return prev;
+        }
+
+        Iterator& operator--() noexcept
+        {
+            --index_;
+            return *this;
+        }
+
+        Iterator operator--(int) noexcept
+        {
+            const auto prev = *this;
+            --index_;
             return prev;
         }
 
+        Iterator& operator+=(difference_type offset) noexcept
+        {
+            index_ += offset;
+            return *this;
+        }
+
+        Iterator& operator-=(difference_type offset) noexcept
+        {
+            index_ -= offset;
+            return *this;
+        }
+
+        Iterator        operator+(difference_type offset) const noexcept { return Iterator(section_, count_, index_ + offset); }
+        Iterator        operator-(difference_type offset) const noexcept { return Iterator(section_, count_, index_ - offset); }
+        difference_type operator-(const Iterator& other) const noexcept { return static_cast<difference_type>(index_ - other.index_); }
+        friend Iterator operator+(difference_type offset, const Iterator& iterator) noexcept { return iterator + offset; }
+
         // Compare operators
         bool operator==(const Iterator& other) const noexcept { return index_ == other.index_; }
         bool operator!=(const Iterator& other) const noexcept { return index_ != other.index_; }
+        bool operator<(const Iterator& other) const noexcept { return index_ < other.index_; }
+        bool operator>(const Iterator& other) const noexcept { return index_ > other.index_; }
+        bool operator<=(const Iterator& other) const noexcept { return index_ <= other.index_; }
+        bool operator>=(const Iterator& other) const noexcept { return index_ >= other.index_; }
         bool operator==(IteratorEnd) const { return !IsValid(); }
         bool operator!=(IteratorEnd) const { return IsValid(); }
 
         // Access operators.
         const SectionHeader& operator*() const { return section_[index_]; }
         const SectionHeader* operator->() const { return &section_[index_]; }
+        const SectionHeader& operator[](difference_type offset) const { return section_[index_ + offset]; }
 
     private:
         const SectionHeader* section_;
@@ -72,7 +131,6 @@ public:
         : section_(section)
         , count_(count)
     {
-        Iterator it(section, count);
     }
 
     /**
@@ -96,9 +154,14 @@ public:
     Iterator begin() const noexcept { return { section_, count_ }; }
 
     /**
-     * @brief Returns an iterator pointing to the final section.
+     * @brief Returns an iterator pointing past the final section.
+     */
+    Iterator end() const noexcept { return { section_, count_, size() }; }
+
+    /**
+     * @brief Returns count of the iterated sections, 0 if the section pointer is nullptr.
      */
-    IteratorEnd end() const noexcept { return {}; }
+    size_t size() const noexcept { return section_ ? count_ : 0; }
 
 private:
     const SectionHeader* section_;
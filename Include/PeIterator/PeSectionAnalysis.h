@@ -0,0 +1,348 @@
+#pragma once
+
+#include "PeFingerprint.h"
+#include "PeImage.h"
+#include "PeParallel.h"
+#include "PeTypes.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(PE_ITERATOR_SSE2) || defined(PE_ITERATOR_AVX2)
+#include <immintrin.h>
+#endif
+
+namespace pe_iterator {
+
+/**
+ * @brief Bytes of the section covered by the analysis.
+ */
+enum class SectionExtent : BYTE {
+    kRaw,    // Raw data: SizeOfRawData bytes of the file, or the part of them the loader maps within VirtualSize.
+    kVirtual // Loaded data: VirtualSize bytes, the part not backed by the raw data of the file counted as zeros.
+};
+
+/**
+ * @brief Options of the section analysis.
+ */
+struct SectionAnalysisOptions {
+    SectionExtent Extent = SectionExtent::kRaw;
+    bool          Hash   = true;  // Computes 64-bit FNV-1a of the bytes.
+    bool          Md5    = false; // Computes MD5 of the bytes.
+};
+
+/**
+ * @brief Range of the section bytes within the image.
+ */
+struct SectionRange {
+    const BYTE* Data;     // First byte, or nullptr if no byte lies within the image.
+    size_t      Size;     // Count of bytes read from the image.
+    size_t      ZeroFill; // Count of zero bytes following them, not present in the raw file.
+};
+
+/**
+ * @brief Byte statistics of one section.
+ */
+struct SectionAnalysis {
+    const SectionHeader* Section;
+    SectionRange         Range;
+    uint32_t             Histogram[256];
+    double               Entropy; // Shannon entropy in bits per byte, 0 for the empty range.
+    uint64_t             Hash;    // 64-bit FNV-1a, or 0 if not requested.
+    Md5Digest            Md5;     // MD5, or all zero if not requested.
+};
+
+/**
+ * @brief Adds counts of the bytes to the histogram.
+ *
+ * Bytes are spread over four interleaved tables to break the store-to-load dependency of repeated values. With
+ * SSE2/AVX2 available, 16/32 bytes are loaded at once and all-zero blocks, common in section padding, are counted
+ * without touching the tables.
+ * @param data Pointer to the bytes.
+ * @param size Count of bytes.
+ * @param histogram Histogram to add to.
+ */
+inline void CountBytes(const BYTE* data, size_t size, uint32_t (&histogram)[256]) noexcept
+{
+    uint32_t tables[4][256] = {};
+    size_t   zeros = 0, index = 0;
+
+    const auto countWord = [&](uint64_t word) {
+        for (size_t cx = 0; cx < 8; cx += 4, word >>= 32) {
+            ++tables[0][word & 0xFF];
+            ++tables[1][(word >> 8) & 0xFF];
+            ++tables[2][(word >> 16) & 0xFF];
+            ++tables[3][(word >> 24) & 0xFF];
+        }
+    };
+
+#if defined(PE_ITERATOR_AVX2)
+    for (; index + 32 <= size; index += 32) {
+        const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + index));
+        if (_mm256_testz_si256(block, block)) {
+            zeros += 32;
+            continue;
+        }
+
+        uint64_t words[4];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(words), block);
+        for (const auto word : words)
+            countWord(word);
+    }
+#endif
+
+#if defined(PE_ITERATOR_SSE2) || defined(PE_ITERATOR_AVX2)
+    const auto zero = _mm_setzero_si128();
+    for (; index + 16 <= size; index += 16) {
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + index));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero)) == 0xFFFF) {
+            zeros += 16;
+            continue;
+        }
+
+        uint64_t words[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(words), block);
+        countWord(words[0]);
+        countWord(words[1]);
+    }
+#endif
+
+    for (; index + 8 <= size; index += 8) {
+        uint64_t word;
+        memcpy(&word, data + index, sizeof(word));
+        if (word)
+            countWord(word);
+        else
+            zeros += 8;
+    }
+
+    for (; index < size; ++index)
+        ++tables[0][data[index]];
+
+    histogram[0] += static_cast<uint32_t>(zeros);
+    for (size_t value = 0; value < 256; ++value)
+        histogram[value] += tables[0][value] + tables[1][value] + tables[2][value] + tables[3][value];
+}
+
+/**
+ * @brief Returns Shannon entropy of the histogram in bits per byte.
+ * @param histogram Byte histogram.
+ */
+inline double ComputeEntropy(const uint32_t (&histogram)[256]) noexcept
+{
+    uint64_t total = 0;
+    for (const auto count : histogram)
+        total += count;
+
+    if (!total)
+        return 0.0;
+
+    double entropy = 0.0;
+    for (const auto count : histogram) {
+        if (count) {
+            const auto probability = static_cast<double>(count) / static_cast<double>(total);
+            entropy -= probability * std::log2(probability);
+        }
+    }
+
+    return entropy;
+}
+
+/**
+ * @brief Computes byte histograms, entropy and hashes of the image sections.
+ *
+ * Section ranges are derived from the header for the image type: raw files are read at PointerToRawData, modules at
+ * VirtualAddress, both clamped to the bounded image size. With SectionExtent::kVirtual sections of raw files also end
+ * at SizeOfImage, as when mapped, and both image types yield the same results for the same image.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class SectionAnalyzer {
+public:
+    // Count of section bytes below which ParallelOptions run the analysis on the calling thread by default.
+    static constexpr size_t kParallelThreshold = 1024 * 1024;
+
+    /**
+     * @brief Initialization constructor.
+     * @param image Image, its data must outlive the analyzer.
+     * @param options Analysis options.
+     */
+    explicit SectionAnalyzer(const Image<Arch>& image, const SectionAnalysisOptions& options = SectionAnalysisOptions()) noexcept
+        : header_(image.GetHeader())
+        , sections_(image.GetSection())
+        , options_(options)
+    {
+    }
+
+    /**
+     * @brief Returns count of sections, the capacity the results need.
+     */
+    size_t GetCount() const noexcept { return header_.IsValid() ? sections_.size() : 0; }
+
+    /**
+     * @brief Returns range of the section bytes within the image.
+     * @param section Section header of the image.
+     */
+    SectionRange GetRange(const SectionHeader& section) const noexcept
+    {
+        const size_t rawSize     = section.PointerToRawData ? section.SizeOfRawData : 0;
+        const size_t virtualSize = section.Misc.VirtualSize ? section.Misc.VirtualSize : section.SizeOfRawData;
+        const auto   module      = header_.GetImageType() == ImageType::kModule;
+        const size_t offset      = module ? section.VirtualAddress : section.PointerToRawData;
+
+        // The loader maps raw data up to VirtualSize only, the rest of the section is zero-initialized.
+        size_t size = rawSize < virtualSize ? rawSize : virtualSize;
+        if (options_.Extent == SectionExtent::kRaw && !module)
+            size = rawSize;
+        else if (options_.Extent == SectionExtent::kVirtual && module)
+            size = virtualSize;
+
+        SectionRange range{ header_.template GetImageBase<const BYTE*>() + offset, size, 0 };
+        if (options_.Extent == SectionExtent::kVirtual && !module)
+            range.ZeroFill = virtualSize - size;
+
+        if (header_.GetImageSize()) {
+            const auto available = offset < header_.GetImageSize() ? header_.GetImageSize() - offset : 0;
+            if (range.Size > available) {
+                // Raw data cut off by the truncated file counts as zero fill, so the section keeps its virtual size.
+                if (options_.Extent == SectionExtent::kVirtual && !module)
+                    range.ZeroFill += range.Size - available;
+
+                range.Size = available;
+            }
+        }
+
+        // As when mapped, the section ends at the image size, so VirtualSize alone can not add gigabytes of zero fill.
+        if (options_.Extent == SectionExtent::kVirtual && !module && header_.IsValid()) {
+            const size_t sizeOfImage = header_.GetOptionalHeader()->SizeOfImage;
+            const auto   mapped      = section.VirtualAddress < sizeOfImage ? sizeOfImage - section.VirtualAddress : 0;
+            range.Size               = std::min(range.Size, mapped);
+            range.ZeroFill           = std::min(range.ZeroFill, mapped - range.Size);
+        }
+
+        if (!range.Size)
+            range.Data = nullptr;
+
+        return range;
+    }
+
+    /**
+     * @brief Analyzes the section.
+     * @param section Section header of the image.
+     * @param result Receives the analysis.
+     */
+    void Analyze(const SectionHeader& section, SectionAnalysis& result) const noexcept
+    {
+        result.Section = &section;
+        result.Range   = GetRange(section);
+        memset(result.Histogram, 0, sizeof(result.Histogram));
+        if (result.Range.Data)
+            CountBytes(result.Range.Data, result.Range.Size, result.Histogram);
+
+        result.Histogram[0] += static_cast<uint32_t>(result.Range.ZeroFill);
+        result.Entropy = ComputeEntropy(result.Histogram);
+        result.Hash    = options_.Hash ? HashRange(Fnv64(), result.Range).Final() : 0;
+        result.Md5     = options_.Md5 ? HashRange(Md5(), result.Range).Final() : Md5Digest{};
+    }
+
+    /**
+     * @brief Analyzes all sections in the section table order.
+     * @param results Array receiving the analyses.
+     * @param capacity Count of elements in the array.
+     * @return Count of analyzed sections, 0 if the headers are not valid or the array is too small.
+     */
+    size_t Analyze(SectionAnalysis* results, size_t capacity) const noexcept
+    {
+        const auto count = GetCount();
+        if (!count || !results || capacity < count)
+            return 0;
+
+        for (size_t index = 0; index < count; ++index)
+            Analyze(sections_.begin()[index], results[index]);
+
+        return count;
+    }
+
+    /**
+     * @brief Analyzes all sections in the section table order.
+     * @tparam N Count of elements in the array.
+     * @param results Array receiving the analyses.
+     * @return Count of analyzed sections, 0 if the headers are not valid or the array is too small.
+     */
+    template<size_t N> size_t Analyze(SectionAnalysis (&results)[N]) const noexcept { return Analyze(results, N); }
+
+    /**
+     * @brief Analyzes all sections into the array allocated from the arena.
+     * @param arena Arena the array is allocated from.
+     * @param output Receives pointer to the array, or nullptr if the arena is exhausted.
+     * @return Count of analyzed sections.
+     */
+    size_t Analyze(Arena& arena, SectionAnalysis*& output) const noexcept
+    {
+        const auto count = GetCount();
+        output           = count ? arena.Allocate<SectionAnalysis>(count) : nullptr;
+        return output ? Analyze(output, count) : 0;
+    }
+
+    /**
+     * @brief Analyzes all sections, running sections concurrently on the tasks of the executor.
+     *
+     * Every task takes the next section not yet taken, so a few large sections do not keep the other tasks waiting.
+     * @tparam Executor Callable as executor(size_t count, const Task& task), see ParallelOptions.
+     * @param results Array receiving the analyses.
+     * @param capacity Count of elements in the array.
+     * @param executor Executor running the tasks.
+     * @param options Work partitioning options, the work items are section bytes.
+     * @return Count of analyzed sections, 0 if the headers are not valid or the array is too small.
+     */
+    template<typename Executor>
+    size_t AnalyzeParallel(SectionAnalysis* results, size_t capacity, Executor&& executor, const ParallelOptions& options = ParallelOptions{ kParallelThreshold }) const
+    {
+        const auto count = GetCount();
+        if (!count || !results || capacity < count)
+            return 0;
+
+        size_t bytes = 0;
+        for (const auto& section : sections_) {
+            const auto range = GetRange(section);
+            bytes += range.Size + range.ZeroFill;
+        }
+
+        const auto tasks = std::min(options.GetTaskCount(bytes), count);
+        if (tasks <= 1)
+            return Analyze(results, capacity);
+
+        std::atomic<size_t> next(0);
+        executor(tasks, [&](size_t) {
+            for (auto index = next.fetch_add(1, std::memory_order_relaxed); index < count; index = next.fetch_add(1, std::memory_order_relaxed))
+                Analyze(sections_.begin()[index], results[index]);
+        });
+
+        return count;
+    }
+
+private:
+    /**
+     * @brief Streams the range bytes and its zero fill into the hasher.
+     */
+    template<typename Hasher> static Hasher HashRange(Hasher hasher, const SectionRange& range) noexcept
+    {
+        if (range.Data)
+            hasher.Update(range.Data, range.Size);
+
+        static constexpr BYTE kZeros[4096] = {};
+        for (auto zeroFill = range.ZeroFill; zeroFill;) {
+            const auto count = zeroFill < sizeof(kZeros) ? zeroFill : sizeof(kZeros);
+            hasher.Update(kZeros, count);
+            zeroFill -= count;
+        }
+
+        return hasher;
+    }
+
+    const Header<Arch>           header_;
+    const Section                sections_;
+    const SectionAnalysisOptions options_;
+};
+
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "PeInstrumentation.h"
+#include "PeTypes.h"
+
+namespace pe_iterator {
+
+/**
+ * @brief Precomputed RVA translation table for raw file images.
+ *
+ * The table is built once from the section headers into a caller-supplied buffer. A header holding the index translates
+ * RVAs without rereading the section table, the sections count or the file alignment on every call.
+ */
+class SectionIndex {
+public:
+    /**
+     * @brief Translation entry of a single section.
+     */
+    struct Entry {
+        RVA   Begin; // First RVA of the section.
+        RVA   End;   // RVA past the last byte of the section raw data (aligned to the file alignment).
+        DWORD Delta; // Value which turns an RVA of the section into a file offset (modulo 2^32).
+    };
+
+    // Count of entries up to which a linear scan is used instead of a binary search.
+    static constexpr size_t kLinearSearchThreshold = 8;
+
+    /**
+     * @brief Initialization constructor.
+     * @param entries Pointer to the buffer receiving translation entries.
+     * @param capacity Count of entries the buffer can hold.
+     */
+    SectionIndex(Entry* entries, size_t capacity) noexcept
+        : entries_(entries)
+        , capacity_(capacity)
+        , count_(0)
+        , built_(false)
+    {
+    }
+
+    /**
+     * @brief Initialization constructor.
+     * @tparam N Count of entries in the buffer.
+     * @param entries Buffer receiving translation entries.
+     */
+    template<size_t N> explicit SectionIndex(Entry (&entries)[N]) noexcept
+        : SectionIndex(entries, N)
+    {
+    }
+
+    /**
+     * @brief Initialization constructor.
+     * @param arena Arena the entries are allocated from, the index can not be built if it is exhausted.
+     * @param capacity Count of entries to allocate.
+     */
+    SectionIndex(Arena& arena, size_t capacity) noexcept
+        : SectionIndex(arena.Allocate<Entry>(capacity), capacity)
+    {
+    }
+
+    /**
+     * @brief Builds the index from the section headers.
+     * @param section Pointer to the header of the first section.
+     * @param count Total count of sections.
+     * @param fileAlignment Image file alignment.
+     * @return false if the buffer is too small or sections raw data overlap; the index stays unused in this case.
+     */
+    bool Build(const SectionHeader* section, size_t count, DWORD fileAlignment) noexcept
+    {
+        Reset();
+        if (!entries_ || (count && !section) || count > capacity_) {
+            built_ = false;
+            return false;
+        }
+
+        for (size_t cx = 0; cx < count; ++cx, ++section) {
+            const auto realSize = (section->SizeOfRawData + (fileAlignment - 1)) & ~(fileAlignment - 1);
+            if (!realSize)
+                continue;
+
+            // Overlapping sections resolve by the order of the section table, which a sorted table can't reproduce.
+            if (!Add({ section->VirtualAddress, section->VirtualAddress + realSize, section->PointerToRawData - section->VirtualAddress })) {
+                count_ = 0;
+                built_ = false;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Empties the index, an empty index translates no RVA.
+     */
+    void Reset() noexcept
+    {
+        count_ = 0;
+        built_ = true;
+    }
+
+    /**
+     * @brief Adds translation entry keeping the entries sorted.
+     * @param entry Translation entry.
+     * @return false if the buffer is full or the entry overlaps another one.
+     */
+    bool Add(const Entry& entry) noexcept
+    {
+        if (!entries_ || count_ >= capacity_ || entry.End <= entry.Begin)
+            return false;
+
+        // Insertion sort by the first RVA, sections are few and mostly already sorted.
+        auto position = count_;
+        while (position && entries_[position - 1].Begin > entry.Begin)
+            --position;
+
+        if ((position && entries_[position - 1].End > entry.Begin) || (position < count_ && entry.End > entries_[position].Begin))
+            return false;
+
+        for (auto cx = count_; cx > position; --cx)
+            entries_[cx] = entries_[cx - 1];
+
+        entries_[position] = entry;
+        ++count_;
+        return true;
+    }
+
+    /**
+     * @brief Builds the index from the image header.
+     * @tparam HeaderType Image header type.
+     * @param header Image header.
+     */
+    template<typename HeaderType> bool Build(const HeaderType& header) noexcept
+    {
+        return Build(IMAGE_FIRST_SECTION(header.GetNtHeaders()), header.GetFileHeader()->NumberOfSections, header.GetOptionalHeader()->FileAlignment);
+    }
+
+    /**
+     * @brief Searching the translation entry containing RVA.
+     * @param rva RVA offset.
+     * @return Pointer to the translation entry, or nullptr.
+     */
+    const Entry* Find(RVA rva) const noexcept
+    {
+        if (!count_)
+            return nullptr;
+
+        if (count_ <= kLinearSearchThreshold) {
+            for (size_t cx = 0; cx < count_; ++cx) {
+                PE_ITERATOR_PROBE(kSectionScanStep, 1);
+                // Single unsigned comparison covers both bounds.
+                if (rva - entries_[cx].Begin < entries_[cx].End - entries_[cx].Begin)
+                    return &entries_[cx];
+            }
+
+            return nullptr;
+        }
+
+        // Branchless search of the last entry beginning at or before RVA.
+        const Entry* entry = entries_;
+        for (size_t length = count_; length > 1;) {
+            PE_ITERATOR_PROBE(kSectionScanStep, 1);
+            const auto half = length / 2;
+            entry           = entry[half].Begin <= rva ? entry + half : entry;
+            length -= half;
+        }
+
+        return rva - entry->Begin < entry->End - entry->Begin ? entry : nullptr;
+    }
+
+    /**
+     * @brief Returns count of translation entries.
+     */
+    size_t GetCount() const noexcept { return count_; }
+
+    /**
+     * @brief Returns true if the index was successfully built.
+     */
+    bool IsValid() const noexcept { return built_; }
+
+private:
+    Entry* entries_;
+    size_t capacity_;
+    size_t count_;
+    bool   built_;
+};
+
+}
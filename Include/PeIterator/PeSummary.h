@@ -0,0 +1,518 @@
+#pragma once
+
+#include "PeImage.h"
+#include "PeTypes.h"
+#include <cstring>
+
+namespace pe_iterator {
+
+constexpr uint32_t kSummarySignature     = 0x4D555350; // "PSUM"
+constexpr uint32_t kSummaryVersion       = 1;
+constexpr uint32_t kSummaryNoString      = 0xFFFFFFFF; // String offset of the absent string.
+constexpr uint32_t kSummaryModuleDelayed = 0x00000001; // Module flag of the delay-loaded module.
+
+/**
+ * @brief Column arrays of the summary record, each column holds one field of all rows of its group.
+ */
+enum class SummaryColumn : BYTE {
+    kSectionName,            // uint32_t string offset of the section name.
+    kSectionRva,             // RVA of the section.
+    kSectionVirtualSize,     // DWORD virtual size of the section.
+    kSectionRawOffset,       // DWORD file offset of the section data.
+    kSectionRawSize,         // DWORD size of the section data in the file.
+    kSectionCharacteristics, // DWORD section characteristics.
+    kModuleName,             // uint32_t string offset of the imported module name.
+    kModuleFirstImport,      // DWORD index of the first import of the module, CountOfModules + 1 entries.
+    kModuleFlags,            // DWORD module flags, kSummaryModuleDelayed.
+    kImportName,             // uint32_t string offset of the imported function name, kSummaryNoString if imported by ordinal.
+    kImportOrdinal,          // WORD ordinal of the function imported by ordinal, or hint of the function imported by name.
+    kExportName,             // uint32_t string offset of the exported function name, kSummaryNoString if exported by ordinal.
+    kExportOrdinal,          // WORD ordinal of the exported function.
+    kExportRva,              // RVA of the exported function, 0 if forwarded.
+    kExportForwarder,        // uint32_t string offset of the forwarder, kSummaryNoString if not forwarded.
+    kTlsCallbackRva,         // RVA of the TLS callback.
+    kCount
+};
+
+/**
+ * @brief Flattened image facts, the fixed header of the summary record.
+ *
+ * The record is one contiguous block of the header, column arrays and string pool, referring to its parts only by offsets
+ * from its start. It holds no pointers into the image or itself, so it can be copied, hashed and shipped as plain bytes.
+ * Padding is zeroed, records of the same image are identical byte by byte.
+ */
+struct SummaryRecord {
+    uint32_t Signature;          // kSummarySignature.
+    uint32_t Version;            // kSummaryVersion.
+    uint32_t Size;               // Size of the record in bytes, including the columns and the string pool.
+    uint32_t Architecture;       // Architecture of the image.
+    uint64_t ImageBase;          // Preferred image base.
+    uint32_t TimeDateStamp;      // File header time stamp.
+    uint32_t CheckSum;           // Optional header checksum.
+    uint32_t SizeOfImage;        // Size of the loaded image.
+    RVA      EntryPoint;         // RVA of the entry point.
+    WORD     Machine;            // File header machine.
+    WORD     Characteristics;    // File header characteristics.
+    WORD     Subsystem;          // Optional header subsystem.
+    WORD     DllCharacteristics; // Optional header DLL characteristics.
+    uint32_t ExportName;         // String offset of the export module name, or kSummaryNoString.
+
+    uint32_t CountOfSections;     // Rows of the section columns.
+    uint32_t CountOfModules;      // Rows of the module columns, imported modules followed by delay-loaded ones.
+    uint32_t CountOfImports;      // Rows of the import columns, grouped by module.
+    uint32_t CountOfExports;      // Rows of the export columns, named exports followed by ordinal-only ones.
+    uint32_t CountOfTlsCallbacks; // Rows of the TLS callback column.
+
+    uint32_t Columns[static_cast<size_t>(SummaryColumn::kCount)]; // Offsets of the column arrays from the record start.
+    uint32_t StringPool;                                          // Offset of the pool of null-terminated strings.
+    uint32_t StringPoolSize;                                      // Size of the string pool in bytes.
+};
+
+/**
+ * @brief Returns size of the element of the summary column.
+ * @param column Summary column.
+ */
+constexpr size_t GetSummaryElementSize(SummaryColumn column) noexcept
+{
+    return column == SummaryColumn::kImportOrdinal || column == SummaryColumn::kExportOrdinal ? sizeof(WORD) : sizeof(DWORD);
+}
+
+/**
+ * @brief Returns count of elements of the summary column.
+ * @param record Summary record.
+ * @param column Summary column.
+ */
+constexpr uint64_t GetSummaryElementCount(const SummaryRecord& record, SummaryColumn column) noexcept
+{
+    return column <= SummaryColumn::kSectionCharacteristics ? record.CountOfSections
+        : column == SummaryColumn::kModuleFirstImport       ? static_cast<uint64_t>(record.CountOfModules) + 1
+        : column <= SummaryColumn::kModuleFlags             ? record.CountOfModules
+        : column <= SummaryColumn::kImportOrdinal           ? record.CountOfImports
+        : column <= SummaryColumn::kExportForwarder         ? record.CountOfExports
+                                                            : record.CountOfTlsCallbacks;
+}
+
+/**
+ * @brief Read-only view of the summary record, validating the record of an untrusted origin once.
+ */
+class SummaryView {
+public:
+    /**
+     * @brief Initialization constructor.
+     * @param data Pointer to the record, aligned as SummaryRecord.
+     * @param size Size of the data in bytes.
+     */
+    SummaryView(const void* data, size_t size) noexcept
+        : record_(Validate(data, size))
+    {
+    }
+
+    /**
+     * @brief Returns true if the record is valid.
+     */
+    bool IsValid() const noexcept { return record_ != nullptr; }
+
+    /**
+     * @brief Returns pointer to the record header.
+     */
+    const SummaryRecord* GetRecord() const noexcept { return record_; }
+
+    /**
+     * @brief Returns count of elements of the column.
+     * @param column Summary column.
+     */
+    uint32_t GetCount(SummaryColumn column) const noexcept { return static_cast<uint32_t>(GetSummaryElementCount(*record_, column)); }
+
+    /**
+     * @brief Returns pointer to the column array.
+     * @tparam T Element type, of the size of the column element.
+     * @param column Summary column.
+     * @return Pointer to the array, or nullptr if the element type does not match the column.
+     */
+    template<typename T> const T* GetColumn(SummaryColumn column) const noexcept
+    {
+        if (sizeof(T) != GetSummaryElementSize(column))
+            return nullptr;
+
+        return reinterpret_cast<const T*>(reinterpret_cast<const BYTE*>(record_) + record_->Columns[static_cast<size_t>(column)]);
+    }
+
+    /**
+     * @brief Returns the string of the pool.
+     * @param offset String offset.
+     * @return Pointer to the null-terminated string, or nullptr for kSummaryNoString.
+     */
+    const char* GetString(uint32_t offset) const noexcept
+    {
+        return offset < record_->StringPoolSize ? reinterpret_cast<const char*>(record_) + record_->StringPool + offset : nullptr;
+    }
+
+private:
+    /**
+     * @brief Checks the header, columns and string pool lie within the record.
+     * @return Pointer to the record, or nullptr if not valid.
+     */
+    static const SummaryRecord* Validate(const void* data, size_t size) noexcept
+    {
+        const auto record = static_cast<const SummaryRecord*>(data);
+        if (!record || size < sizeof(SummaryRecord) || reinterpret_cast<uintptr_t>(data) % alignof(SummaryRecord) != 0)
+            return nullptr;
+
+        if (record->Signature != kSummarySignature || record->Version != kSummaryVersion || record->Size > size || record->Size < sizeof(SummaryRecord))
+            return nullptr;
+
+        for (size_t cx = 0; cx < static_cast<size_t>(SummaryColumn::kCount); ++cx) {
+            const auto column = static_cast<SummaryColumn>(cx);
+            const auto offset = record->Columns[cx];
+            if (offset % GetSummaryElementSize(column) != 0
+                || static_cast<uint64_t>(offset) + GetSummaryElementCount(*record, column) * GetSummaryElementSize(column) > record->Size)
+                return nullptr;
+        }
+
+        // The pool ends with a terminator, so every string offset within it reads a terminated string.
+        const auto pool = reinterpret_cast<const char*>(record) + record->StringPool;
+        if (static_cast<uint64_t>(record->StringPool) + record->StringPoolSize > record->Size
+            || (record->StringPoolSize && pool[record->StringPoolSize - 1] != '\0'))
+            return nullptr;
+
+        return record;
+    }
+
+    const SummaryRecord* record_;
+};
+
+/**
+ * @brief Flattens the image into the summary record.
+ *
+ * The image is walked twice, the first walk counts rows and string bytes, so the record is allocated from the arena once
+ * in its exact size and the second walk fills it.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class Summarizer {
+public:
+    /**
+     * @brief Builds the summary record of the image.
+     * @param image Image to summarize.
+     * @param arena Arena the record is allocated from.
+     * @return Pointer to the record, or nullptr if the image is not valid, the record exceeds 4 GB or the arena is exhausted.
+     */
+    static const SummaryRecord* Summarize(const Image<Arch>& image, Arena& arena) noexcept
+    {
+        const auto header = image.GetHeader();
+        if (!header.IsValid())
+            return nullptr;
+
+        // Many rows may refer to one long string, so the counts are taken in 64 bits and checked before sizing the record.
+        Counter       counter;
+        SummaryRecord counts {};
+        Walk(image, counter);
+        if (!counter.GetCounts(counts))
+            return nullptr;
+
+        // Columns follow the header aligned to their elements, the pool follows the columns.
+        uint64_t size = sizeof(SummaryRecord);
+        uint32_t columns[static_cast<size_t>(SummaryColumn::kCount)];
+        for (size_t cx = 0; cx < static_cast<size_t>(SummaryColumn::kCount); ++cx) {
+            const auto column = static_cast<SummaryColumn>(cx);
+            size              = (size + sizeof(DWORD) - 1) & ~static_cast<uint64_t>(sizeof(DWORD) - 1);
+            columns[cx]       = static_cast<uint32_t>(size);
+            size += GetSummaryElementCount(counts, column) * GetSummaryElementSize(column);
+        }
+
+        const auto stringPool = size;
+        size                  = (size + counter.StringPoolSize + alignof(SummaryRecord) - 1) & ~static_cast<uint64_t>(alignof(SummaryRecord) - 1);
+        if (size > 0xFFFFFFFF)
+            return nullptr;
+
+        const auto record = static_cast<SummaryRecord*>(arena.Allocate(static_cast<size_t>(size), alignof(SummaryRecord)));
+        if (!record)
+            return nullptr;
+
+        std::memset(record, 0, static_cast<size_t>(size));
+
+        const auto nt              = header.GetNtHeaders();
+        record->Signature          = kSummarySignature;
+        record->Version            = kSummaryVersion;
+        record->Size               = static_cast<uint32_t>(size);
+        record->Architecture       = static_cast<uint32_t>(Arch);
+        record->ImageBase          = nt->OptionalHeader.ImageBase;
+        record->TimeDateStamp      = nt->FileHeader.TimeDateStamp;
+        record->CheckSum           = nt->OptionalHeader.CheckSum;
+        record->SizeOfImage        = nt->OptionalHeader.SizeOfImage;
+        record->EntryPoint         = nt->OptionalHeader.AddressOfEntryPoint;
+        record->Machine            = nt->FileHeader.Machine;
+        record->Characteristics    = nt->FileHeader.Characteristics;
+        record->Subsystem          = nt->OptionalHeader.Subsystem;
+        record->DllCharacteristics = nt->OptionalHeader.DllCharacteristics;
+        record->ExportName         = kSummaryNoString;
+        record->StringPool         = static_cast<uint32_t>(stringPool);
+        record->StringPoolSize     = static_cast<uint32_t>(counter.StringPoolSize);
+        std::memcpy(record->Columns, columns, sizeof(columns));
+
+        Writer writer(record);
+        Walk(image, writer);
+
+        writer.Column<DWORD>(SummaryColumn::kModuleFirstImport)[record->CountOfModules] = record->CountOfImports;
+        return record;
+    }
+
+private:
+    using CallbackValue = decltype(TlsDirectoryDescriptor<Arch>::AddressOfCallBacks);
+
+    // Count of functions checked for names by one pass over the names table.
+    static constexpr DWORD kNamedWindow = 4096;
+
+    /**
+     * @brief Walk sink counting rows and string bytes.
+     */
+    struct Counter {
+        uint64_t Sections       = 0;
+        uint64_t Modules        = 0;
+        uint64_t Imports        = 0;
+        uint64_t Exports        = 0;
+        uint64_t TlsCallbacks   = 0;
+        uint64_t StringPoolSize = 0;
+
+        void ExportModule(const char* name) noexcept { String(name); }
+        void Section(const SectionHeader& section) noexcept
+        {
+            ++Sections;
+            StringPoolSize += GetSectionNameLength(section) + 1;
+        }
+        void Module(const char* name, DWORD) noexcept
+        {
+            ++Modules;
+            String(name);
+        }
+        void Import(const char* name, WORD) noexcept
+        {
+            ++Imports;
+            String(name);
+        }
+        void Export(const char* name, Ordinal, RVA, const char* forwarder) noexcept
+        {
+            ++Exports;
+            String(name);
+            String(forwarder);
+        }
+        void TlsCallback(RVA) noexcept { ++TlsCallbacks; }
+
+        /**
+         * @brief Stores the counts of rows into the record.
+         * @return false if a count or the string pool does not fit the record.
+         */
+        bool GetCounts(SummaryRecord& record) const noexcept
+        {
+            if (Sections > 0xFFFFFFFF || Modules > 0xFFFFFFFF || Imports > 0xFFFFFFFF || Exports > 0xFFFFFFFF || TlsCallbacks > 0xFFFFFFFF
+                || StringPoolSize > 0xFFFFFFFF)
+                return false;
+
+            record.CountOfSections     = static_cast<uint32_t>(Sections);
+            record.CountOfModules      = static_cast<uint32_t>(Modules);
+            record.CountOfImports      = static_cast<uint32_t>(Imports);
+            record.CountOfExports      = static_cast<uint32_t>(Exports);
+            record.CountOfTlsCallbacks = static_cast<uint32_t>(TlsCallbacks);
+            return true;
+        }
+
+    private:
+        void String(const char* string) noexcept { StringPoolSize += string ? std::strlen(string) + 1 : 0; }
+    };
+
+    /**
+     * @brief Walk sink filling the allocated record.
+     */
+    class Writer {
+    public:
+        explicit Writer(SummaryRecord* record) noexcept
+            : record_(record)
+            , pool_(reinterpret_cast<char*>(record) + record->StringPool)
+            , poolSize_(0)
+        {
+        }
+
+        template<typename T> T* Column(SummaryColumn column) const noexcept
+        {
+            return reinterpret_cast<T*>(reinterpret_cast<BYTE*>(record_) + record_->Columns[static_cast<size_t>(column)]);
+        }
+
+        void ExportModule(const char* name) noexcept { record_->ExportName = String(name); }
+        void Section(const SectionHeader& section) noexcept
+        {
+            const auto row                                             = record_->CountOfSections++;
+            Column<uint32_t>(SummaryColumn::kSectionName)[row]         = String(reinterpret_cast<const char*>(section.Name), GetSectionNameLength(section));
+            Column<RVA>(SummaryColumn::kSectionRva)[row]               = section.VirtualAddress;
+            Column<DWORD>(SummaryColumn::kSectionVirtualSize)[row]     = section.Misc.VirtualSize;
+            Column<DWORD>(SummaryColumn::kSectionRawOffset)[row]       = section.PointerToRawData;
+            Column<DWORD>(SummaryColumn::kSectionRawSize)[row]         = section.SizeOfRawData;
+            Column<DWORD>(SummaryColumn::kSectionCharacteristics)[row] = section.Characteristics;
+        }
+        void Module(const char* name, DWORD flags) noexcept
+        {
+            const auto row                                        = record_->CountOfModules++;
+            Column<uint32_t>(SummaryColumn::kModuleName)[row]     = String(name);
+            Column<DWORD>(SummaryColumn::kModuleFirstImport)[row] = record_->CountOfImports;
+            Column<DWORD>(SummaryColumn::kModuleFlags)[row]       = flags;
+        }
+        void Import(const char* name, WORD ordinal) noexcept
+        {
+            const auto row                                    = record_->CountOfImports++;
+            Column<uint32_t>(SummaryColumn::kImportName)[row] = String(name);
+            Column<WORD>(SummaryColumn::kImportOrdinal)[row]  = ordinal;
+        }
+        void Export(const char* name, Ordinal ordinal, RVA rva, const char* forwarder) noexcept
+        {
+            const auto row                                         = record_->CountOfExports++;
+            Column<uint32_t>(SummaryColumn::kExportName)[row]      = String(name);
+            Column<WORD>(SummaryColumn::kExportOrdinal)[row]       = ordinal;
+            Column<RVA>(SummaryColumn::kExportRva)[row]            = rva;
+            Column<uint32_t>(SummaryColumn::kExportForwarder)[row] = String(forwarder);
+        }
+        void TlsCallback(RVA rva) noexcept { Column<RVA>(SummaryColumn::kTlsCallbackRva)[record_->CountOfTlsCallbacks++] = rva; }
+
+    private:
+        uint32_t String(const char* string) noexcept { return string ? String(string, std::strlen(string)) : kSummaryNoString; }
+        uint32_t String(const char* string, size_t length) noexcept
+        {
+            const auto offset = poolSize_;
+            std::memcpy(pool_ + offset, string, length);
+            pool_[offset + length] = '\0';
+            poolSize_ += static_cast<uint32_t>(length) + 1;
+            return offset;
+        }
+
+        SummaryRecord* record_;
+        char*          pool_;
+        uint32_t       poolSize_;
+    };
+
+    /**
+     * @brief Returns length of the section name, which is not terminated if it takes all 8 bytes.
+     */
+    static size_t GetSectionNameLength(const SectionHeader& section) noexcept
+    {
+        size_t length = 0;
+        while (length < IMAGE_SIZEOF_SHORT_NAME && section.Name[length])
+            ++length;
+
+        return length;
+    }
+
+public:
+    /**
+     * @brief Walks the image facts in the record order.
+     *
+     * The sink receives ExportModule(const char* name), Section(const SectionHeader&), Module(const char* name, DWORD flags),
+     * Import(const char* name, WORD ordinalOrHint), Export(const char* name, Ordinal, RVA, const char* forwarder) and
+     * TlsCallback(RVA) calls, names are nullptr if absent.
+     * @param image Image to walk.
+     * @param sink Sink of the facts.
+     */
+    template<typename Sink> static void Walk(const Image<Arch>& image, Sink& sink) noexcept
+    {
+        const auto& header = image.GetHeader();
+
+        for (const auto& section : image.GetSection())
+            sink.Section(section);
+
+        const auto imports = image.GetImport();
+        if (imports.IsValid()) {
+            for (const auto& module : imports) {
+                sink.Module(module.GetModuleName(), 0);
+                if (module.GetImportLookupTable()) {
+                    for (const auto& function : module)
+                        WalkImport(function, sink);
+                }
+            }
+        }
+
+        const auto delayedImports = image.GetDelayedImport();
+        if (delayedImports.IsValid()) {
+            for (const auto& module : delayedImports) {
+                sink.Module(module.GetModuleName(), kSummaryModuleDelayed);
+                if (module.GetImportLookupTable()) {
+                    for (const auto& function : module)
+                        WalkImport(function, sink);
+                }
+            }
+        }
+
+        const auto exports = image.GetExport();
+        if (exports.IsValid())
+            WalkExports(header, exports, sink);
+
+        const auto tls = image.GetTls();
+        if (tls.IsValid()) {
+            const auto imageBase = header.GetOptionalHeader()->ImageBase;
+            auto       callback  = reinterpret_cast<const CallbackValue*>(tls.GetCallbacks());
+            for (; callback && (!header.GetImageSize() || header.IsArrayValid(callback, 1)) && *callback; ++callback)
+                sink.TlsCallback(static_cast<RVA>(*callback - imageBase));
+        }
+    }
+
+private:
+    /**
+     * @brief Walks the imported function.
+     */
+    template<typename Function, typename Sink> static void WalkImport(const Function& function, Sink& sink) noexcept
+    {
+        if (function.IsImportedByOrdinal()) {
+            sink.Import(nullptr, static_cast<WORD>(function.GetFunctionOrdinal()));
+            return;
+        }
+
+        const auto name = function.GetFunctionName();
+        sink.Import(name ? reinterpret_cast<const char*>(name->Name) : nullptr, name ? name->Hint : 0);
+    }
+
+    /**
+     * @brief Walks the named exports, then the functions exported only by ordinal.
+     */
+    template<typename Sink> static void WalkExports(const Header<Arch>& header, const Export<Arch>& exports, Sink& sink) noexcept
+    {
+        const auto descriptor     = exports.GetDirectoryDescriptor();
+        const auto countFunctions = exports.GetCountFunctions();
+        const auto countNames     = exports.GetCountOfFunctionsNames();
+
+        sink.ExportModule(descriptor->Name ? header.template RvaToVA<const char>(descriptor->Name) : nullptr);
+
+        const auto walk = [&](const char* name, DWORD functionIndex) {
+            const auto rva       = exports.GetFunctionRva(functionIndex);
+            const auto forwarded = exports.IsForwarded(rva);
+            sink.Export(name, static_cast<Ordinal>(descriptor->Base + functionIndex), forwarded ? 0 : rva,
+                        forwarded ? header.template RvaToVA<const char>(rva) : nullptr);
+        };
+
+        for (DWORD nameIndex = 0; nameIndex < countNames; ++nameIndex) {
+            const auto functionIndex = exports.GetFunctionIndex(nameIndex);
+            if (functionIndex < countFunctions)
+                walk(exports.GetFunctionName(nameIndex), functionIndex);
+        }
+
+        // Functions without names are found by marking the named ones, a window of functions per pass over the names.
+        for (DWORD window = 0; window < countFunctions; window += kNamedWindow) {
+            uint64_t named[kNamedWindow / 64] = {};
+            for (DWORD nameIndex = 0; nameIndex < countNames; ++nameIndex) {
+                const auto functionIndex = exports.GetFunctionIndex(nameIndex);
+                if (functionIndex >= window && functionIndex - window < kNamedWindow)
+                    named[(functionIndex - window) / 64] |= uint64_t(1) << ((functionIndex - window) % 64);
+            }
+
+            const auto last = countFunctions - window < kNamedWindow ? countFunctions - window : kNamedWindow;
+            for (DWORD cx = 0; cx < last; ++cx) {
+                if (!(named[cx / 64] & (uint64_t(1) << (cx % 64))) && exports.GetFunctionRva(window + cx))
+                    walk(nullptr, window + cx);
+            }
+        }
+    }
+};
+
+/**
+ * @brief Flattens the image into the position-independent summary record, see SummaryRecord.
+ * @param image Image to summarize.
+ * @param arena Arena the record is allocated from.
+ * @return Pointer to the record, or nullptr if the image is not valid or the arena is exhausted.
+ */
+template<Architecture Arch> const SummaryRecord* Summarize(const Image<Arch>& image, Arena& arena) noexcept { return Summarizer<Arch>::Summarize(image, arena); }
+
+}
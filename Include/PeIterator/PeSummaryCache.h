@@ -0,0 +1,369 @@
+#pragma once
+
+#include "PeAnyImage.h"
+#include "PeMappedFile.h"
+#include "PeSummary.h"
+#include "PeTypes.h"
+#include <atomic>
+#include <cstring>
+
+namespace pe_iterator {
+
+/**
+ * @brief Key of the file state summarized in the cache.
+ */
+struct SummaryKey {
+    uint64_t FileSize;      // Size of the file in bytes.
+    uint64_t LastWriteTime; // Last write time of the file, 0 for content keys.
+    uint64_t ContentHash;   // 64-bit FNV-1a hash of the file, 0 for identity keys.
+    uint32_t TimeDateStamp; // File header time stamp.
+    uint32_t CheckSum;      // Optional header checksum.
+
+    bool operator==(const SummaryKey& other) const noexcept
+    {
+        return FileSize == other.FileSize && LastWriteTime == other.LastWriteTime && ContentHash == other.ContentHash && TimeDateStamp == other.TimeDateStamp
+            && CheckSum == other.CheckSum;
+    }
+};
+
+// Kind of the summary key.
+enum class SummaryKeyMode : BYTE {
+    kIdentity, // File size, last write time and header stamps, read without touching the file contents.
+    kContent   // File size, content hash and header stamps, reads the whole file.
+};
+
+/**
+ * @brief Persistent cache of the summary records in a single memory-mapped file.
+ *
+ * The file holds a fixed open-addressing table of slots followed by an append-only area of records. A slot is published
+ * by the release store of its state after its key and record are written, so any count of readers, in any processes,
+ * look records up without locks while one writer inserts. The writable view keeps the file open without write sharing,
+ * so a second writer fails to open the cache. Records are never removed, a changed file gets a new key and slot.
+ */
+class SummaryCache {
+public:
+    static constexpr uint32_t kSignature = 0x43555350; // "PSUC"
+    static constexpr uint32_t kVersion   = 1;
+
+#if defined(_WIN32)
+    /**
+     * @brief Opens the existing cache for reading.
+     * @param path Path to the cache file.
+     */
+    explicit SummaryCache(const wchar_t* path) noexcept
+        : file_(path, MappedFile::Access::kRead)
+        , header_(Validate(file_))
+    {
+    }
+#endif
+
+    /**
+     * @brief Opens the existing cache for reading.
+     * @param path Path to the cache file.
+     */
+    explicit SummaryCache(const char* path) noexcept
+        : file_(path, MappedFile::Access::kRead)
+        , header_(Validate(file_))
+    {
+    }
+
+#if defined(_WIN32)
+    /**
+     * @brief Opens the cache for writing, creating it if it does not exist or is empty. An existing cache keeps its own
+     * capacities, an existing file which is not a cache is neither grown nor overwritten.
+     * @param path Path to the cache file.
+     * @param countOfRecords Count of records the created cache can hold.
+     * @param dataCapacity Size of the records area of the created cache in bytes.
+     */
+    SummaryCache(const wchar_t* path, size_t countOfRecords, size_t dataCapacity) noexcept
+        : file_(path, MappedFile::Access::kReadWrite, GetRequiredSize(countOfRecords, dataCapacity))
+        , header_(Initialize(file_, countOfRecords, dataCapacity))
+    {
+    }
+#endif
+
+    /**
+     * @brief Opens the cache for writing, creating it if it does not exist or is empty. An existing cache keeps its own
+     * capacities, an existing file which is not a cache is neither grown nor overwritten.
+     * @param path Path to the cache file.
+     * @param countOfRecords Count of records the created cache can hold.
+     * @param dataCapacity Size of the records area of the created cache in bytes.
+     */
+    SummaryCache(const char* path, size_t countOfRecords, size_t dataCapacity) noexcept
+        : file_(path, MappedFile::Access::kReadWrite, GetRequiredSize(countOfRecords, dataCapacity))
+        , header_(Initialize(file_, countOfRecords, dataCapacity))
+    {
+    }
+
+    /**
+     * @brief Returns true if the cache was opened.
+     */
+    bool IsValid() const noexcept { return header_ != nullptr; }
+
+    /**
+     * @brief Returns true if the cache was opened for writing.
+     */
+    bool IsWritable() const noexcept { return header_ && file_.IsWritable(); }
+
+    /**
+     * @brief Returns count of the cached records.
+     */
+    size_t GetCount() const noexcept { return header_ ? header_->Count.load(std::memory_order_acquire) : 0; }
+
+    /**
+     * @brief Writes the modified pages of the cache to disk.
+     * @return true on success.
+     */
+    bool Flush() const noexcept { return IsWritable() && file_.Flush(); }
+
+    /**
+     * @brief Makes the key of the mapped file.
+     * @param file Mapped file.
+     * @param mode Key mode.
+     * @param key Receives the key.
+     * @return false if the file is not a valid image.
+     */
+    static bool GetKey(const MappedFile& file, SummaryKeyMode mode, SummaryKey& key) noexcept
+    {
+        key = { file.GetSize(), 0, 0, 0, 0 };
+        if (mode == SummaryKeyMode::kContent)
+            key.ContentHash = HashBytes64(file.GetData(), file.GetSize());
+        else
+            key.LastWriteTime = file.GetLastWriteTime();
+
+        return file.GetAnyImage().Visit([&](const auto& image) {
+            const auto header = image.GetHeader();
+            key.TimeDateStamp = header.GetFileHeader()->TimeDateStamp;
+            key.CheckSum      = header.GetOptionalHeader()->CheckSum;
+        });
+    }
+
+    /**
+     * @brief Searching the cached record.
+     * @param key Key of the file.
+     * @return View of the record in the cache, not valid if the record is not cached.
+     */
+    SummaryView Find(const SummaryKey& key) const noexcept
+    {
+        if (!header_)
+            return { nullptr, 0 };
+
+        const auto mask     = header_->CountOfSlots - 1;
+        auto       position = Hash(key) & mask;
+        for (size_t probe = 0; probe <= mask; ++probe, position = (position + 1) & mask) {
+            const auto& slot = GetSlots()[position];
+            if (slot.State.load(std::memory_order_acquire) != kPublished)
+                break;
+
+            if (slot.Key == key)
+                return GetRecord(slot);
+        }
+
+        return { nullptr, 0 };
+    }
+
+    /**
+     * @brief Copies the record into the cache, the cache must be opened for writing.
+     * @param key Key of the file.
+     * @param record Summary record.
+     * @return View of the record in the cache, or of the already cached record of the key. Not valid if the cache is
+     * read-only or full and the key is not cached, or the record is not valid.
+     */
+    SummaryView Insert(const SummaryKey& key, const SummaryRecord* record) noexcept
+    {
+        if (!IsWritable() || !record || !SummaryView(record, record->Size).IsValid())
+            return { nullptr, 0 };
+
+        // Keep a quarter of the slots free, so the probes stay short and always end at an empty slot.
+        const auto size = (static_cast<uint64_t>(record->Size) + kRecordAlignment - 1) & ~static_cast<uint64_t>(kRecordAlignment - 1);
+        const auto used = header_->DataUsed.load(std::memory_order_relaxed);
+        if (header_->Count.load(std::memory_order_relaxed) >= header_->CountOfSlots / 4 * 3 || used > header_->DataCapacity || size > header_->DataCapacity - used)
+            return Find(key);
+
+        const auto mask     = header_->CountOfSlots - 1;
+        auto       position = Hash(key) & mask;
+        for (size_t probe = 0; GetSlots()[position].State.load(std::memory_order_acquire) == kPublished; ++probe, position = (position + 1) & mask) {
+            if (probe > mask)
+                return { nullptr, 0 };
+
+            if (GetSlots()[position].Key == key)
+                return GetRecord(GetSlots()[position]);
+        }
+
+        const auto slot = GetSlots() + position;
+
+        std::memcpy(file_.GetWritableData() + header_->DataOffset + used, record, record->Size);
+        header_->DataUsed.store(used + size, std::memory_order_relaxed);
+
+        slot->Key          = key;
+        slot->RecordOffset = header_->DataOffset + used;
+        slot->RecordSize   = record->Size;
+        slot->State.store(kPublished, std::memory_order_release);
+        header_->Count.fetch_add(1, std::memory_order_release);
+
+        return GetRecord(*slot);
+    }
+
+    /**
+     * @brief Returns the cached summary of the mapped file, summarizing and caching it on a miss if the cache is writable.
+     * @param file Mapped file.
+     * @param arena Arena the record is summarized into on a miss.
+     * @param mode Key mode.
+     * @return View of the record in the cache or in the arena, not valid if the file is not a valid image or the arena is exhausted.
+     */
+    SummaryView Summarize(const MappedFile& file, Arena& arena, SummaryKeyMode mode = SummaryKeyMode::kIdentity) noexcept
+    {
+        SummaryKey key;
+        if (!GetKey(file, mode, key))
+            return { nullptr, 0 };
+
+        const auto cached = Find(key);
+        if (cached.IsValid())
+            return cached;
+
+        const SummaryRecord* record = nullptr;
+        file.GetAnyImage().Visit([&](const auto& image) { record = pe_iterator::Summarize(image, arena); });
+        if (!record)
+            return { nullptr, 0 };
+
+        const auto inserted = Insert(key, record);
+        return inserted.IsValid() ? inserted : SummaryView(record, record->Size);
+    }
+
+private:
+    /**
+     * @brief Header of the cache file.
+     */
+    struct CacheHeader {
+        std::atomic<uint32_t> Signature;    // kSignature, stored last when the cache is created.
+        uint32_t              Version;      // kVersion.
+        uint32_t              CountOfSlots; // Count of the slots, a power of two.
+        uint32_t              Reserved;
+        uint64_t              DataOffset;   // Offset of the records area from the file start.
+        uint64_t              DataCapacity; // Size of the records area in bytes.
+        std::atomic<uint64_t> DataUsed;     // Bytes of the records area taken.
+        std::atomic<uint32_t> Count;        // Count of the published slots.
+        uint32_t              Reserved2;
+    };
+
+    /**
+     * @brief Slot of the records table.
+     */
+    struct Slot {
+        SummaryKey            Key;          // Key of the file.
+        uint64_t              RecordOffset; // Offset of the record from the file start.
+        uint32_t              RecordSize;   // Size of the record in bytes.
+        std::atomic<uint32_t> State;        // kPublished, or 0 if the slot is empty.
+    };
+
+    static_assert(sizeof(SummaryKey) == 32, "Summary key is hashed as bytes");
+    static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2, "Atomics shared between processes must be lock-free");
+
+    static constexpr uint32_t kPublished       = 1;
+    static constexpr size_t   kRecordAlignment = alignof(SummaryRecord);
+    static constexpr size_t   kDataAlignment   = 64;
+
+    /**
+     * @brief Returns count of slots holding the count of records at 75% load.
+     */
+    static size_t GetCountOfSlots(size_t countOfRecords) noexcept
+    {
+        size_t count = 4;
+        while (count / 4 * 3 < countOfRecords && count < 0x80000000)
+            count <<= 1;
+
+        return count;
+    }
+
+    /**
+     * @brief Returns offset of the records area.
+     */
+    static uint64_t GetDataOffset(size_t countOfSlots) noexcept
+    {
+        return (sizeof(CacheHeader) + static_cast<uint64_t>(countOfSlots) * sizeof(Slot) + kDataAlignment - 1) & ~static_cast<uint64_t>(kDataAlignment - 1);
+    }
+
+    /**
+     * @brief Returns size of the created cache file.
+     */
+    static size_t GetRequiredSize(size_t countOfRecords, size_t dataCapacity) noexcept
+    {
+        const auto size = GetDataOffset(GetCountOfSlots(countOfRecords)) + dataCapacity;
+        return size <= static_cast<size_t>(-1) ? static_cast<size_t>(size) : 0;
+    }
+
+    /**
+     * @brief Checks the header of the mapped cache.
+     * @return Pointer to the header, or nullptr if the file is not a valid cache.
+     */
+    static CacheHeader* Validate(const MappedFile& file) noexcept
+    {
+        const auto header = reinterpret_cast<CacheHeader*>(const_cast<BYTE*>(file.GetData()));
+        if (!header || file.GetSize() < sizeof(CacheHeader) || header->Signature.load(std::memory_order_acquire) != kSignature || header->Version != kVersion)
+            return nullptr;
+
+        const auto countOfSlots = header->CountOfSlots;
+        if (countOfSlots < 4 || (countOfSlots & (countOfSlots - 1)) || header->DataOffset < GetDataOffset(countOfSlots) || header->DataOffset % kDataAlignment
+            || header->DataOffset > file.GetSize() || header->DataCapacity > file.GetSize() - header->DataOffset)
+            return nullptr;
+
+        return header;
+    }
+
+    /**
+     * @brief Initializes the cache created in the empty file, or checks the existing one.
+     * @return Pointer to the header, or nullptr if the file is not a valid cache.
+     */
+    static CacheHeader* Initialize(const MappedFile& file, size_t countOfRecords, size_t dataCapacity) noexcept
+    {
+        const auto header = reinterpret_cast<CacheHeader*>(file.GetWritableData());
+        if (!header || file.GetSize() < sizeof(CacheHeader))
+            return nullptr;
+
+        // Only the file which was empty is formatted, the contents of any other file are not overwritten.
+        if (!file.IsExtended())
+            return Validate(file);
+
+        const auto countOfSlots = GetCountOfSlots(countOfRecords);
+        const auto dataOffset   = GetDataOffset(countOfSlots);
+        if (!dataCapacity || dataOffset + dataCapacity > file.GetSize())
+            return nullptr;
+
+        header->Version      = kVersion;
+        header->CountOfSlots = static_cast<uint32_t>(countOfSlots);
+        header->DataOffset   = dataOffset;
+        header->DataCapacity = dataCapacity;
+        header->DataUsed.store(0, std::memory_order_relaxed);
+        header->Count.store(0, std::memory_order_relaxed);
+        header->Signature.store(kSignature, std::memory_order_release);
+
+        return Validate(file);
+    }
+
+    /**
+     * @brief Returns 64-bit FNV-1a hash of the key.
+     */
+    static uint64_t Hash(const SummaryKey& key) noexcept { return HashBytes64(&key, sizeof(key)); }
+
+    /**
+     * @brief Returns pointer to the slots table.
+     */
+    Slot* GetSlots() const noexcept { return reinterpret_cast<Slot*>(header_ + 1); }
+
+    /**
+     * @brief Returns view of the record of the published slot, not valid if the slot points outside the records area.
+     */
+    SummaryView GetRecord(const Slot& slot) const noexcept
+    {
+        if (slot.RecordOffset < header_->DataOffset || slot.RecordOffset % kRecordAlignment || slot.RecordSize > header_->DataCapacity
+            || slot.RecordOffset - header_->DataOffset > header_->DataCapacity - slot.RecordSize)
+            return { nullptr, 0 };
+
+        return { file_.GetData() + slot.RecordOffset, slot.RecordSize };
+    }
+
+    MappedFile   file_;
+    CacheHeader* header_;
+};
+
+}
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "PeHeader.h"
+#include "PeInstrumentation.h"
 #include "PeTypes.h"
+#include <type_traits>
 
 namespace pe_iterator {
 
@@ -13,6 +15,9 @@ template<Architecture Arch> class Tls {
 public:
     /**
      * @brief Callback wrapper class with functions.
+     *
+     * The state is a copy of the header and the callback pointer: trivially copyable and independent of the Tls, so
+     * iterators can be stored and handed to other threads while the image data exists.
      */
     class Iterator {
     public:
@@ -21,7 +26,7 @@ public:
          * @param header Image header.
          * @param callback Pointer to first callback function.
          */
-        Iterator(const Header<Arch>& header, const TlsCallback* callback)
+        Iterator(const Header<Arch>& header, const TlsCallback* callback) noexcept
             : header_(header)
             , callback_(callback)
         {
@@ -33,7 +38,7 @@ public:
         const TlsCallback* GetCallback() const noexcept
         {
             const auto rva = static_cast<RVA>(reinterpret_cast<uint64_t>(*callback_) - header_.GetOptionalHeader()->ImageBase);
-            return header_.RvaToVA<TlsCallback>(rva);
+            return header_.template RvaToVA<TlsCallback>(rva);
         }
 
         /**
@@ -43,6 +48,7 @@ public:
 
         Iterator& operator++()
         {
+            PE_ITERATOR_PROBE(kTlsCallbackVisited, 1);
             ++callback_;
             return *this;
         }
@@ -50,21 +56,21 @@ public:
         Iterator operator++(int)
         {
             auto prev = *this;
-            ++callback_;
+            operator++();
             return prev;
         }
 
         bool operator==(const Iterator& other) const noexcept { return callback_ == other.callback_; }
         bool operator!=(const Iterator& other) const { return callback_ != other.callback_; }
-        bool operator==(IteratorEnd) const { return Validate(); }
+        bool operator==(IteratorEnd) const { return !Validate(); }
         bool operator!=(IteratorEnd) const { return Validate(); }
 
         const Iterator& operator*() const { return *this; }
         Iterator&       operator*() { return *this; }
 
     private:
-        const Header<Arch>& header_;
-        const TlsCallback*  callback_;
+        Header<Arch>       header_;
+        const TlsCallback* callback_;
     };
 
     /**
@@ -73,7 +79,18 @@ public:
      */
     explicit Tls(const Header<Arch>& header)
         : header_(header)
-        , directoryDescriptor_(header_.GetDirectoryDescriptor<TlsDirectoryDescriptor<Arch>>(TlsDirectoryIndex)) {};
+        , directoryDescriptor_(header_.template GetDirectoryDescriptor<TlsDirectoryDescriptor<Arch>>(TlsDirectoryIndex))
+    {
+        // Callbacks table of the bounded image is checked once up to the terminating entry.
+        if (directoryDescriptor_ && header_.GetImageSize()) {
+            auto callback = GetCallbacks();
+            while (header_.IsArrayValid(callback, 1) && *callback)
+                ++callback;
+
+            if (!header_.IsArrayValid(callback, 1))
+                directoryDescriptor_ = nullptr;
+        }
+    }
 
     /**
      * @brief Returns pointer to directory descriptor.
@@ -85,9 +102,12 @@ public:
      */
     const TlsCallback* GetCallbacks() const noexcept
     {
+        if (!directoryDescriptor_ || !directoryDescriptor_->AddressOfCallBacks)
+            return nullptr;
+
         return header_.GetImageType() == ImageType::kModule
             ? reinterpret_cast<TlsCallback*>(GetDirectoryDescriptor()->AddressOfCallBacks)
-            : header_.RvaToVA<TlsCallback>(GetDirectoryDescriptor()->AddressOfCallBacks - header_.GetOptionalHeader()->ImageBase);
+            : header_.template RvaToVA<TlsCallback>(GetDirectoryDescriptor()->AddressOfCallBacks - header_.GetOptionalHeader()->ImageBase);
     }
 
     /**
@@ -96,14 +116,17 @@ public:
     bool IsValid() const noexcept { return directoryDescriptor_; }
 
     // Returns an iterator pointing to the beginning of the callback functions.
-    Iterator begin() const noexcept { return { header_, GetCallbacks() }; }
+    Iterator begin() const noexcept { return Iterator(header_, GetCallbacks()); }
 
     // Returns an iterator pointing to the end of the function callback.
     IteratorEnd end() const noexcept { return {}; }
 
 private:
-    const Header<Arch>&                 header_;
+    const Header<Arch>                  header_;
     const TlsDirectoryDescriptor<Arch>* directoryDescriptor_;
+
+    static_assert(std::is_trivially_copyable<Iterator>::value, "Iterators are trivially copyable");
+    static_assert(sizeof(Iterator) == sizeof(Header<Arch>) + sizeof(void*), "Iterators hold the header copy and their position only");
 };
 
 };
\ No newline at end of file
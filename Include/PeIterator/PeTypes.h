@@ -1,16 +1,29 @@
 #pragma once
 
-#if !defined(_WIN32)
-#error Unsupported platform
-#endif
-
+#include <cstddef>
 #include <cstdint>
+
+// Image structures come from Windows.h on Windows and from the self-contained definitions elsewhere.
+#if defined(_WIN32)
 #include <Windows.h>
+#else
+#include "PeWinTypes.h"
+#endif
+
+// Vector instruction sets available to the engines, PE_ITERATOR_NO_SIMD forces scalar code.
+#if !defined(PE_ITERATOR_NO_SIMD)
+#if defined(__AVX2__)
+#define PE_ITERATOR_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PE_ITERATOR_SSE2
+#endif
+#endif
 
 namespace pe_iterator {
 
 // Image architecture.
-enum class Architecture : BYTE { kX32, kX64, kNative = (sizeof(size_t) == sizeof(unsigned long) ? kX32 : kX64) };
+enum class Architecture : BYTE { kX32, kX64, kNative = (sizeof(void*) == 4 ? kX32 : kX64) };
 
 // Image type.
 enum class ImageType : BYTE {
@@ -48,18 +61,31 @@ template<> struct ImportNameTable<Architecture::kX64> : ImportAddressTable<Archi
 template<> struct TlsDirectoryDescriptor<Architecture::kX32> : IMAGE_TLS_DIRECTORY32 { };
 template<> struct TlsDirectoryDescriptor<Architecture::kX64> : IMAGE_TLS_DIRECTORY64 { };
 
+/**
+ * @brief Returns true if the thunk imports by ordinal, for the thunk width of the image rather than of the current process.
+ * @param thunk Pointer to the thunk.
+ */
+template<typename Thunk> constexpr bool IsSnapByOrdinal(const Thunk* thunk) noexcept
+{
+    return (thunk->u1.Ordinal >> (sizeof(thunk->u1.Ordinal) * 8 - 1)) != 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Arch-Independent
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 struct IteratorEnd { }; // Iterator sentinel.
 
+#if defined(_MSC_VER)
 #pragma warning(push)
 #pragma warning(disable : 4214) // nonstandard extension
+#endif
 typedef struct {
     WORD offset : 12;
     WORD type : 4;
 } IMAGE_RELOC, *PIMAGE_RELOC;
+#if defined(_MSC_VER)
 #pragma warning(pop)
+#endif
 
 using DosHeader     = IMAGE_DOS_HEADER;
 using FileHeader    = IMAGE_FILE_HEADER;
@@ -77,4 +103,297 @@ using ExportDirectoryDescriptor         = IMAGE_EXPORT_DIRECTORY;
 using BaseRelocationDirectoryDescriptor = IMAGE_BASE_RELOCATION;
 using ExceptionDirectoryDescriptor      = RUNTIME_FUNCTION;
 
+// x64 UNWIND_INFO header, followed by the unwind code slots.
+struct UnwindInfoHeader {
+    BYTE VersionAndFlags;        // Version in the low 3 bits, flags in the high 5 bits.
+    BYTE SizeOfProlog;           // Size of the prolog in bytes.
+    BYTE CountOfCodes;           // Count of the unwind code slots.
+    BYTE FrameRegisterAndOffset; // Frame register in the low 4 bits, frame offset in 16-byte units in the high 4 bits.
+};
+
+// x64 unwind code slot, operations with operands take several slots.
+struct UnwindCodeSlot {
+    BYTE CodeOffset;       // Offset of the end of the prolog instruction.
+    BYTE OperationAndInfo; // Unwind operation in the low 4 bits, operation info in the high 4 bits.
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Utilities
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// FNV-1a parameters used by the name hashes.
+constexpr uint32_t kNameHashOffsetBasis = 0x811C9DC5;
+constexpr uint32_t kNameHashPrime       = 0x01000193;
+
+/**
+ * @brief Calculates 32-bit FNV-1a hash of the null-terminated name.
+ * @param name Pointer to the name.
+ */
+constexpr uint32_t HashName(const char* name) noexcept
+{
+    uint32_t hash = kNameHashOffsetBasis;
+    for (; *name; ++name)
+        hash = (hash ^ static_cast<uint8_t>(*name)) * kNameHashPrime;
+
+    return hash;
+}
+
+/**
+ * @brief Calculates 32-bit FNV-1a hash of the name.
+ * @param name Pointer to the name.
+ * @param length Name length.
+ */
+constexpr uint32_t HashName(const char* name, size_t length) noexcept
+{
+    uint32_t hash = kNameHashOffsetBasis;
+    for (size_t cx = 0; cx < length; ++cx)
+        hash = (hash ^ static_cast<uint8_t>(name[cx])) * kNameHashPrime;
+
+    return hash;
+}
+
+// FNV-1a parameters used by the 64-bit content hashes.
+constexpr uint64_t kContentHashOffsetBasis = 0xCBF29CE484222325;
+constexpr uint64_t kContentHashPrime       = 0x00000100000001B3;
+
+/**
+ * @brief Calculates 64-bit FNV-1a hash of the bytes.
+ * @param data Pointer to the bytes.
+ * @param size Count of bytes.
+ * @param hash Hash of the preceding bytes to continue, by default the offset basis.
+ */
+inline uint64_t HashBytes64(const void* data, size_t size, uint64_t hash = kContentHashOffsetBasis) noexcept
+{
+    const auto bytes = static_cast<const uint8_t*>(data);
+    for (size_t cx = 0; cx < size; ++cx)
+        hash = (hash ^ bytes[cx]) * kContentHashPrime;
+
+    return hash;
+}
+
+/**
+ * @brief Returns ASCII lower case of the character.
+ */
+constexpr char ToLowerAscii(char character) noexcept { return character >= 'A' && character <= 'Z' ? static_cast<char>(character - 'A' + 'a') : character; }
+
+/**
+ * @brief Calculates 32-bit FNV-1a hash of the ASCII lower case of the null-terminated name.
+ * @param name Pointer to the name.
+ */
+constexpr uint32_t HashNameInsensitive(const char* name) noexcept
+{
+    uint32_t hash = kNameHashOffsetBasis;
+    for (; *name; ++name)
+        hash = (hash ^ static_cast<uint8_t>(ToLowerAscii(*name))) * kNameHashPrime;
+
+    return hash;
 }
+
+/**
+ * @brief Compares two null-terminated names ignoring ASCII case.
+ * @return Negative, zero or positive value like strcmp.
+ */
+constexpr int CompareNamesInsensitive(const char* first, const char* second) noexcept
+{
+    while (*first && ToLowerAscii(*first) == ToLowerAscii(*second)) {
+        ++first;
+        ++second;
+    }
+
+    return static_cast<uint8_t>(ToLowerAscii(*first)) - static_cast<uint8_t>(ToLowerAscii(*second));
+}
+
+/**
+ * @brief Bump allocator over a caller-supplied buffer, the storage of the APIs materializing data.
+ *
+ * Allocations are carved off the buffer front to back and never freed individually, the buffer is owned by the caller.
+ * Once the buffer is exhausted, the optional growth callback supplies further blocks, released all at once by Reset,
+ * so per-image scratch is recycled between images in one operation.
+ */
+class Arena {
+public:
+    /**
+     * @brief Growth callback, returns the block of at least the requested size in bytes, or nullptr.
+     */
+    using Grow = void* (*)(void* context, size_t size);
+
+    /**
+     * @brief Release callback of the blocks supplied by the growth callback.
+     */
+    using Release = void (*)(void* context, void* block, size_t size);
+
+    /**
+     * @brief Initialization constructor.
+     * @param buffer Pointer to the buffer, must outlive the arena. May be nullptr if the growth callback is set.
+     * @param capacity Size of the buffer in bytes.
+     * @param grow Optional growth callback.
+     * @param release Optional release callback of the grown blocks.
+     * @param context Context passed to the callbacks.
+     */
+    Arena(void* buffer, size_t capacity, Grow grow = nullptr, Release release = nullptr, void* context = nullptr) noexcept
+        : buffer_(static_cast<BYTE*>(buffer))
+        , capacity_(buffer ? capacity : 0)
+        , size_(0)
+        , initialBuffer_(buffer_)
+        , initialCapacity_(capacity_)
+        , grown_(nullptr)
+        , allocated_(0)
+        , grow_(grow)
+        , release_(release)
+        , context_(context)
+    {
+    }
+
+    /**
+     * @brief Initialization constructor.
+     * @tparam N Size of the buffer in bytes.
+     * @param buffer Buffer, must outlive the arena.
+     * @param grow Optional growth callback.
+     * @param release Optional release callback of the grown blocks.
+     * @param context Context passed to the callbacks.
+     */
+    template<size_t N> explicit Arena(BYTE (&buffer)[N], Grow grow = nullptr, Release release = nullptr, void* context = nullptr) noexcept
+        : Arena(buffer, N, grow, release, context)
+    {
+    }
+
+    Arena(const Arena&)            = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() { Reset(); }
+
+    /**
+     * @brief Allocates the memory block.
+     * @param size Size of the block in bytes.
+     * @param alignment Alignment of the block, a power of two.
+     * @return Pointer to the block, or nullptr if the buffer is exhausted and can not grow.
+     */
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) noexcept
+    {
+        if (const auto block = Carve(size, alignment))
+            return block;
+
+        return Expand(size, alignment) ? Carve(size, alignment) : nullptr;
+    }
+
+    /**
+     * @brief Allocates the uninitialized array.
+     * @tparam T Trivial element type.
+     * @param count Count of elements.
+     * @return Pointer to the array, or nullptr if the buffer is exhausted and can not grow.
+     */
+    template<typename T> T* Allocate(size_t count) noexcept
+    {
+        if (count > static_cast<size_t>(-1) / sizeof(T))
+            return nullptr;
+
+        return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    /**
+     * @brief Releases all allocations at once, returning the grown blocks to the release callback.
+     */
+    void Reset() noexcept
+    {
+        while (grown_) {
+            const auto block = grown_;
+            grown_           = block->Previous;
+            if (release_)
+                release_(context_, block, block->Size);
+        }
+
+        buffer_    = initialBuffer_;
+        capacity_  = initialCapacity_;
+        size_      = 0;
+        allocated_ = 0;
+    }
+
+    /**
+     * @brief Returns count of bytes allocated, including the alignment padding and the headers of the grown blocks.
+     */
+    size_t GetSize() const noexcept { return allocated_ + size_; }
+
+    /**
+     * @brief Returns size of the current block in bytes.
+     */
+    size_t GetCapacity() const noexcept { return capacity_; }
+
+private:
+    /**
+     * @brief Header of the grown block.
+     */
+    struct Block {
+        Block* Previous; // Previously grown block, or nullptr.
+        size_t Size;     // Size of the block in bytes.
+    };
+
+    /**
+     * @brief Allocates the memory block from the current block.
+     */
+    void* Carve(size_t size, size_t alignment) noexcept
+    {
+        const auto base   = reinterpret_cast<uintptr_t>(buffer_);
+        const auto offset = ((base + size_ + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1)) - base;
+        if (!buffer_ || offset > capacity_ || size > capacity_ - offset)
+            return nullptr;
+
+        size_ = offset + size;
+        return buffer_ + offset;
+    }
+
+    /**
+     * @brief Switches to the block of the growth callback, at least twice as large as the current one.
+     * @return false if the arena can not grow.
+     */
+    bool Expand(size_t size, size_t alignment) noexcept
+    {
+        const auto overhead = sizeof(Block) + alignment;
+        if (!grow_ || size > static_cast<size_t>(-1) - overhead)
+            return false;
+
+        auto blockSize = capacity_ <= static_cast<size_t>(-1) / 2 ? capacity_ * 2 : capacity_;
+        if (blockSize < size + overhead)
+            blockSize = size + overhead;
+
+        const auto block = static_cast<Block*>(grow_(context_, blockSize));
+        if (!block)
+            return false;
+
+        *block = { grown_, blockSize };
+        grown_ = block;
+        allocated_ += size_;
+        buffer_   = reinterpret_cast<BYTE*>(block);
+        capacity_ = blockSize;
+        size_     = sizeof(Block);
+        return true;
+    }
+
+    BYTE*   buffer_;
+    size_t  capacity_;
+    size_t  size_;
+    BYTE*   initialBuffer_;
+    size_t  initialCapacity_;
+    Block*  grown_;
+    size_t  allocated_;
+    Grow    grow_;
+    Release release_;
+    void*   context_;
+};
+
+/**
+ * @brief Precalculated name hash, distinguishes hashed lookups from the lookups by ordinal.
+ */
+struct NameHash {
+    uint32_t Value;
+};
+
+namespace literals {
+
+/**
+ * @brief Calculates name hash of the string literal, e.g. constexpr auto hash = "NtClose"_hash.
+ */
+constexpr NameHash operator""_hash(const char* name, size_t length) noexcept { return { HashName(name, length) }; }
+
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,384 @@
+#pragma once
+
+#include "PeHeader.h"
+#include "PeInstrumentation.h"
+#include "PeTypes.h"
+#include <cstring>
+#include <type_traits>
+
+namespace pe_iterator {
+
+/**
+ * @brief Stack frame state of the x64 function at some instruction, as established by its prolog.
+ *
+ * Without a frame register the caller RSP is RSP + StackSize + 8. With the established frame register it is
+ * FrameRegister - FrameOffset + FrameStackSize + 8, which also covers dynamic stack allocations.
+ */
+struct UnwindFrame {
+    DWORD StackSize;        // Bytes RSP was lowered by below the return address.
+    DWORD FrameStackSize;   // Part of StackSize allocated before the frame register was established.
+    DWORD FrameOffset;      // Offset of the frame register from RSP at the establishment.
+    BYTE  FrameRegister;    // Frame register number, meaningful only if FrameEstablished.
+    bool  FrameEstablished; // true if the frame register is established at the instruction.
+    bool  MachineFrame;     // true if a machine frame was pushed, the return address is then part of the machine frame.
+};
+
+/**
+ * @brief A wrapper class over the x64 UNWIND_INFO providing an unwind code iterator.
+ *
+ * Codes are decoded on access directly from the image, chained unwind info is followed without copying.
+ * @tparam Arch Image architecture.
+ */
+template<Architecture Arch> class UnwindInfo {
+public:
+    // Unwind operations.
+    static constexpr BYTE kPushNonvolatile    = 0;
+    static constexpr BYTE kAllocLarge         = 1;
+    static constexpr BYTE kAllocSmall         = 2;
+    static constexpr BYTE kSetFrameRegister   = 3;
+    static constexpr BYTE kSaveNonvolatile    = 4;
+    static constexpr BYTE kSaveNonvolatileFar = 5;
+    static constexpr BYTE kEpilog             = 6;
+    static constexpr BYTE kSpareCode          = 7;
+    static constexpr BYTE kSaveXmm128         = 8;
+    static constexpr BYTE kSaveXmm128Far      = 9;
+    static constexpr BYTE kPushMachineFrame   = 10;
+
+    // UNWIND_INFO flags.
+    static constexpr BYTE kFlagExceptionHandler   = 0x1;
+    static constexpr BYTE kFlagTerminationHandler = 0x2;
+    static constexpr BYTE kFlagChainInfo          = 0x4;
+
+    // Maximal count of chained unwind infos followed, protects from the cyclic chains.
+    static constexpr size_t kMaxChainDepth = 32;
+
+    /**
+     * @brief Unwind code iterator, advances by the count of slots of the current operation.
+     */
+    class CodeIterator {
+    public:
+        /**
+         * @brief Initialization constructor.
+         * @param slots Pointer to the unwind code slots.
+         * @param count Count of the slots.
+         * @param index The base index of the slot from which the iteration will begin. By default, 0.
+         */
+        CodeIterator(const UnwindCodeSlot* slots, size_t count, size_t index = 0) noexcept
+            : slots_(slots)
+            , count_(count)
+            , index_(index)
+        {
+        }
+
+        /**
+         * @brief Returns index of the current slot.
+         */
+        size_t GetIndex() const noexcept { return index_; }
+
+        /**
+         * @brief Returns offset of the end of the prolog instruction.
+         */
+        BYTE GetCodeOffset() const noexcept { return slots_[index_].CodeOffset; }
+
+        /**
+         * @brief Returns unwind operation.
+         */
+        BYTE GetOperation() const noexcept { return slots_[index_].OperationAndInfo & 0x0F; }
+
+        /**
+         * @brief Returns operation info.
+         */
+        BYTE GetInfo() const noexcept { return slots_[index_].OperationAndInfo >> 4; }
+
+        /**
+         * @brief Returns count of slots of the current operation.
+         */
+        size_t GetSlots() const noexcept { return GetSlots(slots_[index_]); }
+
+        /**
+         * @brief Returns size of the stack allocation for kAllocSmall, kAllocLarge and kPushMachineFrame or the offset of the
+         * saved register for kSaveNonvolatile/kSaveXmm128 and their far variants, 0 otherwise.
+         */
+        DWORD GetOperand() const noexcept
+        {
+            switch (GetOperation()) {
+            case kAllocSmall: return GetInfo() * 8 + 8;
+            case kAllocLarge: return GetInfo() ? GetDword(1) : GetWord(1) * 8;
+            case kPushMachineFrame: return GetInfo() ? 48 : 40;
+            case kSaveNonvolatile: return GetWord(1) * 8;
+            case kSaveXmm128: return GetWord(1) * 16;
+            case kSaveNonvolatileFar:
+            case kSaveXmm128Far: return GetDword(1);
+            default: return 0;
+            }
+        }
+
+        /**
+         * @brief Returns true if the operation and its operand slots lie within the codes array.
+         */
+        bool IsValid() const noexcept { return index_ < count_ && GetSlots() <= count_ - index_; }
+
+        CodeIterator& operator++()
+        {
+            PE_ITERATOR_PROBE(kUnwindCodeVisited, 1);
+            index_ += GetSlots();
+            return *this;
+        }
+
+        CodeIterator operator++(int)
+        {
+            const auto prev = *this;
+            operator++();
+            return prev;
+        }
+
+        bool operator==(const CodeIterator& other) const noexcept { return index_ == other.index_; }
+        bool operator!=(const CodeIterator& other) const noexcept { return index_ != other.index_; }
+        bool operator==(IteratorEnd) const noexcept { return !IsValid(); }
+        bool operator!=(IteratorEnd) const noexcept { return IsValid(); }
+
+        const CodeIterator& operator*() const { return *this; }
+        CodeIterator&       operator*() { return *this; }
+
+        /**
+         * @brief Returns count of slots of the operation.
+         * @param slot Operation slot.
+         */
+        static size_t GetSlots(const UnwindCodeSlot& slot) noexcept
+        {
+            switch (slot.OperationAndInfo & 0x0F) {
+            case kAllocLarge: return (slot.OperationAndInfo >> 4) ? 3 : 2;
+            case kSaveNonvolatile:
+            case kSaveXmm128:
+            case kEpilog: return 2;
+            case kSaveNonvolatileFar:
+            case kSaveXmm128Far:
+            case kSpareCode: return 3;
+            default: return 1;
+            }
+        }
+
+    private:
+        WORD GetWord(size_t slot) const noexcept
+        {
+            WORD value;
+            memcpy(&value, &slots_[index_ + slot], sizeof(value));
+            return value;
+        }
+
+        DWORD GetDword(size_t slot) const noexcept
+        {
+            DWORD value;
+            memcpy(&value, &slots_[index_ + slot], sizeof(value));
+            return value;
+        }
+
+        const UnwindCodeSlot* slots_;
+        size_t                count_;
+        size_t                index_;
+    };
+
+    /**
+     * @brief Initialization constructor.
+     * @param header Image header.
+     * @param function Pointer to the runtime function, see Exception<Arch>. Indirect entries referencing another runtime
+     * function are resolved.
+     */
+    UnwindInfo(const Header<Arch>& header, const ExceptionDirectoryDescriptor* function) noexcept
+        : header_(header)
+        , info_(nullptr)
+    {
+        // Runtime function with the lowest bit of the unwind data set points to the primary runtime function.
+        for (size_t depth = 0; function && (function->UnwindData & 1) && depth < kMaxChainDepth; ++depth)
+            function = Validate(header_.template RvaToVA<const ExceptionDirectoryDescriptor>(function->UnwindData & ~1u));
+
+        if (function && !(function->UnwindData & 1))
+            info_ = Validate(header_.template RvaToVA<const UnwindInfoHeader>(function->UnwindData));
+    }
+
+    /**
+     * @brief Returns pointer to the UNWIND_INFO header.
+     */
+    const UnwindInfoHeader* GetUnwindInfo() const noexcept { return info_; }
+
+    /**
+     * @brief Returns true if the unwind info is present and lies within the image.
+     */
+    bool IsValid() const noexcept { return info_ != nullptr; }
+
+    /**
+     * @brief Returns UNWIND_INFO version.
+     */
+    BYTE GetVersion() const noexcept { return info_->VersionAndFlags & 0x07; }
+
+    /**
+     * @brief Returns UNWIND_INFO flags.
+     */
+    BYTE GetFlags() const noexcept { return info_->VersionAndFlags >> 3; }
+
+    /**
+     * @brief Returns size of the prolog in bytes.
+     */
+    BYTE GetSizeOfProlog() const noexcept { return info_->SizeOfProlog; }
+
+    /**
+     * @brief Returns count of the unwind code slots.
+     */
+    BYTE GetCountOfCodes() const noexcept { return info_->CountOfCodes; }
+
+    /**
+     * @brief Returns frame register number, 0 if the function does not use a frame register.
+     */
+    BYTE GetFrameRegister() const noexcept { return info_->FrameRegisterAndOffset & 0x0F; }
+
+    /**
+     * @brief Returns offset of the frame register from RSP in bytes.
+     */
+    DWORD GetFrameOffset() const noexcept { return (info_->FrameRegisterAndOffset >> 4) * 16; }
+
+    /**
+     * @brief Returns RVA of the language-specific handler, or 0.
+     */
+    RVA GetExceptionHandler() const noexcept
+    {
+        if ((GetFlags() & kFlagChainInfo) || !(GetFlags() & (kFlagExceptionHandler | kFlagTerminationHandler)))
+            return 0;
+
+        RVA handler;
+        memcpy(&handler, GetTrailer(), sizeof(handler));
+        return handler;
+    }
+
+    /**
+     * @brief Returns pointer to the language-specific handler data, or nullptr.
+     */
+    const BYTE* GetExceptionData() const noexcept { return GetExceptionHandler() ? GetTrailer() + sizeof(RVA) : nullptr; }
+
+    /**
+     * @brief Returns chained runtime function, or nullptr.
+     */
+    const ExceptionDirectoryDescriptor* GetChainedFunction() const noexcept
+    {
+        return GetFlags() & kFlagChainInfo ? reinterpret_cast<const ExceptionDirectoryDescriptor*>(GetTrailer()) : nullptr;
+    }
+
+    /**
+     * @brief Returns unwind info of the chained runtime function, not valid if the info is not chained.
+     */
+    UnwindInfo GetChained() const noexcept { return UnwindInfo(header_, GetChainedFunction()); }
+
+    /**
+     * @brief Computes the frame state at the offset from the function begin, following the chained infos.
+     *
+     * Prolog codes are applied up to the offset, codes of the chained infos are applied entirely. Epilogs are not
+     * detected, the offset is assumed to be in the prolog or the body.
+     * @param codeOffset Offset of the instruction from the begin of the runtime function.
+     * @param frame Receives the frame state.
+     * @return false if the info or some chained info is not valid.
+     */
+    bool GetFrame(DWORD codeOffset, UnwindFrame& frame) const noexcept
+    {
+        frame = {};
+
+        DWORD framed = 0;
+        if (!Accumulate(codeOffset, frame, framed, 0))
+            return false;
+
+        frame.FrameStackSize = frame.FrameEstablished ? frame.StackSize - framed : 0;
+        return true;
+    }
+
+    /**
+     * @brief Returns an iterator pointing to the first unwind code.
+     */
+    CodeIterator begin() const noexcept { return CodeIterator(GetSlots(), info_ ? info_->CountOfCodes : 0); }
+
+    /**
+     * @brief Returns an iterator pointing to the end of unwind codes.
+     */
+    IteratorEnd end() const noexcept { return {}; }
+
+private:
+    /**
+     * @brief Applies codes of this info and of the chained ones to the frame state.
+     * @param codeOffset Offset of the instruction from the begin of the runtime function.
+     * @param frame Frame state.
+     * @param framed Receives StackSize at the frame register establishment.
+     * @param depth Depth of this info in the chain.
+     * @return false if this or some chained info is not valid.
+     */
+    bool Accumulate(DWORD codeOffset, UnwindFrame& frame, DWORD& framed, size_t depth) const noexcept
+    {
+        if (!IsValid() || depth >= kMaxChainDepth)
+            return false;
+
+        for (const auto& code : *this) {
+            // Prolog codes of the function itself apply once their instruction is executed.
+            if (depth == 0 && code.GetCodeOffset() > codeOffset)
+                continue;
+
+            switch (code.GetOperation()) {
+            case kPushNonvolatile: frame.StackSize += 8; break;
+            case kAllocSmall:
+            case kAllocLarge: frame.StackSize += code.GetOperand(); break;
+            case kPushMachineFrame:
+                frame.StackSize += code.GetOperand();
+                frame.MachineFrame = true;
+                break;
+            case kSetFrameRegister:
+                frame.FrameEstablished = true;
+                frame.FrameRegister    = GetFrameRegister();
+                frame.FrameOffset      = GetFrameOffset();
+                framed                 = frame.StackSize;
+                break;
+            default: break;
+            }
+        }
+
+        return !(GetFlags() & kFlagChainInfo) || GetChained().Accumulate(codeOffset, frame, framed, depth + 1);
+    }
+
+    /**
+     * @brief Returns pointer to the unwind code slots.
+     */
+    const UnwindCodeSlot* GetSlots() const noexcept { return info_ ? reinterpret_cast<const UnwindCodeSlot*>(info_ + 1) : nullptr; }
+
+    /**
+     * @brief Returns pointer past the slots array aligned to the even count of slots.
+     */
+    const BYTE* GetTrailer() const noexcept { return reinterpret_cast<const BYTE*>(GetSlots() + ((info_->CountOfCodes + 1) & ~1)); }
+
+    /**
+     * @brief Returns the runtime function if it lies within the bounded image.
+     */
+    const ExceptionDirectoryDescriptor* Validate(const ExceptionDirectoryDescriptor* function) const noexcept
+    {
+        return header_.IsArrayValid(function, 1) ? function : nullptr;
+    }
+
+    /**
+     * @brief Returns the unwind info if its header, slots and the trailer lie within the bounded image.
+     */
+    const UnwindInfoHeader* Validate(const UnwindInfoHeader* info) const noexcept
+    {
+        if (!header_.IsArrayValid(info, 1))
+            return nullptr;
+
+        const auto flags   = info->VersionAndFlags >> 3;
+        size_t     trailer = 0;
+        if (flags & kFlagChainInfo)
+            trailer = sizeof(ExceptionDirectoryDescriptor);
+        else if (flags & (kFlagExceptionHandler | kFlagTerminationHandler))
+            trailer = sizeof(RVA);
+
+        const size_t size = sizeof(UnwindInfoHeader) + ((info->CountOfCodes + 1) & ~1) * sizeof(UnwindCodeSlot) + trailer;
+        return header_.IsRangeValid(info, size) ? info : nullptr;
+    }
+
+    const Header<Arch>      header_;
+    const UnwindInfoHeader* info_;
+
+    static_assert(std::is_trivially_copyable<CodeIterator>::value, "Iterators are trivially copyable");
+};
+
+}